@@ -28,6 +28,8 @@ FileHistory::FileHistory(QObject* p, Git* g) : QAbstractItemModel(p), git(g) {
   headerInfo << "Graph" << "Id" << "Short Log" << "Commit" << "Author" << "Author Date";
   lns = new Lanes();
   revs.reserve(QGit::MAX_DICT_SIZE);
+  displayCache.setMaxCost(64); // blocks of DISPLAY_BLOCK rows
+  displayHashLen = 0;
   clear(); // after _headerInfo is set
 
   connect(git, SIGNAL(newRevsAdded(const FileHistory*, const QVector<ShaString>&)),
@@ -73,6 +75,74 @@ const QString FileHistory::sha(int row) const {
   return (row < 0 || row >= rowCnt ? "" : QString(revOrder.at(row)));
 }
 
+void FileHistory::addRow(const ShaString& sha, const Rev* r) {
+
+  revs.insert(sha, r);
+  revOrder.append(sha);
+  indexRow(revOrder.count() - 1, r);
+}
+
+void FileHistory::indexRow(int row, const Rev* r) {
+
+  rowRev.append(r);
+  authorCol.append(git->authorId(r));
+  dateCol.append(r->authorTime());
+/*
+        Lanes and graph code run on integer keys instead of sha strings. A
+        row gets its own index as key unless a child already referenced it,
+        in that case it inherits the key given to the still missing parent.
+        Pending keys are negative, starting from -2, so to not clash with
+        rows and with Lanes::NO_KEY.
+*/
+  QHash<ShaString, int>::iterator it(pendingKeys.find(r->sha()));
+  if (it != pendingKeys.end()) {
+    rowKey.append(it.value());
+    keyRow[-it.value() - 2] = row;
+    pendingKeys.erase(it);
+  } else
+    rowKey.append(row);
+
+  for (uint i = 0; i < r->parentsCount(); i++) {
+
+    const ShaString par(r->parent(i));
+    const Rev* p = revs.value(par);
+    if (p && p->orderIdx >= 0 && p->orderIdx < row && revOrder[p->orderIdx] == par) {
+      parKey.append(rowKey[p->orderIdx]);
+      continue;
+    }
+    int& k = pendingKeys[par]; // points into r data, alive as long as r is
+    if (k == 0) {
+      keyRow.append(-1);
+      k = -keyRow.count() - 1;
+    }
+    parKey.append(k);
+  }
+  parKeyOfs.append(parKey.count());
+}
+
+int FileHistory::parentRow(int row, int parNum) const {
+// row of a parent given by its key, -1 if the parent is not loaded
+
+  int y = parKeyOfs[row] + parNum;
+  if (parNum < 0 || y >= parKeyOfs[row + 1])
+    return -1;
+
+  int k = parKey[y];
+  return (k >= 0 ? k : keyRow[-k - 2]);
+}
+
+void FileHistory::resetKeys() {
+
+  rowRev.clear();
+  authorCol.clear();
+  dateCol.clear();
+  rowKey.clear();
+  parKey.clear();
+  parKeyOfs.fill(0, 1);
+  pendingKeys.clear();
+  keyRow.clear();
+}
+
 void FileHistory::flushTail() {
 
   if (earlyOutputCnt < 0 || earlyOutputCnt >= revOrder.count()) {
@@ -96,10 +166,67 @@ void FileHistory::flushTail() {
   }
   firstFreeLane = earlyOutputCntBase;
   lns->clear();
+  clearDisplayCache();
+  // pending keys could point into removed revisions, so restart from
+  // scratch, this is rare and anyhow much cheaper than reloading
+  resetKeys();
+  for (int i = 0; i < revOrder.count(); i++)
+    indexRow(i, revs[revOrder[i]]);
+
+  parOfs.clear();
+  parIdx.clear();
+  childOfs.clear();
+  childIdx.clear();
+  reach.clear();
   rowCnt = revOrder.count();
   endResetModel();
 }
 
+void FileHistory::buildGraph() {
+// called when loading is finished, resolve parent keys to rows so that
+// children and ancestor queries do not need to walk the history
+
+  int cnt = revOrder.count();
+  if (rowKey.count() != cnt) {
+    dbp("ASSERT in FileHistory::buildGraph(), %1 keys", rowKey.count());
+    return;
+  }
+  QVector<int> linPar(cnt, -1);
+  parOfs.resize(cnt + 1);
+  parIdx.clear();
+  parIdx.reserve(parKey.count());
+  for (int i = 0; i < cnt; i++) {
+
+    parOfs[i] = parIdx.count();
+    for (int y = parKeyOfs[i]; y < parKeyOfs[i + 1]; y++) {
+      int k = parKey[y];
+      int p = (k >= 0 ? k : keyRow[-k - 2]);
+      if (p != -1)
+        parIdx.append(p);
+    }
+    if (parKeyOfs[i + 1] - parKeyOfs[i] == 1 && parIdx.count() > parOfs[i])
+      linPar[i] = parIdx.last(); // merges break the linear chain
+  }
+  parOfs[cnt] = parIdx.count();
+
+  // children are filled scanning rows in order, so
+  // come out already sorted by loading order
+  childOfs.fill(0, cnt + 1);
+  for (int i = 0; i < parIdx.count(); i++)
+    childOfs[parIdx[i] + 1]++;
+
+  for (int i = 0; i < cnt; i++)
+    childOfs[i + 1] += childOfs[i];
+
+  QVector<int> pos(childOfs);
+  childIdx.resize(parIdx.count());
+  for (int i = 0; i < cnt; i++)
+    for (int y = parOfs[i]; y < parOfs[i + 1]; y++)
+      childIdx[pos[parIdx[y]]++] = i;
+
+  reach.build(parOfs, parIdx, linPar);
+}
+
 void FileHistory::clear(bool complete) {
 
   if (!complete) {
@@ -113,6 +240,12 @@ void FileHistory::clear(bool complete) {
   qDeleteAll(revs);
   revs.clear();
   revOrder.clear();
+  resetKeys();
+  parOfs.clear();
+  parIdx.clear();
+  childOfs.clear();
+  childIdx.clear();
+  reach.clear();
   firstFreeLane = loadTime = earlyOutputCntBase = 0;
   setEarlyOutputState(false);
   lns->clear();
@@ -120,6 +253,7 @@ void FileHistory::clear(bool complete) {
   curFNames.clear();
   qDeleteAll(rowData);
   rowData.clear();
+  clearDisplayCache(); // date format could be changed
 
   if (testFlag(REL_DATE_F)) {
 #if QT_VERSION >= 0x060000
@@ -186,6 +320,8 @@ void FileHistory::on_loadCompleted(const FileHistory* fh, const QString&) {
 
 void FileHistory::on_changeFont(const QFont& f) {
 
+  clearDisplayCache();
+
   QString maxStr(QString::number(rowCnt).length() + 1, '8');
   QFontMetrics fmRows(f);
   int neededWidth = fmRows.boundingRect(maxStr).width();
@@ -253,6 +389,60 @@ const QString FileHistory::timeDiff(unsigned long secs) const {
   return tmp;
 }
 
+void FileHistory::clearDisplayCache() const {
+
+  displayCache.clear();
+  displayHashLen = git->shortHashLength();
+}
+
+const FileHistory::DisplayRow* FileHistory::displayRow(int row) const {
+/*
+        data() is called for each cell many times while scrolling, so text
+        columns are formatted once for a block of rows around the requested
+        one and kept in a LRU of blocks. Last block could be still growing,
+        in this case it is formatted again when new rows are asked.
+*/
+  if (displayHashLen != git->shortHashLength())
+    clearDisplayCache();
+
+  int blk = row / DISPLAY_BLOCK;
+  int first = blk * DISPLAY_BLOCK;
+  DisplayBlock* db = displayCache.object(blk);
+  if (db && row - first < db->rows.count())
+    return &db->rows.at(row - first);
+
+  int last = qMin(first + DISPLAY_BLOCK, revOrder.count()) - 1;
+  if (row > last)
+    return NULL;
+
+  // lanes are computed here too, for all the rows up to last one
+  const Rev* lr = git->revLookup(revOrder.at(last), this);
+  if (lr && lr->lanes.count() == 0)
+    git->setLane(lr->sha(), const_cast<FileHistory*>(this));
+
+  db = new DisplayBlock;
+  db->rows.resize(last - first + 1);
+  for (int i = first; i <= last; i++) {
+
+    const Rev* r = git->revLookup(revOrder.at(i), this);
+    if (!r)
+      continue;
+
+    DisplayRow& dr = db->rows[i - first];
+    dr.log = r->shortLog();
+    dr.hash = r->shortHash(displayHashLen);
+    dr.author = git->authorName(authorCol[i]);
+    if (r->sha() != QGit::ZERO_SHA_RAW) {
+      if (secs != 0) // secs is 0 for absolute date
+        dr.time = timeDiff(secs - dateCol[i]);
+      else
+        dr.time = git->getLocalDate(dateCol[i]);
+    }
+  }
+  displayCache.insert(blk, db);
+  return &db->rows.at(row - first);
+}
+
 QVariant FileHistory::data(const QModelIndex& index, int role) const {
 
   static const QVariant no_value;
@@ -263,34 +453,27 @@ QVariant FileHistory::data(const QModelIndex& index, int role) const {
     return no_value; // fast path, 90% of calls ends here!
   }
 
-  const Rev* r = git->revLookup(revOrder.at(index.row()), this);
-  if (!r)
+  // lanes are calculated in displayRow() too
+  const DisplayRow* dr = displayRow(index.row());
+  if (!dr)
     return no_value;
 
   int col = index.column();
 
-  // calculate lanes
-  if (r->lanes.count() == 0)
-    git->setLane(r->sha(), const_cast<FileHistory*>(this));
-
   if (col == QGit::ANN_ID_COL)
     return (annIdValid ? rowCnt - index.row() : QVariant());
 
   if (col == QGit::LOG_COL)
-    return r->shortLog();
+    return dr->log;
 
   if (col == QGit::HASH_COL)
-    return r->shortHash(git->shortHashLength());
+    return dr->hash;
 
   if (col == QGit::AUTH_COL)
-    return r->author();
+    return dr->author;
 
-  if (col == QGit::TIME_COL && r->sha() != QGit::ZERO_SHA_RAW) {
+  if (col == QGit::TIME_COL)
+    return dr->time;
 
-    if (secs != 0) // secs is 0 for absolute date
-      return timeDiff(secs - r->authorDate().toULong());
-    else
-      return git->getLocalDate(r->authorDate());
-  }
   return no_value;
 }
@@ -11,7 +11,9 @@
 #define FILEHISTORY_H
 
 #include <QAbstractItemModel>
+#include <QCache>
 #include "common.h"
+#include "reachability.h"
 
 //class Annotate;
 //class DataLoader;
@@ -53,16 +55,44 @@ private:
   friend class DataLoader;
   friend class Git;
 
+  struct DisplayRow { // preformatted text columns of a row
+    QVariant log, hash, author, time;
+  };
+  struct DisplayBlock {
+    QVector<DisplayRow> rows;
+  };
+  enum { DISPLAY_BLOCK = 64 }; // rows formatted together, see displayRow()
+
+  void addRow(const ShaString& sha, const Rev* r);
+  void indexRow(int row, const Rev* r);
+  int parentRow(int row, int parNum) const;
+  void resetKeys();
   void flushTail();
+  void buildGraph();
+  bool isGraphReady() const { return reach.count() == revOrder.count(); }
   const QString timeDiff(unsigned long secs) const;
+  const DisplayRow* displayRow(int row) const;
+  void clearDisplayCache() const;
 
   Git* git;
   RevMap revs;
   ShaVect revOrder;
   Lanes* lns;
+  QVector<int> rowKey;          // lanes key of each row, see indexRow()
+  QVector<const Rev*> rowRev;   // revision of each row, lanes are read by row
+  QVector<int> parKeyOfs, parKey; // keys of all the parents of each row
+  QHash<ShaString, int> pendingKeys; // parents still to be loaded
+  QVector<int> keyRow;          // row of pending key k at keyRow[-k - 2]
+  QVector<int> parOfs, parIdx;  // loaded parents of each row, see buildGraph()
+  QVector<int> childOfs, childIdx; // children of each row, in loading order
+  QVector<int> authorCol;       // interned author of each row, see Git::authorId()
+  QVector<qint64> dateCol;      // author date of each row, seconds since epoch
+  Reachability reach;
   uint firstFreeLane;
   QList<QByteArray*> rowData;
   QList<QVariant> headerInfo;
+  mutable QCache<int, DisplayBlock> displayCache; // blocks around the viewport
+  mutable int displayHashLen;
   int rowCnt;
   bool annIdValid;
   unsigned long secs;
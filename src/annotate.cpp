@@ -6,11 +6,14 @@
 	Copyright: See COPYING file that comes with this distribution
 
 */
+#include <string.h>
+#include <algorithm>
 #include <QApplication>
 #include <QTimer>
 #include "FileHistory.h"
 #include "git.h"
 #include "myprocess.h"
+#include "cache.h"
 #include "annotate.h"
 
 #define MAX_AUTHOR_LEN 16
@@ -25,31 +28,71 @@ Annotate::Annotate(Git* parent, QObject* guiObj) : QObject(parent) {
 	gui = guiObj;
 	cancelingAnnotate = annotateRunning = annotateActivity = false;
 	valid = canceled = isError = false;
+	worker = NULL;
+	annDoneCnt = 0;
+	wantedRow = -1;
+	blameRow = -1;
+	cachedCnt = 0;
 
 	connect(this, SIGNAL(annotateReady(Annotate*, bool, const QString&)),
 	        git, SIGNAL(annotateReady(Annotate*, bool, const QString&)));
 }
 
 const FileAnnotation* Annotate::lookupAnnotation(SCRef sha) {
+// while annotation is running only already computed revisions are
+// found, a missing one is requested to be annotated as next
 
-	if (!valid || sha.isEmpty())
+	if (!(valid || annotateRunning) || sha.isEmpty())
 		return NULL;
 
 	AnnotateHistory::const_iterator it = ah.constFind(toTempSha(sha));
-	if (it != ah.constEnd())
-		return &(it.value());
+	if (it != ah.constEnd()) {
+		if (!it->isValid)
+			setPriority(sha);
+
+		return (it->isValid || isPartial(&(it.value())) ? &(it.value()) : NULL);
+	}
+	// file sha are known only once patches are collected
+	if (!(valid || worker))
+		return NULL;
 
 	// ok, we are not lucky. Check for an ancestor before to give up
-	int shaIdx;
-	const QString ancestorSha = getAncestor(sha, &shaIdx);
-	if (!ancestorSha.isEmpty()) {
-		it = ah.constFind(toTempSha(ancestorSha));
-		if (it != ah.constEnd())
+	int shaIdx = ancestorRow(sha);
+	if (shaIdx != -1) {
+		it = ah.constFind(histRevOrder[shaIdx]);
+		if (it != ah.constEnd() && !it->isValid)
+			wantRow(shaIdx);
+
+		if (it != ah.constEnd() && (it->isValid || isPartial(&(it.value()))))
 			return &(it.value());
 	}
 	return NULL;
 }
 
+int Annotate::ancestorRow(SCRef sha) {
+// lookups are repeated while annotating and range filtering,
+// so avoid to run git again for the same revision
+
+	int shaIdx = lookupAncestors.value(sha, -1);
+	if (shaIdx == -1) {
+		if (getAncestor(sha, &shaIdx).isEmpty())
+			return -1;
+
+		lookupAncestors.insert(sha, shaIdx);
+	}
+	return (shaIdx >= 0 && shaIdx < histRevOrder.count() ? shaIdx : -1);
+}
+
+bool Annotate::isPartial(const FileAnnotation* fa) const {
+// true if fa is still filled by git blame
+
+	if (blameRow == -1 || fa->isValid)
+		return false;
+
+	AnnotateHistory::const_iterator it = ah.constFind(histRevOrder[blameRow]);
+	return (it != ah.constEnd() && &(it.value()) == fa);
+}
+
 void Annotate::deleteWhenDone() {
 
 	if (!EM_IS_PENDING(exAnnCanceled))
@@ -58,6 +101,11 @@ void Annotate::deleteWhenDone() {
 	if (annotateRunning)
 		cancelingAnnotate = true;
 
+	if (worker)
+		worker->cancel(); // on_workerDone() will be called soon
+
+	cancelBlame();
+
 	on_deleteWhenDone();
 }
 
@@ -82,13 +130,15 @@ bool Annotate::start(const FileHistory* _fh) {
 	annotateRunning = true;
 
 	// init AnnotateHistory
-	annFilesNum = 0;
 	annId = histRevOrder.count();
 	annNumLen = QString::number(histRevOrder.count()).length();
 	ShaVect::const_iterator it(histRevOrder.constBegin());
-	do
+	do {
+		histRows.insert(*it, histRows.count());
 		ah.insert(*it, FileAnnotation(annId--));
-	while (++it != histRevOrder.constEnd());
+	} while (++it != histRevOrder.constEnd());
+
+	loadCache(); // unchanged revisions are available at once
 
 	// annotating the file history could be time consuming,
 	// so return now and use a timer to start annotation
@@ -97,15 +147,35 @@ bool Annotate::start(const FileHistory* _fh) {
 }
 
 void Annotate::slotComputeDiffs() {
+// patches are collected here, then annotation runs in a worker
+// thread and results are published while they are computed
 
 	processingTime.start();
 
-	if (!cancelingAnnotate)
-		annotateFileHistory(); // now could call Qt event loop
+	QVector<AnnotateWorker::Job> jobs;
+	if (cancelingAnnotate || !prepareJobs(jobs)) { // now could call Qt event loop
+		annotateDone();
+		return;
+	}
+	annDoneCnt = 0;
+	for (int i = 0; i < jobs.count(); i++)
+		if (jobs[i].isPreset)
+			annDoneCnt++;
+
+	worker = new AnnotateWorker(this, jobs, wantedRow);
+	connect(worker, SIGNAL(progress()), this, SLOT(on_workerProgress()));
+	connect(worker, SIGNAL(finished()), this, SLOT(on_workerDone()));
+	worker->start(QThread::LowPriority);
+}
+
+void Annotate::annotateDone() {
 
 	valid = !(isError || cancelingAnnotate);
 	canceled = cancelingAnnotate;
 	cancelingAnnotate = annotateRunning = false;
+	if (valid && cachedCnt < histRevOrder.count())
+		Cache::saveAnnotation(git->getGitDir(), annCacheKey, histRevOrder, ah);
+
 	if (canceled)
 		deleteWhenDone();
 	else {
@@ -115,106 +185,256 @@ void Annotate::slotComputeDiffs() {
 	}
 }
 
-void Annotate::annotateFileHistory() {
+void Annotate::on_workerProgress() {
 
-	// sweep from the oldest to newest so that parent
-	// annotations are calculated before children
-	ShaVect::const_iterator it(histRevOrder.constEnd());
-	do {
-		--it;
-		doAnnotate(*it);
-	} while (it != histRevOrder.constBegin() && !isError && !cancelingAnnotate);
+	if (!worker)
+		return;
+
+	const QVector<int> rows(worker->takeFinished());
+	for (int i = 0; i < rows.count(); i++) {
+
+		if (rows[i] == blameRow)
+			cancelBlame(); // history was faster
+
+		FileAnnotation& fa = ah[histRevOrder[rows[i]]];
+		if (!fa.isValid) { // otherwise already blamed
+			fa.lines = worker->result(rows[i]); // implicitly shared
+			fa.isValid = true;
+		}
+	}
+	annDoneCnt += rows.count();
+	if (!rows.isEmpty() && !cancelingAnnotate)
+		emit annotateProgress(annDoneCnt, histRevOrder.count());
 }
 
-void Annotate::doAnnotate(const ShaString& ss) {
-// all the parents annotations must be valid here
+void Annotate::on_workerDone() {
+
+	on_workerProgress(); // last results
+	isError = isError || worker->hasError() || (annDoneCnt != histRevOrder.count() && !cancelingAnnotate);
+	delete worker;
+	worker = NULL;
+	annotateDone();
+}
 
-	const QString sha(ss);
-	FileAnnotation* fa = getFileAnnotation(sha);
-	if (fa == NULL || fa->isValid || isError || cancelingAnnotate)
+void Annotate::setPriority(SCRef sha) {
+// annotation of sha is wanted now, only its missing ancestors are
+// computed before it. Could be called before the worker is started
+
+	if (!sha.isEmpty())
+		wantRow(histRows.value(toTempSha(sha), -1));
+}
+
+void Annotate::wantRow(int row) {
+
+	if (!annotateRunning || row < 0 || row == wantedRow)
 		return;
 
-	const Rev* r = git->revLookup(ss, fh); // historyRevs
-	if (r == NULL) {
-		dbp("ASSERT doAnnotate: no revision %1", sha);
-		isError = true;
+	wantedRow = row;
+	if (worker)
+		worker->setPriority(row);
+
+	startBlame(row);
+}
+
+void Annotate::startBlame(int row) {
+
+	if (row == blameRow)
 		return;
-	}
-	const QString& diff(getPatch(sha)); // set FileAnnotation::fileSha
-	if (r->parentsCount() == 0) { // initial revision
-		setInitialAnnotation(ah[ss].fileSha, fa); // calls Qt event loop
-		fa->isValid = true;
+
+	cancelBlame();
+
+	// with renames the blamed path changes along history, leave to worker
+	if (fh->fileNames().count() != 1 || ah[histRevOrder[row]].isValid)
+		return;
+
+	blameProc = git->getBlame(histRevOrder[row], fh->fileNames().first(), this);
+	if (!blameProc)
 		return;
+
+	blameRow = row;
+	blameTime.start();
+}
+
+void Annotate::cancelBlame() {
+// partial lines are left in place, they are not valid and will
+// be overwritten by worker result or by a following blame
+
+	if (blameProc)
+		blameProc->on_cancel();
+
+	blameProc = NULL;
+	blameRow = -1;
+	blame.clear();
+	blameIds.clear();
+}
+
+void Annotate::procReadyRead(const QByteArray& data) {
+
+	if (sender() != blameProc)
+		return;
+
+	blame.append(data);
+
+	// throttle GUI updates
+	if (blameTime.elapsed() > 100) {
+		publishBlame(false);
+		blameTime.restart();
 	}
-	// now create a new annotation from first parent diffs
-	const QStringList& parents(r->parents());
-	const QString& parSha = parents.first();
-	FileAnnotation* pa = getFileAnnotation(parSha);
+}
+
+void Annotate::procFinished() {
+
+	if (sender() != blameProc)
+		return;
+
+	blame.finish();
+
+	// nothing found means an error, as example a path
+	// not existing in revision, so wait for the worker
+	publishBlame(!blame.isEmpty());
+	blameProc = NULL; // auto-deleted
+	cancelBlame();
+}
+
+void Annotate::publishBlame(bool complete) {
 
-	if (!pa || !pa->isValid) {
-		dbp("ASSERT in doAnnotate: annotation for %1 not valid", parSha);
-		isError = true;
+	FileAnnotation& fa = ah[histRevOrder[blameRow]];
+	if (fa.isValid || blame.isEmpty()) // worker was faster
 		return;
+
+	// a revision not in file history, as example a
+	// boundary one, has no annotation id
+	const QVector<QByteArray>& commits = blame.commits();
+	for (int i = blameIds.count(); i < commits.count(); i++) {
+		AnnotateHistory::const_iterator a(ah.constFind(toTempSha(QString::fromLatin1(commits[i]))));
+		blameIds.append(a != ah.constEnd() ? a->annId : AnnotationLines::NO_ORIGIN);
 	}
-	const QString& author(setupAuthor(r->author(), fa->annId));
-	setAnnotation(diff, author, pa->lines, fa->lines);
+	blame.toAnnotation(blameIds, &fa.lines);
+	fa.isValid = complete;
+	emit annotateProgress(annDoneCnt, histRevOrder.count());
+}
 
-	// then add other parents diff if any
-	QStringList::const_iterator it(parents.constBegin());
-	++it;
-	int parentNum = 1;
-	while (it != parents.constEnd()) {
+bool Annotate::prepareJobs(QVector<AnnotateWorker::Job>& jobs) {
+// runs in GUI thread, sweep from the oldest to newest so
+// that parents file sha are known before children ones
 
-		FileAnnotation* pa = getFileAnnotation(*it);
-		const QString& diff(getPatch(sha, parentNum++));
-		QStringList tmpAnn;
-		setAnnotation(diff, "Merge", pa->lines, tmpAnn);
+	jobs.resize(histRevOrder.count());
+	for (int i = histRevOrder.count() - 1; i >= 0 && !cancelingAnnotate; i--) {
 
-		// the two annotations must be of the same length
-		if (fa->lines.count() != tmpAnn.count()) {
-			qDebug("ASSERT: merging annotations of different length\n merging "
-			       "%s in %s", (*it).toLatin1().constData(), sha.toLatin1().constData());
+		const ShaString& ss = histRevOrder[i];
+		const QString sha(ss);
+		AnnotateWorker::Job& job = jobs[i];
+		job.annId = ah[ss].annId;
+		job.initLines = 0;
+		job.isPreset = false;
+
+		const Rev* r = git->revLookup(ss, fh); // historyRevs
+		if (r == NULL) {
+			dbp("ASSERT prepareJobs: no revision %1", sha);
 			isError = true;
-			return;
+			return false;
+		}
+		job.diffs.append(getRawPatch(sha)); // set FileAnnotation::fileSha
+		if (ah[ss].isValid) { // from cache or already blamed
+			job.isPreset = true;
+			job.preset = ah[ss].lines;
+			job.diffs.clear();
+			continue;
+		}
+		if (r->parentsCount() == 0) { // initial revision
+			job.initLines = setInitialAnnotation(ah[ss].fileSha); // calls Qt event loop
+			job.diffs.clear();
+			continue;
+		}
+		const QStringList parents(r->parents());
+		for (int y = 0; y < parents.count(); y++) {
+
+			int p = histRows.value(toTempSha(parents[y]), -1);
+			if (p <= i) { // parents must be already annotated
+				dbp("ASSERT in prepareJobs: annotation for %1 not valid", parents[y]);
+				isError = true;
+				return false;
+			}
+			job.parents.append(p);
+			if (y > 0)
+				job.diffs.append(getRawPatch(sha, y));
 		}
-		// finally we unify the annotations
-		unify(tmpAnn, fa->lines);
-		fa->lines = tmpAnn;
-		++it;
 	}
-	fa->isValid = true;
+	return !cancelingAnnotate;
 }
 
-FileAnnotation* Annotate::getFileAnnotation(SCRef sha) {
+const QString Annotate::cacheKey() {
+// annotation of a revision depends only on its ancestry, that is the same
+// if renames and history start are unchanged, so that revisions already
+// annotated are still valid when new ones are added on top
 
-	AnnotateHistory::iterator it(ah.find(toTempSha(sha)));
-	if (it == ah.end()) {
-		dbp("ASSERT getFileAnnotation: no revision %1", sha);
-		isError = true;
-		return NULL;
+	QString roots;
+	FOREACH (ShaVect, it, histRevOrder) {
+		const Rev* r = git->revLookup(*it, fh);
+		if (r && r->parentsCount() == 0)
+			roots.append(QString(*it) + " ");
 	}
-	return &(*it);
+	return fh->fileNames().join("\n") + "\n" + roots;
 }
 
-void Annotate::setInitialAnnotation(SCRef fileSha, FileAnnotation* fa) {
+void Annotate::loadCache() {
+
+	annCacheKey = cacheKey();
+	cachedCnt = 0;
+
+	StrVect revs, fileShas;
+	QVector<int> ids;
+	QVector<AnnotationLines> lines;
+	if (!Cache::loadAnnotation(git->getGitDir(), annCacheKey, revs, ids, fileShas, lines))
+		return;
+
+	// saved annotation ids could be shifted by new revisions
+	int maxId = 0;
+	for (int i = 0; i < ids.count(); i++)
+		maxId = qMax(maxId, ids[i]);
+
+	QVector<int> newIds(maxId + 1, AnnotationLines::NO_ORIGIN);
+	for (int i = 0; i < revs.count(); i++) {
+		AnnotateHistory::const_iterator it(ah.constFind(toTempSha(revs[i])));
+		if (it != ah.constEnd() && ids[i] > 0)
+			newIds[ids[i]] = it->annId;
+	}
+	// file sha are set sweeping from the oldest, see patchRev()
+	for (int i = histRevOrder.count() - 1; i >= 0; i--)
+		patchRev(histRevOrder[i]);
+
+	for (int i = 0; i < revs.count(); i++) {
+
+		AnnotateHistory::iterator it(ah.find(toTempSha(revs[i])));
+		if (it == ah.end() || it->fileSha != fileShas[i]) // content changed
+			continue;
+
+		if (!lines[i].mapOrigins(newIds))
+			continue;
+
+		it->lines = lines[i];
+		it->isValid = true;
+		cachedCnt++;
+	}
+}
+
+int Annotate::setInitialAnnotation(SCRef fileSha) {
 
 	QByteArray fileData;
 
 	// fh->fileNames() are in cronological order, so we need the last one
 	git->getFile(fileSha, NULL, &fileData, fh->fileNames().last()); // calls Qt event loop
 	if (cancelingAnnotate)
-		return;
+		return 0;
 
 	int lineNum = fileData.count('\n');
 	if (!fileData.endsWith('\n') && !fileData.isEmpty()) // No newline at end of file
 		lineNum++;
 
-	const QString empty;
-	for (int i = 0; i < lineNum; i++)
-		fa->lines.append(empty);
+	return lineNum;
 }
 
-const QString Annotate::setupAuthor(SCRef origAuthor, int annId) {
+static QString shortAuthor(SCRef origAuthor) {
 
 	QString tmp(origAuthor.section('<', 0, 0).trimmed()); // strip e-mail address
 	if (tmp.isEmpty()) { // probably only e-mail
@@ -232,30 +452,121 @@ const QString Annotate::setupAuthor(SCRef origAuthor, int annId) {
 
 		tmp.truncate(MAX_AUTHOR_LEN);
 	}
-	return QString("%1.%2").arg(annId, annNumLen).arg(tmp);
+	return tmp;
 }
 
-void Annotate::unify(SList dst, SCList src) {
+const QString Annotate::setupAuthor(int authorId, int annId) {
 
-	const QString m("Merge");
-	for (int i = 0; i < dst.size(); ++i) {
-		if (dst.at(i) == m)
-			dst[i] = src.at(i);
+	QHash<int, QString>::const_iterator it(shortAuthors.constFind(authorId));
+	if (it == shortAuthors.constEnd())
+		it = shortAuthors.insert(authorId, shortAuthor(git->authorName(authorId)));
+
+	return QString("%1.%2").arg(annId, annNumLen).arg(it.value());
+}
+
+const QString Annotate::originLabel(int origin) {
+// annotation ids count down from the newest revision
+
+	if (origin == AnnotationLines::MERGE)
+		return "Merge";
+
+	int idx = histRevOrder.count() - origin;
+	if (origin == AnnotationLines::NO_ORIGIN || idx < 0 || idx >= histRevOrder.count())
+		return "";
+
+	const Rev* r = git->revLookup(histRevOrder[idx], fh);
+	return (r ? setupAuthor(git->authorId(r), origin) : "");
+}
+
+//
+//  Lines of previous revision that are kept, and lines added by the patch,
+//  come in runs that are appended to the new annotation in bulk.
+//
+class AnnotationBuilder {
+public:
+	AnnotationBuilder(const AnnotationLines& p, AnnotationLines& n, int o)
+	                  : prev(p), ann(n), origin(o), keepFrom(0), keepCnt(0), addCnt(0) {}
+
+	void keep(int from, int cnt) { // lines of prev starting from 'from'
+
+		flushAdded();
+		if (keepCnt && keepFrom + keepCnt == from) {
+			keepCnt += cnt;
+			return;
+		}
+		flushKept();
+		keepFrom = from;
+		keepCnt = cnt;
 	}
+	void add() { flushKept(); addCnt++; }
+	void flush() { flushKept(); flushAdded(); }
+
+private:
+	void flushKept() { ann.append(prev, keepFrom, keepCnt); keepCnt = 0; }
+	void flushAdded() { ann.append(origin, addCnt); addCnt = 0; }
+
+	const AnnotationLines& prev;
+	AnnotationLines& ann;
+	int origin, keepFrom, keepCnt, addCnt;
+};
+
+static const char* parseNum(const char* p, const char* eol, int* num) {
+
+	if (p == eol || *p < '0' || *p > '9')
+		return NULL;
+
+	for (*num = 0; p < eol && *p >= '0' && *p <= '9'; p++)
+		*num = *num * 10 + (*p - '0');
+	return p;
+}
+
+static bool parseHunkHeader(const char* line, const char* eol, int* oldStart,
+                            int* oldCnt, int* newStart, int* newCnt) {
+// an unified diff fragment header has form '@@ -a,b +c,d @@' where 'a'
+// is old file line number and 'b' is old file number of lines of the
+// hunk, 'c' and 'd' are the same for new file. If the file does not
+// have enough lines then also the form '@@ -a +c @@' is used.
+
+	const char* p = static_cast<const char*>(memchr(line, '-', eol - line));
+	if (!p || !(p = parseNum(p + 1, eol, oldStart)))
+		return false;
+
+	*oldCnt = 1;
+	if (*p == ',' && !(p = parseNum(p + 1, eol, oldCnt)))
+		return false;
+
+	p = static_cast<const char*>(memchr(p, '+', eol - p));
+	if (!p || !(p = parseNum(p + 1, eol, newStart)))
+		return false;
+
+	*newCnt = 1;
+	if (p < eol && *p == ',' && !parseNum(p + 1, eol, newCnt))
+		return false;
+
+	return true;
 }
 
-bool Annotate::setAnnotation(SCRef diff, SCRef author, SCList prevAnn, SList newAnn, int ofs) {
+bool Annotate::setAnnotation(const QByteArray& diff, int origin, const AnnotationLines& prevAnn, AnnotationLines& newAnn) {
+// static, called also by AnnotateWorker
+// raw patch bytes are scanned in place, lines kept from previous revision
+// and added ones are appended by runs, so both memory and time depend
+// on the number of hunks and not on the file length
 
 	newAnn.clear();
-	QStringList::const_iterator cur(prevAnn.constBegin());
-	QString line;
-	int idx = 0, num, lineNumStart, lineNumEnd;
+	AnnotationBuilder ann(prevAnn, newAnn, origin);
+	const int prevCnt = prevAnn.count();
 	int curLineNum = 1; // warning, starts from 1 instead of 0
 	bool inHeader = true;
+	const char* line = diff.constData();
+	const char* end = line + diff.size();
+
+	for (const char* eol; line < end; line = (eol < end ? eol + 1 : end)) {
 
-	while (getNextSection(diff, idx, line, "\n")) {
+		eol = static_cast<const char*>(memchr(line, '\n', end - line));
+		if (!eol)
+			eol = end;
 
-		char firstChar = line.at(0).toLatin1();
+		char firstChar = (line < eol ? *line : '\n');
 
 		if (inHeader) {
 			if (firstChar == '@')
@@ -264,361 +575,398 @@ bool Annotate::setAnnotation(SCRef diff, SCRef author, SCList prevAnn, SList new
 				continue;
 		}
 		switch (firstChar) {
-		case '@':
-			// an unified diff fragment header has form '@@ -a,b +c,d @@'
-			// where 'a' is old file line number and 'b' is old file
-			// number of lines of the hunk, 'c' and 'd' are the same
-			// for new file. If the file does not have enough lines
-			// then also the form '@@ -a +c @@' is used.
-			if (ofs == 0)
-				lineNumStart = line.indexOf('-') + 1;
-			else
-			// in this case we are given diff fragments with
-			// faked small files that span the fragment plus
-			// some padding. So we use 'c' instead of 'a' to
-			// find the beginning of our patch in the faked file,
-			// this value will be offsetted by ofs later
-				lineNumStart = line.indexOf('+') + 1;
-
-			lineNumEnd = line.indexOf(',', lineNumStart);
-			if (lineNumEnd == -1) // small file case
-				lineNumEnd = line.indexOf(' ', lineNumStart);
-
-			num = line.mid(lineNumStart, lineNumEnd - lineNumStart).toInt();
-			num -= ofs; // offset for range filter computation
-
-			// diff lines start from 1, 0 is empty file,
-			// instead QValueList::at() starts from 0
-			if (num < 0 || num > prevAnn.size()) {
+		case '@': {
+			int num = -1, oldCnt, newStart, newCnt;
+			parseHunkHeader(line, eol, &num, &oldCnt, &newStart, &newCnt);
+
+			// diff lines start from 1, 0 is empty file
+			if (num < 0 || num > prevCnt) {
 				dbp("ASSERT setAnnotation: start line number is %1", num);
-				isError = true;
 				return false;
 			}
-			for ( ; curLineNum < num; ++curLineNum) {
-				newAnn.append(*cur);
-				++cur;
+			if (curLineNum < num) {
+				ann.keep(curLineNum - 1, num - curLineNum);
+				curLineNum = num;
 			}
 			break;
+		}
 		case '+':
-			newAnn.append(author);
+			ann.add();
 			break;
 		case '-':
-			if (curLineNum > prevAnn.size()) {
+			if (curLineNum > prevCnt) {
 				dbp("ASSERT setAnnotation: remove end of "
-				    "file, diff is %1", diff);
-				isError = true;
+				    "file, diff is %1", QString::fromLatin1(diff));
 				return false;
-			} else {
-				++cur;
-				++curLineNum;
 			}
+			++curLineNum;
 			break;
 		case '\\':
 			// diff(1) produces a "\ No newline at end of file", but the
 			// message is locale dependent, so just test the space after '\'
-			if (line[1] == ' ')
+			if (line + 1 < eol && line[1] == ' ')
 				break;
 
 			// fall through
 		default:
-			if (curLineNum > prevAnn.size()) {
+			if (curLineNum > prevCnt) {
 				dbp("ASSERT setAnnotation: end of "
-				    "file reached, diff is %1", diff);
-				isError = true;
+				    "file reached, diff is %1", QString::fromLatin1(diff));
 				return false;
-			} else {
-				newAnn.append(*cur);
-				++cur;
-				++curLineNum;
 			}
+			ann.keep(curLineNum - 1, 1);
+			++curLineNum;
 			break;
 		}
 	}
 	// copy the tail
-	for ( ; curLineNum <= prevAnn.size(); ++curLineNum) {
-		newAnn.append(*cur);
-		++cur;
-	}
+	ann.keep(curLineNum - 1, prevCnt - curLineNum + 1);
+	ann.flush();
 	return true;
 }
 
-const QString Annotate::getPatch(SCRef sha, int parentNum) {
+const Rev* Annotate::patchRev(SCRef sha, int parentNum) {
+// revision with patch of sha against parentNum, set FileAnnotation::fileSha
 
 	QString mergeSha(sha);
 	if (parentNum)
 		mergeSha = QString::number(parentNum) + " m " + sha;
 
 	const Rev* r = git->revLookup(mergeSha, fh);
-	if (!r)
-		return QString();
-
-	const QString diff(r->diff());
+	if (!r || parentNum)
+		return r;
 
 	QVector<QByteArray> ba;
-	const ShaString& ss = toPersistentSha(sha, ba);
-
-	if (ah[ss].fileSha.isEmpty() && !parentNum) {
+	FileAnnotation& fa = ah[toPersistentSha(sha, ba)];
+	if (fa.fileSha.isEmpty()) {
 
+		const QByteArray diff(r->diffRaw());
 		int idx = diff.indexOf("..");
 		if (idx != -1)
-			ah[ss].fileSha = diff.mid(idx + 2, 40);
+			fa.fileSha = QString::fromLatin1(diff.constData() + idx + 2, qMin(40, diff.size() - idx - 2));
 		else // file mode change only, same sha of parent
-			ah[ss].fileSha = ah[r->parent(0)].fileSha;
+			fa.fileSha = ah[r->parent(0)].fileSha;
 	}
-	return diff;
+	return r;
 }
 
-bool Annotate::getNextSection(SCRef d, int& idx, QString& sec, SCRef target) {
+const QByteArray Annotate::getRawPatch(SCRef sha, int parentNum) {
+// a deep copy, could be used after file history is released
 
-	if (idx >= d.length())
-		return false;
+	const Rev* r = patchRev(sha, parentNum);
+	if (!r)
+		return QByteArray();
+
+	const QByteArray diff(r->diffRaw());
+	return QByteArray(diff.constData(), diff.size());
+}
 
-	int newIdx = d.indexOf(target, idx);
-	if (newIdx == -1) // last section, take all
-		newIdx = d.length() - 1;
 
-	sec = d.mid(idx, newIdx - idx + 1);
-	idx = newIdx + 1;
-	return true;
+
+// ***************************** ANNOTATE WORKER ****************************
+
+
+
+AnnotateWorker::AnnotateWorker(QObject* p, const QVector<Job>& j, int wantedRow)
+                               : QThread(p), jobs(j), priority(wantedRow), canceled(false), isError(false) {
+
+	results.resize(jobs.count());
+	done.fill(false, jobs.count());
+	for (int i = 0; i < jobs.count(); i++)
+		if (jobs[i].isPreset) {
+			results[i] = jobs[i].preset;
+			done[i] = true;
+		}
 }
 
+AnnotateWorker::~AnnotateWorker() {
 
-// ****************************** RANGE FILTER *****************************
+	cancel();
+	wait();
+}
 
+void AnnotateWorker::setPriority(int row) {
 
+	QMutexLocker lock(&mutex);
+	priority = row;
+}
 
-bool Annotate::getRange(SCRef sha, RangeInfo* r) {
+const QVector<int> AnnotateWorker::takeFinished() {
 
-	if (!ranges.contains(sha) || !valid || canceled) {
-		r->clear();
+	QMutexLocker lock(&mutex);
+	QVector<int> rows(finished);
+	finished.clear();
+	return rows;
+}
+
+static void unify(AnnotationLines& dst, const AnnotationLines& src) {
+// lines added by the merge are the ones not coming from first parent
+
+	QVector<int> d(dst.toVector());
+	const QVector<int> s(src.toVector());
+	for (int i = 0; i < d.count(); ++i) {
+		if (d[i] == AnnotationLines::MERGE)
+			d[i] = s[i];
+	}
+	dst.fromVector(d);
+}
+
+bool AnnotateWorker::annotate(int row) {
+// all the parents annotations must be valid here
+
+	const Job& job = jobs[row];
+	AnnotationLines& fa = results[row];
+
+	if (job.parents.isEmpty()) { // initial revision
+		fa.append(AnnotationLines::NO_ORIGIN, job.initLines);
+		return true;
+	}
+	// now create a new annotation from first parent diffs
+	if (!Annotate::setAnnotation(job.diffs[0], job.annId, results[job.parents[0]], fa))
 		return false;
+
+	// then add other parents diff if any
+	for (int i = 1; i < job.parents.count(); i++) {
+
+		AnnotationLines tmpAnn;
+		if (!Annotate::setAnnotation(job.diffs[i], AnnotationLines::MERGE, results[job.parents[i]], tmpAnn))
+			return false;
+
+		// the two annotations must be of the same length
+		if (fa.count() != tmpAnn.count()) {
+			dbp("ASSERT: merging annotations of different length in row %1", row);
+			return false;
+		}
+		// finally we unify the annotations
+		unify(tmpAnn, fa);
+		fa = tmpAnn;
 	}
-	*r = ranges[sha]; // by copy
 	return true;
 }
 
-void Annotate::updateCrossRanges(SCRef chunk, bool rev, int fileLen, int ofs, RangeInfo* r) {
+void AnnotateWorker::getAncestry(int row, QVector<int>& rows) {
+// rows not yet annotated that are needed by row, row included,
+// sorted so that parents, that always follow children, come first
+
+	rows.clear();
+	if (done[row])
+		return;
+
+	QVector<int> stack(1, row);
+	done[row] = true; // as visited, reset below
+	while (!stack.isEmpty()) {
+		int r = stack.last();
+		stack.pop_back();
+		rows.append(r);
+		for (int i = 0; i < jobs[r].parents.count(); i++) {
+			int p = jobs[r].parents[i];
+			if (!done[p]) {
+				done[p] = true;
+				stack.append(p);
+			}
+		}
+	}
+	for (int i = 0; i < rows.count(); i++)
+		done[rows[i]] = false;
 
-/* here the deal is to fake a file that will be modified by chunk, the
-   file must contain also the whole output range.
+	std::sort(rows.begin(), rows.end());
+	std::reverse(rows.begin(), rows.end());
+}
 
-   Then we apply an annotation step and see what happens...
+void AnnotateWorker::run() {
+// the ancestry of a wanted row is annotated first, otherwise
+// rows are annotated from the oldest to newest
 
-   First we mark each line of the file with the corresponding line number,
-   then apply the patch and check where the lines have been moved around.
+	QElapsedTimer lastProgress;
+	lastProgress.start();
+	int next = jobs.count() - 1;
+	QVector<int> todo;
 
-   Now we have to cases:
+	while (!canceled) {
 
-   - In reverse case we infer the before-patch range knowing the after-patch range.
-     So we check what lines we have in the region corresponding to after-patch range.
+		int pr;
+		{
+			QMutexLocker lock(&mutex);
+			pr = priority;
+			priority = -1;
+		}
+		if (pr >= 0 && pr < jobs.count())
+			getAncestry(pr, todo);
 
-   - In forward case we infer the after-patch range knowing the before-patch range.
-     So we scan the resulting annotation to find line numbers corresponding to the
-     before-patch range.
+		if (todo.isEmpty()) {
+			pr = -1;
+			while (next >= 0 && done[next])
+				next--;
 
-*/
-	// because of the padding the file first line number will be
-	//
-	// fileFirstLineNr = newLineId - beforePadding = fileOffset + 1
-	QStringList beforeAnn;
-	QStringList afterAnn;
-	for (int lineNum = ofs + 1; lineNum <= ofs + fileLen; lineNum++)
-		beforeAnn.append(QString::number(lineNum));
-
-	const QString fakedAuthor("*");
-	setAnnotation(chunk, fakedAuthor, beforeAnn, afterAnn, ofs);
-	int newStart = ofs + 1;
-	int newEnd = ofs + fileLen;
-
-	if (rev) {
-		// let's see what line number we have at given range interval limits.
-		// at() counts from 0.
-		//QLinkedList<QString>::const_iterator itStart(afterAnn.at(r->start - ofs - 1));
-		//QLinkedList<QString>::const_iterator itEnd(afterAnn.at(r->end - ofs - 1));
-		QStringList::const_iterator itStart(afterAnn.constBegin());
-		for (int i = 0; i < r->start - ofs - 1; i++)
-			++itStart;
-
-		QStringList::const_iterator itEnd(afterAnn.constBegin());
-		for (int i = 0; i < r->end - ofs - 1; i++)
-			++itEnd;
-
-		bool leftExtended = (*itStart == fakedAuthor);
-		bool rightExtended = (*itEnd == fakedAuthor);
-
-		// if range boundary is a line added by the patch
-		// we consider inclusive and extend the range
-		++itStart;
-		do {
-			--itStart;
-			if (*itStart != fakedAuthor) {
-				newStart = (*itStart).toInt();
+			if (next < 0)
 				break;
-			}
-		} while (itStart != afterAnn.constBegin());
 
-		while (itEnd != afterAnn.constEnd()) {
+			todo.append(next);
+		}
+		for (int i = 0; i < todo.count() && !canceled; i++) {
 
-			if (*itEnd != fakedAuthor) {
-				newEnd = (*itEnd).toInt();
-				break;
+			int row = todo[i];
+			if (!annotate(row)) {
+				isError = true;
+				return;
+			}
+			done[row] = true;
+			{
+				QMutexLocker lock(&mutex);
+				finished.append(row);
 			}
-			++itEnd;
 		}
-		if (leftExtended && *itStart != fakedAuthor)
-			newStart++;
+		todo.clear();
 
-		if (rightExtended && itEnd != afterAnn.constEnd())
-			newEnd--;
+		// throttle GUI updates, but publish a wanted row at once
+		if (pr >= 0 || lastProgress.elapsed() > 100) {
+			emit progress();
+			lastProgress.restart();
+		}
+	}
+}
 
-		r->modified = (leftExtended || rightExtended);
 
-		if (!r->modified) { // check for consecutive sequence
-			for (int i = r->start; i <= r->end; ++i, ++itStart)
-				if (i - r->start != (*itStart).toInt() - newStart) {
-					r->modified = true;
-					break;
-				}
-		}
-		if (newStart > newEnd) // selected range is whole inside new added lines
-			newStart = newEnd = 0;
+// ****************************** RANGE FILTER *****************************
 
-	} else { // forward case
 
-		// scan afterAnn to check for before-patch range boundaries
-		QStringList::const_iterator itStart(afterAnn.constEnd());
-		QStringList::const_iterator itEnd(afterAnn.constEnd());
 
-		QStringList::const_iterator it(afterAnn.constBegin());
-		for (int lineNum = ofs + 1; it != afterAnn.constEnd(); ++lineNum, ++it) {
+bool Annotate::getRange(SCRef sha, RangeInfo* r) {
 
-			if (*it != fakedAuthor) {
+	if (!ranges.contains(sha) || !(valid || annotateRunning) || canceled) {
+		r->clear();
+		return false;
+	}
+	*r = ranges[sha]; // by copy
+	return true;
+}
 
-				if ((*it).toInt() <= r->start) {
-					newStart = lineNum;
-					itStart = it;
-				}
-				if (  (*it).toInt() >= r->end
-				    && itEnd == afterAnn.constEnd()) { // one-shot
-					newEnd = lineNum;
-					itEnd = it;
-				}
-			}
-		}
-		if (itStart != afterAnn.constEnd() && (*itStart).toInt() < r->start)
-			newStart++;
+bool LineMap::parse(const QByteArray& diff) {
+// the runs of not changed lines are the gaps between hunks plus hunks
+// context lines. Line 0 is faked as not changed, so that a deleted
+// range at the beginning of the file maps to the beginning
 
-		if (itEnd != afterAnn.constEnd() && (*itEnd).toInt() > r->end)
-			newEnd--;
+	oldStarts.clear();
+	newStarts.clear();
+	lens.clear();
+	if (diff.isEmpty())
+		return false;
+
+	appendRun(0, 0, 1);
+	int oldCur = 1, newCur = 1;
+	bool inHeader = true;
+	const char* line = diff.constData();
+	const char* end = line + diff.size();
+
+	for (const char* eol; line < end; line = (eol < end ? eol + 1 : end)) {
 
-		r->modified = (itStart == afterAnn.constEnd() || itEnd == afterAnn.constEnd());
+		eol = static_cast<const char*>(memchr(line, '\n', end - line));
+		if (!eol)
+			eol = end;
 
-		if (!r->modified) { // check for consecutive sequence
-			for (int i = r->start; i <= r->end; ++itStart, i++)
-				if ((*itStart).toInt() != i) {
-				r->modified = true;
+		char firstChar = (line < eol ? *line : '\n');
+		if (inHeader && firstChar != '@')
+			continue;
+
+		switch (firstChar) {
+		case '@': {
+			int oldStart, oldCnt, newStart, newCnt;
+			if (!parseHunkHeader(line, eol, &oldStart, &oldCnt, &newStart, &newCnt)) {
+				dbs("ASSERT in LineMap::parse: bad hunk header");
+				return false;
+			}
+			inHeader = false;
+
+			// with no old lines 'a' is the line after which new ones are added
+			int gap = (oldCnt == 0 ? oldStart + 1 : oldStart) - oldCur;
+			appendRun(oldCur, newCur, gap);
+			oldCur += gap;
+			newCur += gap;
+			break;
+		}
+		case '+':
+			newCur++;
+			break;
+		case '-':
+			oldCur++;
+			break;
+		case '\\':
+			if (line + 1 < eol && line[1] == ' ') // "\ No newline at end of file"
 				break;
-				}
+
+			// fall through
+		default:
+			appendRun(oldCur++, newCur++, 1);
+			break;
 		}
-		if (newStart > newEnd) // selected range has been deleted
-			newStart = newEnd = 0;
 	}
-	r->start = newStart;
-	r->end = newEnd;
+	appendRun(oldCur, newCur, OPEN_RUN); // tail is not changed
+	return true;
 }
 
-void Annotate::updateRange(RangeInfo* r, SCRef diff, bool reverse) {
+void LineMap::appendRun(int oldStart, int newStart, int len) {
+
+	if (len <= 0)
+		return;
+
+	int last = lens.count() - 1;
+	if (   last >= 0
+	    && oldStarts[last] + lens[last] == oldStart
+	    && newStarts[last] + lens[last] == newStart) {
+		lens[last] += len;
+		return;
+	}
+	oldStarts.append(oldStart);
+	newStarts.append(newStart);
+	lens.append(len);
+}
+
+void LineMap::mapRange(RangeInfo* r, bool reverse) const {
+// a boundary line changed by the patch is moved to the nearest not changed
+// line, toward the inside of the range. Range is flagged as modified if
+// it is not whole inside a run of not changed lines
 
 	r->modified = false;
-	if (r->start == 0)
+	if (r->start == 0 || lens.isEmpty())
 		return;
 
-	// r(start, end) is updated after each chunk incrementally and
-	// not at the end of the whole diff to be always in sync with
-	// chunk headers that are updated in the same way by GNU diff.
-	//
-	// so in case of reverse we have to apply the chunks from last
-	// one to first.
-	int idx = 0;
-	QString chunk;
-	QStringList chunkList;
-	while (getNextSection(diff, idx, chunk, "\n@"))
-		if (reverse)
-			chunkList.prepend(chunk);
-		else
-			chunkList.append(chunk);
-
-	QStringList::const_iterator chunkIt(chunkList.constBegin());
-	while (chunkIt != chunkList.constEnd()) {
-
-		// an unified diff fragment header has form '@@ -a,b +c,d @@'
-		// where 'a' is old file line number and 'b' is old file
-		// number of lines of the hunk, 'c' and 'd' are the same
-		// for new file. If the file does not have enough lines
-		// then also the form '@@ -a +c @@' is used.
-		chunk  = *chunkIt++;
-		int m  = chunk.indexOf('-');
-		int c1 = chunk.indexOf(',', m);
-		int p  = chunk.indexOf('+', c1);
-		int c2 = chunk.indexOf(',', p);
-		int e  = chunk.indexOf(' ', c2);
-
-		int oldLineCnt = chunk.mid(c1 + 1, p - c1 - 2).toInt();
-		int newLineId = chunk.mid(p + 1, c2 - p - 1).toInt();
-		int newLineCnt = chunk.mid(c2 + 1, e - c2 - 1).toInt();
-		int lineNumDiff = newLineCnt - oldLineCnt;
-
-		// because r(start, end) is updated after each chunk we have to
-		// consider the updated patch delimiters to compare with r(start, end)
-		int patchStart = newLineId;
-
-		// patch end depends only to lines count so is...
-		int patchEnd = patchStart + (reverse ? newLineCnt : oldLineCnt);
-		patchEnd--; // with 1 line patch patchStart == patchEnd
-
-		// case 1: patch range after our range
-		if (patchStart > r->end)
-			continue;
+	const QVector<int>& from = (reverse ? newStarts : oldStarts);
+	const QVector<int>& to = (reverse ? oldStarts : newStarts);
 
-		// case 2: patch range before our range
-		if (patchEnd < r->start) {
-			r->start += (reverse ? -lineNumDiff : lineNumDiff);
-			r->end += (reverse ? -lineNumDiff : lineNumDiff);
-			continue;
-		}
-		// case 3: the patch is whole inside our range
-		if (patchStart >= r->start && patchEnd <= r->end) {
-			r->end += (reverse ? -lineNumDiff : lineNumDiff);
-			r->modified = true;
-			continue;
-		}
-		// case 4: ranges are crossing
-		// add padding so that resulting file is the UNION: selectRange U patchRange
+	// runs that start at or before range boundaries, line 0 is always found
+	int s = std::upper_bound(from.constBegin(), from.constEnd(), r->start) - from.constBegin() - 1;
+	int e = std::upper_bound(from.constBegin(), from.constEnd(), r->end) - from.constBegin() - 1;
+	bool startKept = (r->start < from[s] + lens[s]);
+	bool endKept = (r->end < from[e] + lens[e]); // last run is open, so e + 1 exists if false
 
-		// reverse independent
-		int beforePadding = (r->start > patchStart ? 0 : patchStart - r->start);
+	int newStart = (startKept ? to[s] + r->start - from[s] : to[s] + lens[s]);
+	int newEnd = (endKept ? to[e] + r->end - from[e] : to[e + 1] - 1);
 
-		// reverse dependent
-		int afterPadding = (patchEnd > r->end ? 0 : r->end - patchEnd);
+	r->modified = !(startKept && endKept && s == e);
+	if (newStart > newEnd) // selected range has been deleted or is whole new
+		newStart = newEnd = 0;
 
-		// file is the faked file on which we will apply the diff,
-		// so it is always the _old_ before the patch one.
-		int fileLenght = beforePadding + oldLineCnt + afterPadding;
+	r->start = newStart;
+	r->end = newEnd;
+}
 
-		// given the chunk header @@ -a,b +c,d @@, line nr. 'c' must correspond
-		// to the file line nr. 1 because we have only a partial file.
-		// More, there is also the file padding to consider.
-		// So we need that 'c' corresponds to file line nr. 'beforePadding + 1'
-		//
-		// the transformation in setAnnotation() is
-		//     newLineNum = 'c' - offset = beforePadding + 1
-		// so...
-		int fileOffset = newLineId - beforePadding - 1;
+const LineMap* Annotate::lineMap(SCRef sha) {
+// hunk mappings are parsed once and reused by following range queries
 
-		// because of the padding the file first line number will be
-		//     fileFirstLineNr = newLineId - beforePadding = fileOffset + 1
-		updateCrossRanges(chunk, reverse, fileLenght, fileOffset, r);
+	int row = histRows.value(toTempSha(sha), -1);
+	if (row == -1)
+		return NULL;
+
+	if (lineMaps.count() != histRevOrder.count())
+		lineMaps.resize(histRevOrder.count());
+
+	LineMap& lm = lineMaps[row];
+	if (!lm.isValid()) {
+		const Rev* r = patchRev(sha);
+		if (!r || !lm.parse(r->diffRaw()))
+			return NULL;
 	}
+	return &lm;
 }
 
 const QString Annotate::getAncestor(SCRef sha, int* shaIdx) {
@@ -659,19 +1007,30 @@ const QString Annotate::getAncestor(SCRef sha, int* shaIdx) {
 	// NOTE: more then one revision could have the same file sha as our
 	// input revision. This happens if the patch is reverted or if the patch
 	// modify only file mode but no content. From the point of view of code
-	// range filtering this is equivalent, so we don't care to find the correct
-	// ancestor, but just the first revision with the same file sha
-	for (*shaIdx = 0; *shaIdx < histRevOrder.count(); (*shaIdx)++) {
-
-		const FileAnnotation& fa(ah[histRevOrder[*shaIdx]]);
-		if (fa.fileSha == fileSha)
-			return histRevOrder[*shaIdx];
+	// range filtering this is equivalent, anyhow we prefer a real ancestor
+	// and fall back on the first revision with the same file sha.
+	QStringList candidates;
+	QVector<int> candidatesIdx;
+	for (int i = 0; i < histRevOrder.count(); i++) {
+
+		const FileAnnotation& fa(ah[histRevOrder[i]]);
+		if (fa.fileSha == fileSha) {
+			candidates.append(histRevOrder[i]);
+			candidatesIdx.append(i);
+		}
+	}
+	if (!candidates.isEmpty()) {
+		int best = qMax(git->areAncestors(candidates, sha).indexOf(true), 0);
+		*shaIdx = candidatesIdx[best];
+		return candidates[best];
 	}
 	// ok still not found, this could happen if sha is an unapplied
 	// stgit patch. In this case fall back on the first in the list
 	// that is the newest.
-	if (git->getAllRefSha(Git::UN_APPLIED).contains(sha))
+	if (git->getAllRefSha(Git::UN_APPLIED).contains(sha)) {
+		*shaIdx = 0;
 		return histRevOrder.first();
+	}
 
 	dbp("ASSERT in getAncestor: ancestor of %1 not found", sha);
 	return "";
@@ -683,17 +1042,7 @@ bool Annotate::isDescendant(SCRef sha, SCRef target) {
 // a merge is found the search returns false because you'll need,
 // in general, all the previous ranges to compute the target one.
 
-	const Rev* r = git->revLookup(sha, fh);
-	if (!r)
-		return false;
-
-	int shaIdx = r->orderIdx;
-	r = git->revLookup(target, fh);
-
-	while (r && r->orderIdx < shaIdx && r->parentsCount() == 1)
-		r = git->revLookup(r->parent(0), fh);
-
-	return (r && r->orderIdx == shaIdx);
+	return git->isLinearAncestor(sha, target, fh);
 }
 
 /*
@@ -710,7 +1059,8 @@ const QString Annotate::computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef
 
 	ranges.clear();
 
-	if (!valid || canceled || sha.isEmpty()) {
+	// only patches are needed, so no need to wait for annotation
+	if (!(valid || annotateRunning) || canceled || sha.isEmpty()) {
 		dbp("ASSERT in computeRanges: annotation from %1 not valid", sha);
 		return "";
 	}
@@ -719,17 +1069,13 @@ const QString Annotate::computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef
 	int rangeEnd = paraTo + 1;
 
 	QString ancestor(sha);
-	int shaIdx;
-	QVector<QByteArray> ba;
-	const ShaString& ss = toPersistentSha(sha, ba);
-	for (shaIdx = 0; shaIdx < histRevOrder.count(); shaIdx++)
-		if (histRevOrder[shaIdx] == ss)
-			break;
-
-	if (shaIdx == histRevOrder.count()) { // not in history, find an ancestor
-		ancestor = getAncestor(sha, &shaIdx);
-		if (ancestor.isEmpty())
+	int shaIdx = histRows.value(toTempSha(sha), -1);
+	if (shaIdx == -1) { // not in history, find an ancestor
+		shaIdx = ancestorRow(sha);
+		if (shaIdx == -1)
 			return "";
+
+		ancestor = histRevOrder[shaIdx];
 	}
 	// insert starting one, always included by default, could be removed after
 	ranges.insert(ancestor, RangeInfo(rangeStart, rangeEnd, true));
@@ -743,8 +1089,8 @@ const QString Annotate::computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef
 	QString curRevSha(curRev->sha());
 	while (curRevSha != oldest && !isDirectDescendant) {
 
-		const QString& diff(getPatch(curRevSha));
-		if (diff.isEmpty()) {
+		const LineMap* lm = lineMap(curRevSha);
+		if (!lm) {
 			if (curRev->parentsCount() == 0)  // is initial
 				break;
 
@@ -752,7 +1098,7 @@ const QString Annotate::computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef
 			return "";
 		}
 		RangeInfo r(ranges[curRevSha]);
-		updateRange(&r, diff, true);
+		lm->mapRange(&r, true);
 
 		// special case for modified flag. Mark always the 'after patch' revision
 		// with modified flag, not the before patch. So we have to stick the flag
@@ -800,8 +1146,8 @@ const QString Annotate::computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef
 				ranges.insert(sha, RangeInfo());
 				continue;
 			}
-			const QString& diff(getPatch(sha));
-			if (diff.isEmpty()) {
+			const LineMap* lm = lineMap(sha);
+			if (!lm) {
 				dbp("ASSERT in rangeFilter 2: diff for %1 not found", sha);
 				return "";
 			}
@@ -816,7 +1162,7 @@ const QString Annotate::computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef
 				return "";
 			}
 			RangeInfo r(ranges[parSha]);
-			updateRange(&r, diff, false);
+			lm->mapRange(&r, false);
 			ranges.insert(sha, r);
 
 			if (sha == target) // stop now, no need to continue
@@ -8,9 +8,13 @@
 #define ANNOTATE_H
 
 #include <QElapsedTimer>
+#include <QMutex>
 #include <QObject>
+#include <QPointer>
+#include <QThread>
 #include "exceptionmanager.h"
 #include "common.h"
+#include "blameparser.h"
 
 class Git;
 class FileHistory;
@@ -27,6 +31,82 @@ public:
 };
 typedef QHash<QString, RangeInfo> Ranges;
 
+//
+//  LineMap maps line numbers across the patch of a revision. It stores the
+//  runs of lines not changed by the patch, sorted by both old and new line
+//  numbers, the last run is open and extends to the end of file. So a range
+//  is mapped with two binary searches, whatever the file length is.
+//
+class LineMap {
+public:
+	bool isValid() const { return !lens.isEmpty(); }
+	bool parse(const QByteArray& diff);
+	void mapRange(RangeInfo* r, bool reverse) const;
+
+private:
+	enum { OPEN_RUN = 0x3FFFFFFF };
+
+	void appendRun(int oldStart, int newStart, int len);
+
+	QVector<int> oldStarts, newStarts, lens;
+};
+
+//
+//  AnnotateWorker runs the annotation sweep on immutable copies of the
+//  patches prepared by Annotate. Rows are indices in file history, parents
+//  always follow their children. Finished rows are queued and taken by the
+//  GUI thread with takeFinished(), their result is not modified anymore.
+//
+//  Annotation is demand driven: the ancestry of a wanted row is annotated
+//  first, reusing the rows already done, then the remaining rows are filled
+//  in background from the oldest one.
+//
+class AnnotateWorker : public QThread {
+Q_OBJECT
+public:
+	struct Job {
+		QVector<int> parents; // rows of parents, first parent first
+		QVector<QByteArray> diffs; // raw patch against each parent
+		int annId;
+		int initLines;        // number of lines of initial revisions
+		bool isPreset;        // already annotated, as example from cache
+		AnnotationLines preset;
+	};
+	AnnotateWorker(QObject* p, const QVector<Job>& jobs, int wantedRow = -1);
+	~AnnotateWorker();
+	void cancel() { canceled = true; }
+	void setPriority(int row);
+	const QVector<int> takeFinished();
+	const AnnotationLines& result(int row) const { return results.at(row); }
+	bool hasError() const { return isError; }
+
+signals:
+	void progress();
+
+protected:
+	virtual void run();
+
+private:
+	bool annotate(int row);
+	void getAncestry(int row, QVector<int>& rows);
+
+	const QVector<Job> jobs;
+	QVector<AnnotationLines> results;
+	QVector<bool> done;       // worker side only
+	QVector<int> finished;    // guarded by mutex
+	int priority;             // guarded by mutex
+	QMutex mutex;
+	volatile bool canceled;
+	volatile bool isError;
+};
+
+//
+//  Annotate computes the history annotation in an AnnotateWorker, this
+//  is needed by range filtering. While running, a wanted revision that is
+//  not annotated yet is also blamed with 'git blame --incremental' that is
+//  much faster for a single revision, its lines are published while git
+//  streams them and first result, blame or history, wins.
+//
 class Annotate : public QObject {
 Q_OBJECT
 public:
@@ -39,27 +119,38 @@ public:
 	bool getRange(SCRef sha, RangeInfo* r);
 	bool seekPosition(int* rangeStart, int* rangeEnd, SCRef fromSha, SCRef toSha);
 	const QString computeRanges(SCRef sha, int paraFrom, int paraTo, SCRef target = "");
+	const QString originLabel(int origin);
+	bool isPartial(const FileAnnotation* fa) const;
+	void setPriority(SCRef sha);
+	static bool setAnnotation(const QByteArray& diff, int origin, const AnnotationLines& pAnn, AnnotationLines& nAnn);
 
 signals:
 	void annotateReady(Annotate*, bool, const QString&);
+	void annotateProgress(int, int);
 
 private slots:
 	void on_deleteWhenDone();
 	void slotComputeDiffs();
+	void on_workerProgress();
+	void on_workerDone();
+	void procReadyRead(const QByteArray& data);
+	void procFinished();
 
 private:
-	void annotateFileHistory();
-	void doAnnotate(const ShaString& sha);
-	FileAnnotation* getFileAnnotation(SCRef sha);
-	void setInitialAnnotation(SCRef fileSha, FileAnnotation* fa);
-	const QString setupAuthor(SCRef origAuthor, int annId);
-	bool setAnnotation(SCRef diff, SCRef aut, SCList pAnn, SList nAnn, int ofs = 0);
-	bool getNextLine(SCRef d, int& idx, QString& line);
-	static void unify(SList dst, SCList src);
-	const QString getPatch(SCRef sha, int parentNum = 0);
-	bool getNextSection(SCRef d, int& idx, QString& sec, SCRef target);
-	void updateRange(RangeInfo* r, SCRef diff, bool reverse);
-	void updateCrossRanges(SCRef cnk, bool rev, int oStart, int oLineCnt, RangeInfo* r);
+	bool prepareJobs(QVector<AnnotateWorker::Job>& jobs);
+	void annotateDone();
+	void wantRow(int row);
+	void startBlame(int row);
+	void cancelBlame();
+	void publishBlame(bool complete);
+	const QString cacheKey();
+	void loadCache();
+	int setInitialAnnotation(SCRef fileSha);
+	const QString setupAuthor(int authorId, int annId);
+	const Rev* patchRev(SCRef sha, int parentNum = 0);
+	const QByteArray getRawPatch(SCRef sha, int parentNum = 0);
+	const LineMap* lineMap(SCRef sha);
+	int ancestorRow(SCRef sha);
 	bool isDescendant(SCRef sha, SCRef target);
 
 	EM_DECLARE(exAnnCanceled);
@@ -74,12 +165,25 @@ private:
 	bool isError;
 	int annNumLen;
 	int annId;
-	int annFilesNum;
 	ShaVect histRevOrder; // TODO use reference
+	QHash<ShaString, int> histRows; // index in histRevOrder
 	bool valid;
 	bool canceled;
 	QElapsedTimer processingTime;
 	Ranges ranges;
+	QVector<LineMap> lineMaps; // by history row, parsed on demand
+	QHash<int, QString> shortAuthors; // by author id, see Git::authorId()
+	AnnotateWorker* worker;
+	int annDoneCnt;
+	int wantedRow; // last revision asked with setPriority()
+	QPointer<MyProcess> blameProc;
+	int blameRow; // row being blamed, -1 if none
+	BlameParser blame;
+	QVector<int> blameIds; // origin of each blamed commit, by BlameParser index
+	QElapsedTimer blameTime;
+	QHash<QString, int> lookupAncestors; // row of sha ancestor in history
+	QString annCacheKey;
+	int cachedCnt; // revisions loaded from persistent cache
 };
 
 #endif
@@ -0,0 +1,309 @@
+/*
+	Description: memory mapped viewer for huge files
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <string.h>
+#include <QFile>
+#include <QPainter>
+#include <QScrollBar>
+#include "annotate.h"
+#include "bigfileview.h"
+
+static const int MARGIN = 4; // pixels, as QTextDocument default margin
+static const int TAB_WIDTH = 8;
+static const int MAX_LINE_BYTES = 64 * 1024; // longer lines are shown truncated
+
+static QString expandTabs(SCRef line) {
+
+	if (!line.contains('\t'))
+		return line;
+
+	QString txt;
+	txt.reserve(line.length() + TAB_WIDTH);
+	for (int i = 0; i < line.length(); i++) {
+		if (line.at(i) == '\t')
+			txt.append(QString(TAB_WIDTH - txt.length() % TAB_WIDTH, ' '));
+		else
+			txt.append(line.at(i));
+	}
+	return txt;
+}
+
+BigFileView::BigFileView(QWidget* parent) : QAbstractScrollArea(parent) {
+
+	file = NULL;
+	data = NULL;
+	size = 0;
+	indexer = NULL;
+	pendingTop = -1;
+	maxCols = labelLen = 0;
+	ann = NULL;
+	setFocusPolicy(Qt::StrongFocus);
+	updateMetrics();
+}
+
+BigFileView::~BigFileView() {
+
+	clear();
+}
+
+void BigFileView::clear() {
+
+	delete indexer; // cancel and wait, before unmapping
+	indexer = NULL;
+	if (file) {
+		if (data)
+			file->unmap((uchar*)data);
+		delete file;
+		file = NULL;
+	}
+	data = NULL;
+	size = 0;
+	lines = QVector<qint64>();
+	pendingTop = -1;
+	maxCols = 0;
+	ann = NULL;
+	updateScrollBars();
+	viewport()->update();
+}
+
+bool BigFileView::setFile(QFile* f) {
+// takes ownership of an open file if it can be mapped,
+// lines are then indexed in background
+
+	clear();
+	file = f;
+	size = file->size();
+	if (size > 0) {
+		data = (const char*)file->map(0, size);
+		if (!data) {
+			dbp("ASSERT in BigFileView::setFile, unable to map %1", file->fileName());
+			file = NULL; // still of the caller
+			clear();
+			return false;
+		}
+		indexer = new LineIndexer(this, data, size);
+		connect(indexer, SIGNAL(finished()), this, SLOT(on_indexReady()));
+		indexer->start(QThread::LowPriority);
+	}
+	verticalScrollBar()->setValue(0);
+	horizontalScrollBar()->setValue(0);
+	viewport()->update();
+	return true;
+}
+
+void BigFileView::on_indexReady() {
+
+	if (!indexer || sender() != indexer) // could be stale
+		return;
+
+	indexer->wait(); // could still be returning from run()
+	lines = indexer->takeLines();
+	indexer->deleteLater();
+	indexer = NULL;
+	updateScrollBars();
+	if (pendingTop != -1)
+		verticalScrollBar()->setValue(pendingTop);
+
+	pendingTop = -1;
+	viewport()->update();
+}
+
+void BigFileView::setAnnotation(const FileAnnotation* a, Annotate* an) {
+
+	if (an != annotate) {
+		labels.clear(); // labels depend on file history
+		labelLen = 0;
+	}
+	ann = a;
+	annotate = an;
+	viewport()->update();
+}
+
+int BigFileView::lineCount() const {
+
+	return lines.count();
+}
+
+int BigFileView::topLine() const {
+
+	return (indexer ? qMax(pendingTop, 0) : verticalScrollBar()->value());
+}
+
+void BigFileView::scrollToLine(int line) {
+
+	if (indexer)
+		pendingTop = line; // scroll bar range is still unknown
+	else
+		verticalScrollBar()->setValue(line);
+}
+
+qint64 BigFileView::lineStart(int line) const {
+// before indexing only the first page is shown
+
+	return (line >= 0 && line < lines.count() ? lines[line] : 0);
+}
+
+QString BigFileView::lineText(qint64 ofs) const {
+
+	const char* nl = static_cast<const char*>(memchr(data + ofs, '\n', size - ofs));
+	qint64 len = (nl ? nl - data : size) - ofs;
+	if (len > 0 && data[ofs + len - 1] == '\r')
+		len--;
+
+	// same decoding of QTextEdit::setPlainText(QByteArray)
+	return expandTabs(QString::fromUtf8(data + ofs, (int)qMin(len, (qint64)MAX_LINE_BYTES)));
+}
+
+const QString& BigFileView::originLabel(int origin) {
+
+	QHash<int, QString>::const_iterator it(labels.constFind(origin));
+	if (it == labels.constEnd()) {
+		it = labels.insert(origin, annotate->originLabel(origin));
+		labelLen = qMax(labelLen, it.value().length());
+	}
+	return it.value();
+}
+
+int BigFileView::gutterColumns() const {
+// as FileContent::setAnnList(), label, a space and the line number
+
+	int digits = QString::number(qMax(lineCount(), 1)).length();
+	return (ann && annotate ? labelLen + 1 : 0) + digits + 2;
+}
+
+void BigFileView::updateMetrics() {
+
+	QFontMetrics fm(font());
+	lineHeight = qMax(fm.lineSpacing(), 1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+	charWidth = qMax(fm.horizontalAdvance(QLatin1Char('x')), 1);
+#else
+	charWidth = qMax(fm.width(QLatin1Char('x')), 1);
+#endif
+	updateScrollBars();
+}
+
+void BigFileView::updateScrollBars() {
+
+	int visible = qMax(viewport()->height() / lineHeight, 1);
+	QScrollBar* vsb = verticalScrollBar();
+	vsb->setRange(0, qMax(lineCount() - visible, 0));
+	vsb->setPageStep(visible);
+	vsb->setSingleStep(1);
+
+	int textWidth = qMax(viewport()->width() - gutterColumns() * charWidth, 1);
+	QScrollBar* hsb = horizontalScrollBar();
+	hsb->setRange(0, qMax(maxCols * charWidth + 2 * MARGIN - textWidth, 0));
+	hsb->setPageStep(textWidth);
+	hsb->setSingleStep(charWidth);
+}
+
+void BigFileView::paintEvent(QPaintEvent*) {
+
+	// visible lines, labels are looked up first because
+	// a new longer one makes the gutter wider
+	QVector<qint64> starts;
+	QVector<int> origins;
+	const bool annotated = (ann && annotate);
+	const int top = (indexer ? 0 : verticalScrollBar()->value());
+	qint64 ofs = lineStart(top);
+	for (int y = 0; data && ofs < size && y < viewport()->height(); y += lineHeight) {
+
+		starts.append(ofs);
+		if (annotated) {
+			origins.append(ann->lines.at(top + starts.count() - 1));
+			originLabel(origins.last());
+		}
+		const char* nl = static_cast<const char*>(memchr(data + ofs, '\n', size - ofs));
+		ofs = (nl ? nl - data + 1 : size);
+	}
+	QPainter p(viewport());
+	p.setFont(font());
+	const int gutter = gutterColumns() * charWidth;
+	const int digits = QString::number(qMax(lineCount(), 1)).length();
+	const int hOfs = horizontalScrollBar()->value();
+	const int c0 = hOfs / charWidth;
+	const int cols = (viewport()->width() - gutter) / charWidth + 2;
+	const QColor textColor(palette().color(QPalette::Text));
+	QFont boldFont(font());
+	boldFont.setBold(true);
+
+	int widest = maxCols;
+	for (int i = 0; i < starts.count(); i++) {
+
+		const int y = i * lineHeight;
+		const QString txt(lineText(starts[i]));
+		widest = qMax(widest, txt.length());
+
+		p.save();
+		p.setClipRect(gutter, y, viewport()->width() - gutter, lineHeight);
+		p.setPen(textColor);
+		int from = qMin(c0, txt.length());
+		p.drawText(gutter + MARGIN - hOfs + from * charWidth, y + fontMetrics().ascent(),
+		           txt.mid(from, cols));
+		p.restore();
+
+		// gutter, same look of the annotation list of small files
+		QString g(annotated ? originLabel(origins[i]).leftJustified(labelLen) + " " : "");
+		g.append(QString(" %1 ").arg(top + i + 1, digits));
+		bool current = (annotated && origins[i] == ann->annId);
+		if (current)
+			p.fillRect(0, y, gutter, lineHeight, Qt::lightGray);
+
+		p.setFont(current ? boldFont : font());
+		p.setPen(current ? QColor(Qt::darkRed) : QColor(Qt::lightGray));
+		p.drawText(0, y + fontMetrics().ascent(), g);
+		p.setFont(font());
+	}
+	if (widest > maxCols) { // tabs and long lines are known only once painted
+		maxCols = widest;
+		updateScrollBars();
+	}
+}
+
+void BigFileView::resizeEvent(QResizeEvent* e) {
+
+	QAbstractScrollArea::resizeEvent(e);
+	updateScrollBars();
+}
+
+void BigFileView::changeEvent(QEvent* e) {
+
+	if (e->type() == QEvent::FontChange)
+		updateMetrics();
+
+	QAbstractScrollArea::changeEvent(e);
+}
+
+LineIndexer::LineIndexer(QObject* p, const char* d, qint64 s)
+                         : QThread(p), data(d), size(s), canceled(false) {}
+
+LineIndexer::~LineIndexer() {
+
+	cancel();
+	wait();
+}
+
+QVector<qint64> LineIndexer::takeLines() {
+// to be called once the thread is finished
+
+	QVector<qint64> l(lines);
+	lines.clear();
+	return l;
+}
+
+void LineIndexer::run() {
+// a trailing new line does not start a new line, as in QTextEdit
+
+	lines.reserve(int(size / 64) + 1); // a guess, grows anyway
+	qint64 ofs = 0;
+	while (ofs < size && !canceled) {
+
+		lines.append(ofs);
+		const char* nl = static_cast<const char*>(memchr(data + ofs, '\n', size - ofs));
+		ofs = (nl ? nl - data + 1 : size);
+	}
+}
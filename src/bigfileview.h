@@ -0,0 +1,87 @@
+/*
+	Description: memory mapped viewer for huge files
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef BIGFILEVIEW_H
+#define BIGFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QHash>
+#include <QPointer>
+#include <QThread>
+#include <QVector>
+#include "common.h"
+
+class QFile;
+class Annotate;
+class LineIndexer;
+
+//
+//  BigFileView shows a file spooled to disk, the file is memory mapped
+//  and the start offset of each line is found by a LineIndexer. Only the
+//  visible lines are decoded and painted, with line numbers and, when
+//  available, annotation labels in a gutter on the left.
+//
+class BigFileView : public QAbstractScrollArea {
+Q_OBJECT
+public:
+	BigFileView(QWidget* parent);
+	~BigFileView();
+	void clear();
+	bool setFile(QFile* f);
+	void setAnnotation(const FileAnnotation* ann, Annotate* annotate);
+	int topLine() const;
+	void scrollToLine(int line);
+
+protected:
+	virtual void paintEvent(QPaintEvent* e);
+	virtual void resizeEvent(QResizeEvent* e);
+	virtual void changeEvent(QEvent* e);
+
+private slots:
+	void on_indexReady();
+
+private:
+	int lineCount() const;
+	qint64 lineStart(int line) const;
+	QString lineText(qint64 ofs) const;
+	const QString& originLabel(int origin);
+	int gutterColumns() const;
+	void updateMetrics();
+	void updateScrollBars();
+
+	QFile* file;        // owned, deleted on clear()
+	const char* data;   // mapped file content
+	qint64 size;
+	QVector<qint64> lines; // start offset of each line, once indexed
+	LineIndexer* indexer;
+	int pendingTop;     // line to show once indexed
+	int maxCols;        // widest line seen so far, in characters
+	int lineHeight, charWidth;
+	const FileAnnotation* ann;
+	QPointer<Annotate> annotate;
+	QHash<int, QString> labels; // of annotate, formatted once
+	int labelLen;               // longest label seen so far
+};
+
+class LineIndexer : public QThread {
+Q_OBJECT
+public:
+	LineIndexer(QObject* p, const char* data, qint64 size);
+	~LineIndexer();
+	void cancel() { canceled = true; }
+	QVector<qint64> takeLines();
+
+protected:
+	virtual void run();
+
+private:
+	const char* data;
+	qint64 size;
+	QVector<qint64> lines;
+	volatile bool canceled;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+	Description: parser of 'git blame --incremental' output
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <QList>
+#include "blameparser.h"
+
+void BlameParser::clear() {
+
+	inEntry = false;
+	buf.clear();
+	shas.clear();
+	shaIdx.clear();
+	lines.clear();
+}
+
+void BlameParser::append(const QByteArray& data) {
+
+	buf.append(data);
+	int start = 0, end;
+	while ((end = buf.indexOf('\n', start)) != -1) {
+		parseLine(buf.mid(start, end - start));
+		start = end + 1;
+	}
+	buf.remove(0, start);
+}
+
+void BlameParser::finish() {
+
+	if (!buf.isEmpty())
+		parseLine(buf);
+
+	buf.clear();
+}
+
+void BlameParser::parseLine(const QByteArray& line) {
+// each entry starts with '<sha> <orig line> <final line> <lines count>'
+// then commit info follows, only the first time, until 'filename' line
+
+	if (inEntry) {
+		if (line.startsWith("filename "))
+			inEntry = false;
+		return;
+	}
+	const QList<QByteArray> f(line.split(' '));
+	if (f.count() != 4 || f.first().length() < 40) {
+		dbp("ASSERT in BlameParser::parseLine: unexpected line %1", QString::fromLatin1(line));
+		return;
+	}
+	inEntry = true;
+	int start = f.at(2).toInt() - 1; // blame lines start from 1
+	int cnt = f.at(3).toInt();
+	if (start < 0 || cnt <= 0)
+		return;
+
+	QHash<QByteArray, int>::const_iterator it(shaIdx.constFind(f.first()));
+	if (it == shaIdx.constEnd()) {
+		it = shaIdx.insert(f.first(), shas.count());
+		shas.append(f.first());
+	}
+	// entries come in any order, lines skipped by a far one are not known yet
+	if (lines.count() < start + cnt)
+		lines.insert(lines.count(), start + cnt - lines.count(), -1);
+
+	for (int i = start; i < start + cnt; i++)
+		lines[i] = it.value();
+}
+
+void BlameParser::toAnnotation(const QVector<int>& origins, AnnotationLines* al) const {
+// origins are given by commit index, lines not blamed yet are NO_ORIGIN
+
+	al->clear();
+	for (int i = 0; i < lines.count(); i++) {
+		int c = lines[i];
+		al->append(c >= 0 && c < origins.count() ? origins[c] : AnnotationLines::NO_ORIGIN);
+	}
+}
@@ -0,0 +1,41 @@
+/*
+	Description: parser of 'git blame --incremental' output
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef BLAMEPARSER_H
+#define BLAMEPARSER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include "common.h"
+
+//
+//  BlameParser reads the output of 'git blame --incremental' while it is
+//  streamed. Each line gets the index of the commit that added it, commits
+//  are numbered in order of appearance so that the caller looks up each of
+//  them only once and turns the lines into an AnnotationLines.
+//
+class BlameParser {
+public:
+	BlameParser() { clear(); }
+	void clear();
+	void append(const QByteArray& data); // only complete lines are parsed
+	void finish(); // parses a last line without new line
+	bool isEmpty() const { return lines.isEmpty(); }
+	const QVector<QByteArray>& commits() const { return shas; }
+	void toAnnotation(const QVector<int>& origins, AnnotationLines* al) const;
+
+private:
+	void parseLine(const QByteArray& line);
+
+	bool inEntry; // commit info lines until 'filename' one
+	QByteArray buf; // last incomplete line
+	QVector<QByteArray> shas;
+	QHash<QByteArray, int> shaIdx;
+	QVector<int> lines; // commit index of each line, -1 if not blamed yet
+};
+
+#endif
@@ -7,6 +7,7 @@
 
 */
 #include <QFile>
+#include <QCryptographicHash>
 #include <QDataStream>
 #include <QDir>
 #include "cache.h"
@@ -170,3 +171,199 @@ bool Cache::load(const QString& gitDir, RevFileMap& rfm,
 	f.close();
 	return true;
 }
+
+const QString Cache::cachePath(const QString& dirPath, const QString& key) {
+// one file for each key, named after the key hash
+
+	QByteArray h(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1));
+	return dirPath + "/" + QString::fromLatin1(h.toHex());
+}
+
+bool Cache::replaceFile(const QString& path, const QByteArray& data) {
+
+	const QString tmpPath(path + BAK_EXT);
+	QFile f(tmpPath);
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Unbuffered))
+		return false;
+
+	f.write(qCompress(data, 1));
+	f.close();
+
+	QDir dir;
+	if (dir.exists(path) && !dir.remove(path)) {
+		dbs("access denied to " + path);
+		dir.remove(tmpPath);
+		return false;
+	}
+	dir.rename(tmpPath, path);
+	return true;
+}
+
+void Cache::trimDir(const QString& dirPath, qint64 budget) {
+// keep the newest files within the size budget
+
+	QDir dir(dirPath);
+	const QFileInfoList fl(dir.entryInfoList(QDir::Files, QDir::Time));
+	qint64 total = 0;
+	for (int i = 0; i < fl.count(); i++) {
+
+		total += fl[i].size();
+		if (total > budget && i > 0)
+			dir.remove(fl[i].fileName());
+	}
+}
+
+/*
+  Annotations are saved in a file for each file history, named after the
+  hash of the key, see Annotate::cacheKey(). Each revision is saved with
+  its annotation id, so that ids can be remapped when new revisions are
+  loaded, and with its file sha, so that a changed content is detected.
+*/
+bool Cache::saveAnnotation(const QString& gitDir, const QString& key,
+                           const ShaVect& revs, const AnnotateHistory& ah) {
+
+	if (gitDir.isEmpty() || key.isEmpty() || revs.isEmpty())
+		return false;
+
+	QDir dir;
+	if (!dir.exists(gitDir + A_DAT_DIR) && !dir.mkpath(gitDir + A_DAT_DIR))
+		return false;
+
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << (quint32)A_MAGIC;
+	stream << (qint32)A_VERSION;
+	stream << key;
+
+	qint32 cnt = 0;
+	FOREACH (ShaVect, it, revs) {
+		AnnotateHistory::const_iterator a(ah.constFind(*it));
+		if (a != ah.constEnd() && a->isValid && *it != ZERO_SHA_RAW)
+			cnt++;
+	}
+	stream << cnt;
+	FOREACH (ShaVect, it, revs) {
+
+		AnnotateHistory::const_iterator a(ah.constFind(*it));
+		if (a == ah.constEnd() || !a->isValid || *it == ZERO_SHA_RAW)
+			continue;
+
+		stream << QByteArray((*it).latin1()) << (qint32)a->annId << a->fileSha.toLatin1();
+		a->lines >> stream;
+	}
+	if (!replaceFile(cachePath(gitDir + A_DAT_DIR, key), data))
+		return false;
+
+	trimDir(gitDir + A_DAT_DIR, A_DAT_BUDGET);
+	return true;
+}
+
+bool Cache::loadAnnotation(const QString& gitDir, const QString& key, StrVect& revs,
+                           QVector<int>& annIds, StrVect& fileShas,
+                           QVector<AnnotationLines>& lines) {
+
+	QFile f(cachePath(gitDir + A_DAT_DIR, key));
+	if (!f.exists() || !f.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+		return false;
+
+	QDataStream stream(qUncompress(f.readAll()));
+	f.close();
+
+	quint32 magic;
+	qint32 version, cnt;
+	QString storedKey;
+	stream >> magic;
+	stream >> version;
+	if (magic != A_MAGIC || version != A_VERSION)
+		return false;
+
+	stream >> storedKey;
+	if (storedKey != key) // hash collision
+		return false;
+
+	stream >> cnt;
+	if (cnt < 0 || stream.status() != QDataStream::Ok)
+		return false;
+
+	revs.resize(cnt);
+	annIds.resize(cnt);
+	fileShas.resize(cnt);
+	lines.resize(cnt);
+	for (int i = 0; i < cnt; i++) {
+
+		QByteArray sha, fileSha;
+		qint32 id;
+		stream >> sha >> id >> fileSha;
+		lines[i] << stream;
+		revs[i] = QString::fromLatin1(sha);
+		annIds[i] = id;
+		fileShas[i] = QString::fromLatin1(fileSha);
+	}
+	if (stream.status() != QDataStream::Ok) {
+		dbs("ASSERT in Cache::loadAnnotation, corrupted file");
+		return false;
+	}
+	return true;
+}
+
+/*
+  Patches are saved as they come from git, one file for each
+  (sha, diffToSha, combined) key, see Git::diffKey()
+*/
+bool Cache::saveDiff(const QString& gitDir, const QString& key, const QByteArray& patch) {
+
+	if (gitDir.isEmpty() || key.isEmpty())
+		return false;
+
+	QDir dir;
+	if (!dir.exists(gitDir + D_DAT_DIR) && !dir.mkpath(gitDir + D_DAT_DIR))
+		return false;
+
+	QByteArray data;
+	QDataStream stream(&data, QIODevice::WriteOnly);
+	stream << (quint32)D_MAGIC;
+	stream << (qint32)D_VERSION;
+	stream << key;
+	stream << patch;
+
+	if (!replaceFile(cachePath(gitDir + D_DAT_DIR, key), data))
+		return false;
+
+	trimDir(gitDir + D_DAT_DIR, D_DAT_BUDGET);
+	return true;
+}
+
+bool Cache::hasDiff(const QString& gitDir, const QString& key) {
+
+	return !gitDir.isEmpty() && QFile::exists(cachePath(gitDir + D_DAT_DIR, key));
+}
+
+bool Cache::loadDiff(const QString& gitDir, const QString& key, QByteArray* patch) {
+
+	QFile f(cachePath(gitDir + D_DAT_DIR, key));
+	if (gitDir.isEmpty() || !f.exists() || !f.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+		return false;
+
+	QDataStream stream(qUncompress(f.readAll()));
+	f.close();
+
+	quint32 magic;
+	qint32 version;
+	QString storedKey;
+	stream >> magic;
+	stream >> version;
+	if (magic != D_MAGIC || version != D_VERSION)
+		return false;
+
+	stream >> storedKey;
+	if (storedKey != key) // hash collision
+		return false;
+
+	stream >> *patch;
+	if (stream.status() != QDataStream::Ok) {
+		dbs("ASSERT in Cache::loadDiff, corrupted file");
+		patch->clear();
+		return false;
+	}
+	return true;
+}
@@ -17,6 +17,19 @@ public:
 	                 const StrVect& dirs, const StrVect& files);
 	static bool load(const QString& gitDir, RevFileMap& rf,
 	                 StrVect& dirs, StrVect& files, QByteArray& revsFilesShaBuf);
+	static bool saveAnnotation(const QString& gitDir, const QString& key,
+	                           const ShaVect& revs, const AnnotateHistory& ah);
+	static bool loadAnnotation(const QString& gitDir, const QString& key, StrVect& revs,
+	                           QVector<int>& annIds, StrVect& fileShas,
+	                           QVector<AnnotationLines>& lines);
+	static bool saveDiff(const QString& gitDir, const QString& key, const QByteArray& patch);
+	static bool loadDiff(const QString& gitDir, const QString& key, QByteArray* patch);
+	static bool hasDiff(const QString& gitDir, const QString& key);
+
+private:
+	static const QString cachePath(const QString& dirPath, const QString& key);
+	static bool replaceFile(const QString& path, const QByteArray& data);
+	static void trimDir(const QString& dirPath, qint64 budget);
 };
 
 #endif
@@ -7,15 +7,52 @@
 
 */
 
+#include <string.h>
+#include <algorithm>
 #include <QDataStream>
 #include <QTextDocument>
 #include "common.h"
 
+static bool isAscii(const char* data, int len) {
+// checks 8 bytes at a time, memcpy avoids unaligned reads
+
+        const quint64 highBits = Q_UINT64_C(0x8080808080808080);
+        int i = 0;
+        for ( ; i + 8 <= len; i += 8) {
+                quint64 w;
+                memcpy(&w, data + i, 8);
+                if (w & highBits)
+                        return false;
+        }
+        for ( ; i < len; i++)
+                if (data[i] & 0x80)
+                        return false;
+        return true;
+}
+
 const QString Rev::mid(int start, int len) const {
 
         // warning no sanity check is done on arguments
-        const char* data = ba.constData();
-        return QString::fromLocal8Bit(data + start, len);
+        const char* data = ba.constData() + start;
+
+        // most of commit text is plain ASCII that is the same in any
+        // encoding, so skip the codec that is much slower than Latin1
+        if (isAscii(data, len))
+                return QString::fromLatin1(data, len);
+
+        return QString::fromLocal8Bit(data, len);
+}
+
+qint64 Rev::authorTime() const {
+// parse seconds since epoch directly, without going through a QString
+
+        setup();
+        const char* data = ba.constData() + autDateStart;
+        qint64 secs = 0;
+        for (int i = 0; data[i] >= '0' && data[i] <= '9'; i++)
+                secs = secs * 10 + data[i] - '0';
+
+        return secs;
 }
 
 const QString Rev::midSha(int start, int len) const {
@@ -264,6 +301,97 @@ RevFile& RevFile::operator<<(QDataStream& stream) {
         return *this;
 }
 
+void AnnotationLines::append(int origin, int cnt) {
+
+        if (cnt <= 0)
+                return;
+
+        if (!vals.isEmpty() && vals.last() == origin) {
+                ends.last() += cnt;
+                return;
+        }
+        vals.append(origin);
+        ends.append(count() + cnt);
+}
+
+void AnnotationLines::append(const AnnotationLines& src, int from, int cnt) {
+// append cnt lines of src starting from line 'from', counted from 0
+
+        int to = qMin(from + cnt, src.count());
+        if (from >= to)
+                return;
+
+        // first run that ends after 'from'
+        int r = std::upper_bound(src.ends.constBegin(), src.ends.constEnd(), from) - src.ends.constBegin();
+        for ( ; from < to; r++) {
+                int runEnd = qMin(src.ends[r], to);
+                append(src.vals[r], runEnd - from);
+                from = runEnd;
+        }
+}
+
+int AnnotationLines::at(int line) const {
+// origin of a line, counted from 0, a binary search on runs
+
+        int r = std::upper_bound(ends.constBegin(), ends.constEnd(), line) - ends.constBegin();
+        return (line >= 0 && r < vals.count() ? vals[r] : NO_ORIGIN);
+}
+
+const QVector<int> AnnotationLines::toVector() const {
+
+        QVector<int> v;
+        v.reserve(count());
+        for (int r = 0, line = 0; r < vals.count(); r++)
+                for ( ; line < ends[r]; line++)
+                        v.append(vals[r]);
+        return v;
+}
+
+void AnnotationLines::fromVector(const QVector<int>& v) {
+
+        clear();
+        for (int i = 0; i < v.count(); i++)
+                append(v[i]);
+}
+
+bool AnnotationLines::mapOrigins(const QVector<int>& newIds) {
+// change annotation ids, as example of a cached annotation. Runs
+// are unchanged because different ids are mapped to different ones
+
+        for (int r = 0; r < vals.count(); r++) {
+
+                if (vals[r] == NO_ORIGIN || vals[r] == MERGE)
+                        continue;
+
+                if (vals[r] < 0 || vals[r] >= newIds.count() || newIds[vals[r]] == NO_ORIGIN)
+                        return false;
+
+                vals[r] = newIds[vals[r]];
+        }
+        return true;
+}
+
+/**
+ * AnnotationLines streaming out
+ */
+const AnnotationLines& AnnotationLines::operator>>(QDataStream& stream) const {
+
+        stream << vals << ends;
+        return *this;
+}
+
+/**
+ * AnnotationLines streaming in
+ */
+AnnotationLines& AnnotationLines::operator<<(QDataStream& stream) {
+
+        stream >> vals >> ends;
+        if (vals.count() != ends.count()) // corrupted
+                clear();
+
+        return *this;
+}
+
 QString qt4and5escaping(QString toescape) {
 #if QT_VERSION >= 0x050000
 	return toescape.toHtmlEscaped();
@@ -246,7 +246,8 @@ namespace QGit {
 		USE_CMT_MSG_F   = 1 << 15,
 // 		OPEN_IN_EDITOR_F = 1 << 16,  //  not used anymore; subject to be replaced
 		ENABLE_DRAGNDROP_F = 1 << 17,
-		ENABLE_SHORTREF_F = 1 << 18
+		ENABLE_SHORTREF_F = 1 << 18,
+		PATCH_CACHE_F   = 1 << 19
 	};
 	const int FLAGS_DEF = USE_CMT_MSG_F | RANGE_SELECT_F | SMART_LBL_F | VERIFY_CMT_F | SIGN_PATCH_F | LOG_DIFF_TAB_F | MSG_ON_NEW_F | ENABLE_DRAGNDROP_F;
 
@@ -283,10 +284,26 @@ namespace QGit {
 	extern const QString BAK_EXT;
 	extern const QString C_DAT_FILE;
 
+	// annotation cache, one file per file history
+	const uint A_MAGIC  = 0xA0B0C0D1;
+	const int A_VERSION = 1;
+	const qint64 A_DAT_BUDGET = 32 * 1024 * 1024; // bytes, oldest files are removed
+	extern const QString A_DAT_DIR;
+
+	// patches cache, raw 'git diff-tree' output
+	const uint D_MAGIC  = 0xA0B0C0D2;
+	const int D_VERSION = 1;
+	const int D_MEM_BUDGET = 32 * 1024; // KB, least recently used are dropped
+	const qint64 D_DAT_BUDGET = 64 * 1024 * 1024; // bytes, oldest files are removed
+	extern const QString D_DAT_DIR;
+
 	// misc
 	const int MAX_DICT_SIZE    = 100003; // must be a prime number see QDict docs
 	const int MAX_MENU_ENTRIES = 20;
 	const int MAX_RECENT_REPOS = 7;
+	const int BIG_PATCH_SIZE   = 8 * 1024 * 1024; // bytes, bigger patches skip QTextEdit
+	const int BIG_FILE_SIZE    = 32 * 1024 * 1024; // bytes, bigger files are memory mapped
+	const int PAIR_FILES_CNT   = 64; // diff to sha file lists kept, least recently used are dropped
 	extern const QString QUOTE_CHAR;
 	extern const QString SCRIPT_EXT;
 }
@@ -314,7 +331,6 @@ public:
 	    : orderIdx(idx), ba(b), start(s) {
 
 		indexed = isDiffCache = isApplied = isUnApplied = false;
-		descRefsMaster = ancRefsMaster = descBrnMaster = -1;
 		*next = indexData(true, withDiff);
 	}
 	bool isBoundary() const { return (ba.at(shaStart - 1) == '-'); }
@@ -326,17 +342,20 @@ public:
 	const QString committer() const { setup(); return mid(comStart, autStart - comStart - 1); }
 	const QString author() const { setup(); return mid(autStart, autDateStart - autStart - 1); }
 	const QString authorDate() const { setup(); return mid(autDateStart, 10); }
+	const QByteArray authorRaw() const { // not a deep copy, see Git::authorId()
+		setup();
+		return QByteArray::fromRawData(ba.constData() + autStart, autDateStart - autStart - 1);
+	}
+	qint64 authorTime() const;
 	const QString shortLog() const { setup(); return mid(sLogStart, sLogLen); }
 	const QString longLog() const { setup(); return mid(lLogStart, lLogLen); }
 	const QString diff() const { setup(); return mid(diffStart, diffLen); }
+	const QByteArray diffRaw() const { // not a deep copy, see Annotate::getRawPatch()
+		setup();
+		return QByteArray::fromRawData(ba.constData() + diffStart, diffLen);
+	}
 
-        QVector<int> lanes, children;
-	QVector<int> descRefs;     // list of descendant refs index, normally tags
-	QVector<int> ancRefs;      // list of ancestor refs index, normally tags
-	QVector<int> descBranches; // list of descendant branches index
-	int descRefsMaster; // in case of many Rev have the same descRefs, ancRefs or
-	int ancRefsMaster;  // descBranches these are stored only once in a Rev pointed
-	int descBrnMaster;  // by corresponding index xxxMaster
+        QVector<int> lanes;
 	int orderIdx;
 private:
 	inline void setup() const { if (!indexed) indexData(false, false); }
@@ -429,11 +448,38 @@ public:
 typedef QHash<ShaString, const RevFile*> RevFileMap;
 
 
+class AnnotationLines {
+// origin of each line of a file revision, stored as runs of lines with the same
+// origin. An origin is the annotation id of the revision that added the line,
+// labels are formatted only when shown, see Annotate::originLabel()
+public:
+	enum Origin {
+		NO_ORIGIN = 0, // lines of initial revision
+		MERGE = -1     // lines added by a merge
+	};
+	AnnotationLines() {}
+	int count() const { return (ends.isEmpty() ? 0 : ends.last()); }
+	bool isEmpty() const { return ends.isEmpty(); }
+	int at(int line) const;
+	void clear() { vals.clear(); ends.clear(); }
+	void append(int origin, int cnt = 1);
+	void append(const AnnotationLines& src, int from, int cnt);
+	const QVector<int> toVector() const;
+	void fromVector(const QVector<int>& v);
+	bool mapOrigins(const QVector<int>& newIds);
+	const AnnotationLines& operator>>(QDataStream&) const;
+	AnnotationLines& operator<<(QDataStream&);
+
+private:
+	QVector<int> vals; // origin of each run
+	QVector<int> ends; // end line of each run, exclusive
+};
+
 class FileAnnotation {
 public:
 	explicit FileAnnotation(int id) : isValid(false), annId(id) {}
 	FileAnnotation() : isValid(false) {}
-	QStringList lines;
+	AnnotationLines lines;
 	bool isValid;
 	int annId;
 	QString fileSha;
@@ -0,0 +1,123 @@
+/*
+	Description: recently shown patches and file lists cache
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include "cache.h"
+#include "diffcache.h"
+#include "myprocess.h"
+
+DiffCache::DiffCache(QObject* p) : QObject(p) {
+
+	patches.setMaxCost(QGit::D_MEM_BUDGET);
+}
+
+void DiffCache::clear() {
+
+	patches.clear();
+}
+
+bool DiffCache::useDisk() const {
+
+	return !gitDir.isEmpty() && QGit::testFlag(QGit::PATCH_CACHE_F);
+}
+
+bool DiffCache::contains(SCRef key) const {
+
+	if (key.isEmpty())
+		return false;
+
+	return patches.contains(key) || (useDisk() && Cache::hasDiff(gitDir, key));
+}
+
+bool DiffCache::find(SCRef key, QByteArray* patch) {
+
+	if (key.isEmpty())
+		return false;
+
+	const QByteArray* p = patches.object(key); // moves it to the front
+	if (p) {
+		*patch = *p;
+		return true;
+	}
+	if (!useDisk() || !Cache::loadDiff(gitDir, key, patch))
+		return false;
+
+	patches.insert(key, new QByteArray(*patch), patch->size() / 1024 + 1);
+	return true;
+}
+
+void DiffCache::insert(SCRef key, const QByteArray& patch) {
+
+	if (key.isEmpty() || patch.size() > maxPatchSize())
+		return;
+
+	patches.insert(key, new QByteArray(patch), patch.size() / 1024 + 1);
+	if (useDisk())
+		Cache::saveDiff(gitDir, key, patch);
+}
+
+DiffFetcher::DiffFetcher(DiffCache* c, SCRef k, QObject* receiver) : cache(c), key(k) {
+
+	hasReceiver = tooBig = false;
+	if (receiver)
+		attach(receiver);
+}
+
+bool DiffFetcher::attach(QObject* receiver) {
+// called also on a running prefetch, data received so far is sent at once
+
+	if (hasReceiver || tooBig)
+		return false;
+
+	connect(this, SIGNAL(dataReady(const QByteArray&)),
+	        receiver, SLOT(procReadyRead(const QByteArray&)));
+
+	connect(this, SIGNAL(eof()), receiver, SLOT(procFinished()));
+
+	hasReceiver = true;
+	if (!patch.isEmpty())
+		emit dataReady(patch);
+
+	return true;
+}
+
+void DiffFetcher::procReadyRead(const QByteArray& data) {
+
+	if (hasReceiver)
+		emit dataReady(data);
+
+	if (tooBig)
+		return;
+
+	if (patch.size() + data.size() <= DiffCache::maxPatchSize()) {
+		patch.append(data);
+		return;
+	}
+	tooBig = true;
+	patch = QByteArray();
+
+	// a prefetch is useless now, stop it. Queued because we
+	// are called from a signal of the process we cancel
+	if (!hasReceiver && parent())
+		QMetaObject::invokeMethod(parent(), "on_cancel", Qt::QueuedConnection);
+}
+
+void DiffFetcher::procFinished() {
+
+	if (hasReceiver)
+		emit eof();
+
+	// stderr is sent as data too, so a failed command is not cached
+	MyProcess* p = qobject_cast<MyProcess*>(sender());
+	if (!tooBig && cache && p && p->getErrorOutput().isEmpty())
+		cache->insert(key, patch);
+}
+
+void FilesFetcher::procFinished() {
+
+	MyProcess* p = qobject_cast<MyProcess*>(sender());
+	if (p && p->getErrorOutput().isEmpty())
+		emit filesReady(key, output);
+}
@@ -0,0 +1,87 @@
+/*
+	Description: recently shown patches and file lists cache
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef DIFFCACHE_H
+#define DIFFCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QObject>
+#include <QPointer>
+#include "common.h"
+
+//
+//  DiffCache keeps raw patches, as output by git, of recently shown or
+//  prefetched revisions. Memory tier is a QCache with cost in KB, when
+//  PATCH_CACHE_F is set patches are also saved compressed under git dir.
+//
+class DiffCache : public QObject {
+Q_OBJECT
+public:
+	explicit DiffCache(QObject* p);
+	void clear();
+	void setGitDir(SCRef dir) { gitDir = dir; }
+	bool contains(SCRef key) const;
+	bool find(SCRef key, QByteArray* patch);
+	void insert(SCRef key, const QByteArray& patch);
+	static int maxPatchSize() { return QGit::BIG_PATCH_SIZE; }
+
+private:
+	bool useDisk() const;
+
+	QCache<QString, QByteArray> patches;
+	QString gitDir;
+};
+
+//
+//  DiffFetcher is the receiver of a 'git diff-tree' process, it forwards
+//  the patch to the real receiver, if any, and stores it once complete.
+//  It is a child of the process so it is deleted with it, also on cancel.
+//
+class DiffFetcher : public QObject {
+Q_OBJECT
+public:
+	DiffFetcher(DiffCache* c, SCRef k, QObject* receiver);
+	bool attach(QObject* receiver);
+
+signals:
+	void dataReady(const QByteArray&);
+	void eof();
+
+public slots:
+	void procReadyRead(const QByteArray& data);
+	void procFinished();
+
+private:
+	QPointer<DiffCache> cache;
+	QString key;
+	QByteArray patch;
+	bool hasReceiver;
+	bool tooBig; // not cached, patch is not kept
+};
+
+//
+//  FilesFetcher collects the output of a prefetched 'git diff-tree' file
+//  list and hands it over on success. Like DiffFetcher it is a child of the process.
+//
+class FilesFetcher : public QObject {
+Q_OBJECT
+public:
+	explicit FilesFetcher(SCRef k) : key(k) {}
+
+signals:
+	void filesReady(const QString& key, const QByteArray& output);
+
+public slots:
+	void procReadyRead(const QByteArray& data) { output.append(data); }
+	void procFinished();
+
+private:
+	QString key;
+	QByteArray output;
+};
+
+#endif
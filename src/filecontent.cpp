@@ -4,8 +4,10 @@
 	Copyright: See COPYING file that comes with this distribution
 
 */
-#include <QListWidget>
+#include <QPainter>
+#include <QPaintEvent>
 #include <QSyntaxHighlighter>
+#include <QTextBlock>
 #include <QTextCharFormat>
 #include <QTextCursor>
 #include <QScrollBar>
@@ -18,6 +20,7 @@
 #include "mainimpl.h"
 #include "git.h"
 #include "annotate.h"
+#include "bigfileview.h"
 #include "filecontent.h"
 
 class FileHighlighter : public QSyntaxHighlighter {
@@ -48,15 +51,120 @@ private:
 	FileContent* f;
 };
 
+class AnnotationGutter : public QWidget {
+// annotation labels and line numbers of the visible lines, painted
+// on the left of the text and aligned with the text layout
+public:
+	AnnotationGutter(FileContent* fc) : QWidget(fc), f(fc), labelLen(0) {}
+
+	bool isAnnotated() const {
+		return (f->isAnnotationAppended && f->curAnn && f->annotateObj);
+	}
+	int columns() const { // as many as the longest label painted so far
+		int digits = QString::number(f->document()->blockCount()).length();
+		return (isAnnotated() ? labelLen : 0) + 1 + digits + 2;
+	}
+	bool updateLabels();
+	int lineAt(int y) const { // -1 if y is not on a line
+		QTextBlock b = f->cursorForPosition(QPoint(0, y)).block();
+		QRectF r(blockRect(b));
+		return (y >= r.top() && y < r.bottom() ? b.blockNumber() : -1);
+	}
+
+protected:
+	virtual void paintEvent(QPaintEvent* e);
+	virtual void mouseDoubleClickEvent(QMouseEvent* e) {
+		int id = f->annIdAt(e->pos());
+		if (id)
+			emit f->revIdSelected(id);
+	}
+	virtual void wheelEvent(QWheelEvent* e) { f->wheelEvent(e); }
+
+private:
+	QRectF blockRect(const QTextBlock& b) const {
+		QRectF r(f->document()->documentLayout()->blockBoundingRect(b));
+		return r.translated(0, -f->verticalScrollBar()->value());
+	}
+	const QString& originLabel(int origin) {
+		QHash<int, QString>::const_iterator it(labels.constFind(origin));
+		if (it == labels.constEnd()) {
+			it = labels.insert(origin, f->annotateObj->originLabel(origin));
+			labelLen = qMax(labelLen, it.value().length());
+		}
+		return it.value();
+	}
+
+	FileContent* f;
+	QPointer<Annotate> labelsOf;
+	QHash<int, QString> labels; // few distinct origins, format them once
+	int labelLen;
+};
+
+bool AnnotationGutter::updateLabels() {
+// labels of the visible lines are looked up before painting,
+// true if a new longer one needs a wider gutter
+
+	if (!isAnnotated())
+		return false;
+
+	if (labelsOf != f->annotateObj) { // labels depend on file history
+		labels.clear();
+		labelLen = 0;
+		labelsOf = f->annotateObj;
+	}
+	int oldLabelLen = labelLen;
+	QTextBlock b = f->cursorForPosition(QPoint(0, 0)).block();
+	for ( ; b.isValid() && blockRect(b).top() < height(); b = b.next())
+		originLabel(f->curAnn->lines.at(b.blockNumber()));
+
+	return labelLen > oldLabelLen;
+}
+
+void AnnotationGutter::paintEvent(QPaintEvent*) {
+// labels are already known, see FileContent::updateGutter()
+
+	const bool annotated = (isAnnotated() && labelsOf == f->annotateObj);
+	QPainter p(this);
+	p.fillRect(rect(), palette().color(QPalette::Base));
+	const int digits = QString::number(f->document()->blockCount()).length();
+	QFont boldFont(font());
+	boldFont.setBold(true);
+
+	QTextBlock b = f->cursorForPosition(QPoint(0, 0)).block();
+	for ( ; b.isValid() && blockRect(b).top() < height(); b = b.next()) {
+
+		QRectF r(blockRect(b));
+		QRect lineRect(0, qRound(r.top()), width(), qRound(r.height()));
+		int origin = (annotated ? f->curAnn->lines.at(b.blockNumber()) : 0);
+		QString txt(annotated ? labels.value(origin).leftJustified(labelLen) : "");
+		txt.append(QString(" %1 ").arg(b.blockNumber() + 1, digits));
+
+		bool current = (annotated && origin == f->curAnn->annId);
+		if (current)
+			p.fillRect(lineRect, Qt::lightGray);
+
+		p.setFont(current ? boldFont : font());
+		p.setPen(current ? QColor(Qt::darkRed) : QColor(Qt::lightGray));
+		p.drawText(lineRect, Qt::AlignLeft | Qt::AlignVCenter, txt);
+	}
+}
+
 FileContent::FileContent(QWidget* parent) : QTextEdit(parent) {
 
 	isRangeFilterActive = isHtmlSource = isImageFile = isAnnotationAppended = false;
+	isAnnotationPartial = isBigFile = false;
 	isShowAnnotate = true;
+	spool = NULL;
 
 	rangeInfo = new RangeInfo();
 	fileHighlighter = new FileHighlighter(this);
 
+	gutter = new AnnotationGutter(this);
+	bigView = new BigFileView(this);
+	bigView->hide();
+
 	setFont(QGit::TYPE_WRITER_FONT);
+	bigView->setFont(QGit::TYPE_WRITER_FONT);
 }
 
 FileContent::~FileContent() {
@@ -66,19 +174,12 @@ FileContent::~FileContent() {
 	delete rangeInfo;
 }
 
-void FileContent::setup(Domain* dm, Git* g, QListWidget* lw) {
+void FileContent::setup(Domain* dm, Git* g) {
 
 	d = dm;
 	git = g;
 	st = &(d->st);
 
-	listWidgetAnn = lw;
-	lw->setParent(this);
-	lw->setSelectionMode(QAbstractItemView::NoSelection);
-	QPalette pl = lw->palette();
-	pl.setColor(QPalette::Text, Qt::lightGray);
-	lw->setPalette(pl);
-
 	clearAll(!optEmitSignal);
 
 	connect(d->m(), SIGNAL(typeWriterFontChanged()),
@@ -87,46 +188,31 @@ void FileContent::setup(Domain* dm, Git* g, QListWidget* lw) {
 	connect(git, SIGNAL(annotateReady(Annotate*, bool, const QString&)),
 	        this, SLOT(on_annotateReady(Annotate*, bool, const QString&)));
 
-	connect(listWidgetAnn, SIGNAL(itemDoubleClicked(QListWidgetItem*)),
-	        this, SLOT(on_list_doubleClicked(QListWidgetItem*)));
-
 	QScrollBar* vsb = verticalScrollBar();
 	connect(vsb, SIGNAL(valueChanged(int)),
 	        this, SLOT(on_scrollBar_valueChanged(int)));
         vsb->setSingleStep(fontMetrics().lineSpacing());
-
-	vsb = listWidgetAnn->verticalScrollBar();
-	connect(vsb, SIGNAL(valueChanged(int)),
-	        this, SLOT(on_listScrollBar_valueChanged(int)));
-        vsb->setSingleStep(fontMetrics().lineSpacing());
 }
 
-void FileContent::on_scrollBar_valueChanged(int value) {
+void FileContent::on_scrollBar_valueChanged(int) {
 
-	listWidgetAnn->verticalScrollBar()->setValue(value);
+	updateGutter();
 }
 
-void FileContent::on_listScrollBar_valueChanged(int value) {
+QWidget* FileContent::annotationGutter() const {
 
-	verticalScrollBar()->setValue(value);
+	return gutter;
 }
 
-int FileContent::itemAnnId(QListWidgetItem* item) {
+int FileContent::annIdAt(const QPoint& pos) {
+// annotation id of the line at gutter position pos, 0 if none
 
-	if (item == NULL)
-		return 0;
-	QString id(item->text());
-	if (!id.contains('.'))
+	if (isBigFile || !gutter->isAnnotated())
 		return 0;
 
-	return id.section('.', 0, 0).toInt();
-}
-
-void FileContent::on_list_doubleClicked(QListWidgetItem* item) {
-
-	int id = itemAnnId(item);
-	if (id)
-		emit revIdSelected(id);
+	int line = gutter->lineAt(pos.y());
+	int id = (line != -1 ? curAnn->lines.at(line) : 0);
+	return (id > 0 ? id : 0); // no merges and initial revision
 }
 
 void FileContent::clearAnnotate(bool emitSignal) {
@@ -134,7 +220,9 @@ void FileContent::clearAnnotate(bool emitSignal) {
 	git->cancelAnnotate(annotateObj);
 	annotateObj = NULL;
 	curAnn = NULL;
-	isAnnotationLoading = false;
+	isAnnotationLoading = isAnnotationPartial = false;
+	bigView->setAnnotation(NULL, NULL);
+	gutter->update();
 
 	if (emitSignal)
 		emit annotationAvailable(false);
@@ -146,8 +234,13 @@ void FileContent::clearText(bool emitSignal) {
 	proc = NULL;
 	fileRowData.clear();
 	QTextEdit::clear(); // explicit call because our clear() is only declared
-	listWidgetAnn->clear();
-	isFileAvail = isAnnotationAppended = false;
+	gutter->update();
+	delete spool;
+	spool = NULL;
+	bigView->clear();
+	bigView->hide();
+	setFocusProxy(NULL);
+	isFileAvail = isAnnotationAppended = isBigFile = false;
 
 	if (emitSignal)
 		emit fileAvailable(false);
@@ -230,19 +323,21 @@ bool FileContent::startAnnotate(FileHistory* fh, SCRef ht) {
 	if (!isImageFile)
 		annotateObj = git->startAnnotate(fh, d); // non blocking
 
+	if (annotateObj)
+		connect(annotateObj, SIGNAL(annotateProgress(int, int)),
+		        this, SLOT(on_annotateProgress(int, int)));
+
 	histTime = ht;
 	isAnnotationLoading = (annotateObj != NULL);
-	return isAnnotationLoading;
-}
-
-uint FileContent::annotateLength(const FileAnnotation* annFile) {
 
-	int maxLen = 0;
-	FOREACH_SL (it, annFile->lines)
-		if ((*it).length() > maxLen)
-			maxLen = (*it).length();
+	// start from what user is looking at, could be already cached
+	if (isAnnotationLoading && lookupAnnotation()) {
+		if (isFileAvail)
+			setAnnList();
 
-	return maxLen;
+		emit annotationAvailable(true);
+	}
+	return isAnnotationLoading;
 }
 
 bool FileContent::getRange(SCRef sha, RangeInfo* r) {
@@ -261,6 +356,10 @@ void FileContent::scrollCursorToTop() {
 
 void FileContent::scrollLineToTop(int lineNum) {
 
+	if (isBigFile) {
+		bigView->scrollToLine(lineNum);
+		return;
+	}
 	QTextCursor tc = textCursor();
 	tc.movePosition(QTextCursor::Start);
 	tc.movePosition(QTextCursor::NextBlock, QTextCursor::MoveAnchor, lineNum);
@@ -279,12 +378,18 @@ int FileContent::positionToLineNum(int pos) {
 
 int FileContent::lineAtTop() {
 
+	if (isBigFile)
+		return bigView->topLine();
+
 	return cursorForPosition(QPoint(1, 1)).blockNumber();
 }
 
 void FileContent::setSelection(int paraFrom, int indexFrom, int paraTo, int indexTo) {
 
 	scrollLineToTop(paraFrom);
+	if (isBigFile) // no selection, the range is only scrolled to
+		return;
+
 	QTextCursor tc = textCursor();
 	tc.setPosition(tc.position() + indexFrom);
 	tc.movePosition(QTextCursor::StartOfBlock, QTextCursor::KeepAnchor);
@@ -297,6 +402,11 @@ void FileContent::setSelection(int paraFrom, int indexFrom, int paraTo, int inde
 void FileContent::saveScreenState() {
 
 	ss.isValid = true;
+	if (isBigFile) {
+		ss.hasSelectedText = false;
+		ss.topPara = lineAtTop();
+		return;
+	}
 	QTextCursor tc = textCursor();
 	ss.hasSelectedText = tc.hasSelection();
 	if (ss.hasSelectedText) {
@@ -327,18 +437,14 @@ void FileContent::goToAnnotation(int revId, int dir) {
 	if (!isAnnotationAppended || !curAnn || (revId == 0))
 		return;
 
-	const QString header(QString::number(revId) + ".");
+	const AnnotationLines& lines = curAnn->lines;
 	int row = (dir == 0 ? -1 : lineAtTop());
-	QListWidgetItem* itm = NULL;
-	do {
+	do
 		row += (dir >= 0 ? 1 : -1);
-		itm = listWidgetAnn->item(row);
+	while (row >= 0 && row < lines.count() && lines.at(row) != revId);
 
-		if (itm && itm->text().trimmed().startsWith(header)) {
-			scrollLineToTop(row);
-			break;
-		}
-	} while (itm);
+	if (row >= 0 && row < lines.count())
+		scrollLineToTop(row);
 }
 
 bool FileContent::goToRangeStart() {
@@ -373,6 +479,10 @@ bool FileContent::rangeFilter(bool b) {
 
 	isRangeFilterActive = false;
 
+	if (b && isBigFile) {
+		d->showStatusBarMessage("Sorry, range filter not available for huge files.");
+		return false;
+	}
 	if (b) {
 		if (!annotateObj) {
 			dbs("ASSERT in rangeFilter: annotateObj not available");
@@ -425,7 +535,6 @@ bool FileContent::lookupAnnotation() {
 
 	if (    st->sha().isEmpty()
 	    ||  st->fileName().isEmpty()
-	    || isAnnotationLoading
 	    || !annotateObj)
 		return false;
 
@@ -433,15 +542,18 @@ bool FileContent::lookupAnnotation() {
 		d->setThrowOnDelete(true);
 
 		// could call qApp->processEvents()
+		// while loading a missing revision is annotated as next one
 		curAnn = git->lookupAnnotation(annotateObj, st->sha());
 
-		if (!curAnn) {
+		if (!curAnn && !isAnnotationLoading) {
 			dbp("ASSERT in lookupAnnotation: no annotation for %1", st->fileName());
 			clearAnnotate(optEmitSignal);
 
-		} else if (curAnn->lines.empty())
+		} else if (curAnn && curAnn->lines.isEmpty())
 			curAnn = NULL;
 
+		isAnnotationPartial = (curAnn && annotateObj->isPartial(curAnn));
+
 		d->setThrowOnDelete(false);
 
 	} catch (int i) {
@@ -480,11 +592,34 @@ void FileContent::on_annotateReady(Annotate* readyAnn, bool ok, const QString& m
 		emit annotationAvailable(true);
 }
 
+void FileContent::on_annotateProgress(int done, int total) {
+// annotation of current revision could be ready well before the whole history
+
+	if (sender() != annotateObj || !isAnnotationLoading)
+		return;
+
+	QString msg("Annotating revisions of '%1'... %2/%3");
+	d->showStatusBarMessage(msg.arg(st->fileName()).arg(done).arg(total));
+
+	if (curAnn && !isAnnotationPartial) // already complete
+		return;
+
+	bool wasAvailable = (curAnn != NULL);
+	if (lookupAnnotation()) {
+		if (isFileAvail)
+			setAnnList();
+
+		if (!wasAvailable)
+			emit annotationAvailable(true);
+	}
+}
+
 void FileContent::typeWriterFontChanged() {
 
 	setFont(QGit::TYPE_WRITER_FONT);
+	bigView->setFont(QGit::TYPE_WRITER_FONT);
 
-	if (!isHtmlSource && !isImageFile && isFileAvail) {
+	if (!isHtmlSource && !isImageFile && !isBigFile && isFileAvail) {
 		setPlainText(toPlainText());
 		setAnnList();
 	}
@@ -492,15 +627,57 @@ void FileContent::typeWriterFontChanged() {
 
 void FileContent::procReadyRead(const QByteArray& fileChunk) {
 
-	fileRowData.append(fileChunk);
+	if (   !isBigFile && !isImageFile && !isHtmlSource
+	    && fileRowData.size() + fileChunk.size() > QGit::BIG_FILE_SIZE)
+		switchToBigFile();
+
+	if (isBigFile)
+		spool->write(fileChunk);
+	else
+		fileRowData.append(fileChunk);
 	// set text at the end of loading, much faster
 }
 
+void FileContent::switchToBigFile() {
+// a huge file does not fit in a QTextDocument, so it is
+// spooled to disk and then shown memory mapped by bigView
+
+	spool = new QTemporaryFile();
+	if (!spool->open()) {
+		dbs("ASSERT in switchToBigFile: unable to open a temporary file");
+		delete spool;
+		spool = NULL;
+		return;
+	}
+	spool->write(fileRowData);
+	fileRowData.clear();
+	isBigFile = true;
+}
+
+bool FileContent::showBigFile() {
+// on mapping failure the file is loaded as a normal one
+
+	QTemporaryFile* f = spool;
+	spool = NULL;
+	if (f->flush() && bigView->setFile(f)) { // takes ownership
+		bigView->setGeometry(rect());
+		bigView->show();
+		bigView->raise();
+		setFocusProxy(bigView);
+		return true;
+	}
+	f->seek(0);
+	fileRowData = f->readAll();
+	delete f;
+	isBigFile = false;
+	return false;
+}
+
 void FileContent::procFinished(bool emitSignal) {
 
 	if (isImageFile)
 		showFileImage();
-	else {
+	else if (!isBigFile || !showBigFile()) {
 		if (!fileRowData.endsWith("\n"))
 			fileRowData.append('\n'); // fake a trailing new line
 
@@ -538,99 +715,43 @@ void FileContent::showFileImage() {
 }
 
 void FileContent::setAnnList() {
+// labels are painted only for the visible lines, see AnnotationGutter
 
-	int linesNum = document()->blockCount();
-	int linesNumDigits = QString::number(linesNum).length();
-	int curId = 0, annoMaxLen = 0;
-	QStringList::const_iterator it, endIt;
-
-	isAnnotationAppended = isShowAnnotate && curAnn;
+	isAnnotationAppended = isShowAnnotate && curAnn && annotateObj;
 
-	if (isAnnotationAppended) {
-		annoMaxLen = annotateLength(curAnn);
-		it = curAnn->lines.constBegin();
-		endIt = curAnn->lines.constEnd();
-		curId = curAnn->annId;
+	if (isBigFile) {
+		bigView->setAnnotation(isAnnotationAppended ? curAnn : NULL, annotateObj);
+		return;
 	}
-	listWidgetAnn->setFont(currentFont());
+	adjustGutter();
+	updateGutter();
+}
 
-	QString tmp;
-	tmp.fill('M', annoMaxLen + 1 + linesNumDigits + 2);
-	int width = listWidgetAnn->fontMetrics().boundingRect(tmp).width();
-
-	QStringList sl;
-	QVector<int> curIdLines;
-	for (int i = 0; i < linesNum; i++) {
-
-		if (isAnnotationAppended) {
-			if (it != endIt)
-				tmp = (*(it++)).leftJustified(annoMaxLen);
-			else
-				tmp = QString().leftJustified(annoMaxLen);
-
-			if (tmp.section('.',0 ,0).toInt() == curId)
-				curIdLines.append(i);
-		} else
-			tmp.clear();
-
-		tmp.append(QString(" %1 ").arg(i + 1, linesNumDigits));
-		sl.append(tmp);
-	}
-        sl.append(QString());  // QTextEdit adds a blank line after content
-	listWidgetAnn->setUpdatesEnabled(false);
-	listWidgetAnn->clear();
-	listWidgetAnn->addItems(sl);
-
-	QAbstractTextDocumentLayout *layout = document()->documentLayout();
-	if (layout != NULL) {
-                qreal previousBottom = 0.;
-		QTextBlock block = document()->begin();
-                for (int i = 0; i < linesNum; i++) {
-                        qreal bottom = layout->blockBoundingRect(block).bottom();
-			QListWidgetItem* item = listWidgetAnn->item(i);
-                        item->setSizeHint(QSize(0, static_cast<int>(bottom - previousBottom)));
-                        item->setTextAlignment(Qt::AlignVCenter);  // Move down a pixel or so.
-
-			previousBottom = bottom;
-			block = block.next();
-		}
-	}
+void FileContent::updateGutter() {
+// called when visible lines could change, never while painting
+// because resizing the gutter moves the text view
 
-	QBrush fore(Qt::darkRed);
-	QBrush back(Qt::lightGray);
-	QFont f(listWidgetAnn->font());
-	f.setBold(true);
-	FOREACH (QVector<int>, it, curIdLines) {
-		QListWidgetItem* item = listWidgetAnn->item(*it);
-		item->setForeground(fore);
-		item->setBackground(back);
-		item->setFont(f);
-	}
-	/* When listWidgetAnn get focus for the first time the current
-	   item, if not already present, is set to the first row and
-	   scrolling starts from there, so set a proper current item here
-	*/
-	int topRow = lineAtTop() + 1;
-	listWidgetAnn->setCurrentRow(topRow);
-        listWidgetAnn->adjustSize(); // update scrollbar state
-        adjustAnnListSize(width);
-        listWidgetAnn->setUpdatesEnabled(true);
+	if (gutter->updateLabels())
+		adjustGutter();
+
+	gutter->update();
 }
 
-void FileContent::adjustAnnListSize(int width) {
+void FileContent::adjustGutter() {
 
-        QRect r = listWidgetAnn->geometry();
-        r.setWidth(width);
-        int height = geometry().height();
-        if (horizontalScrollBar()->isVisible()) height -= horizontalScrollBar()->height();
-        r.setHeight(height);
-        listWidgetAnn->setGeometry(r);
-        setViewportMargins(width, 0, 0, 0); // move textedit view to the left of listWidgetAnn
+	gutter->setFont(currentFont());
+	QString tmp;
+	tmp.fill('M', gutter->columns());
+	int width = gutter->fontMetrics().boundingRect(tmp).width();
+	QRect r(contentsRect());
+	gutter->setGeometry(r.left(), r.top(), width, viewport()->height());
+	setViewportMargins(width, 0, 0, 0); // move textedit view to the right of gutter
 }
 
 void FileContent::resizeEvent(QResizeEvent* e) {
 
 	QTextEdit::resizeEvent(e);
-	int width = listWidgetAnn->geometry().width();
-	adjustAnnListSize(width); // update list width
+	bigView->setGeometry(rect());
+	adjustGutter();
+	updateGutter();
 }
@@ -12,6 +12,7 @@
 #include "common.h"
 
 class FileHighlighter;
+class AnnotationGutter;
 class Domain;
 class StateInfo;
 class Annotate;
@@ -19,16 +20,16 @@ class Git;
 class MyProcess;
 class RangeInfo;
 class FileHistory;
+class BigFileView;
 
-class QListWidget;
-class QListWidgetItem;
+class QTemporaryFile;
 
 class FileContent: public QTextEdit {
 Q_OBJECT
 public:
 	FileContent(QWidget* parent);
 	~FileContent();
-	void setup(Domain* parent, Git* git, QListWidget* lwa);
+	void setup(Domain* parent, Git* git);
 	void doUpdate(bool force = false);
 	void clearAll(bool emitSignal = true);
 	void copySelection();
@@ -40,7 +41,8 @@ public:
 	void setShowAnnotate(bool b);
 	void setHighlightSource(bool b);
 	void setSelection(int paraFrom, int indexFrom, int paraTo, int indexTo);
-	int itemAnnId(QListWidgetItem* item);
+	int annIdAt(const QPoint& pos);
+	QWidget* annotationGutter() const;
 	bool isFileAvailable() const { return isFileAvail; }
 	bool isAnnotateAvailable() const { return curAnn != NULL; }
 
@@ -59,12 +61,12 @@ protected:
 	virtual void resizeEvent(QResizeEvent* e);
 
 private slots:
-	void on_list_doubleClicked(QListWidgetItem*);
+	void on_annotateProgress(int done, int total);
 	void on_scrollBar_valueChanged(int);
-	void on_listScrollBar_valueChanged(int);
 
 private:
 	friend class FileHighlighter;
+	friend class AnnotationGutter;
 
 	void clear(); // declared as private, to avoid indirect access to QTextEdit::clear()
 	void clearAnnotate(bool emitSignal);
@@ -75,31 +77,37 @@ private:
 	int positionToLineNum(int pos = -1);
 	int lineAtTop();
 	bool lookupAnnotation();
-	uint annotateLength(const FileAnnotation* curAnn);
 	void saveScreenState();
 	void restoreScreenState();
 	void showFileImage();
-	void adjustAnnListSize(int width);
+	void switchToBigFile();
+	bool showBigFile();
+	void adjustGutter();
+	void updateGutter();
 	void setAnnList();
 
 	Domain* d;
 	Git* git;
-	QListWidget* listWidgetAnn;
+	AnnotationGutter* gutter;
+	BigFileView* bigView; // shown over the text for huge files
+	QTemporaryFile* spool; // huge file being loaded
 	StateInfo* st;
 	RangeInfo* rangeInfo;
 	FileHighlighter* fileHighlighter;
 	QPointer<MyProcess> proc;
 	QPointer<Annotate> annotateObj; // valid from beginning of annotation loading
-	const FileAnnotation* curAnn; // valid at the end of annotation loading
+	const FileAnnotation* curAnn; // valid once current revision is annotated
 	QByteArray fileRowData;
 	QString histTime;
 	bool isFileAvail;
 	bool isAnnotationLoading;
 	bool isAnnotationAppended;
+	bool isAnnotationPartial; // curAnn is still streamed by git blame
 	bool isRangeFilterActive;
 	bool isShowAnnotate;
 	bool isHtmlSource;
 	bool isImageFile;
+	bool isBigFile;
 
 	struct ScreenState {
 		bool isValid, hasSelectedText;
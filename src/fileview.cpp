@@ -26,7 +26,7 @@ FileView::FileView(MainImpl* mi, Git* g) : Domain(mi, g, false) {
 	fileTab = new Ui_TabFile();
 	fileTab->setupUi(container);
 	fileTab->histListView->setup(this, git);
-	fileTab->textEditFile->setup(this, git, fileTab->listWidgetAnn);
+	fileTab->textEditFile->setup(this, git);
 
 	// an empty string turn off the special-value text display
 	fileTab->spinBoxRevision->setSpecialValueText(" ");
@@ -37,7 +37,7 @@ FileView::FileView(MainImpl* mi, Git* g) : Domain(mi, g, false) {
 
 	clear(true); // init some stuff
 
-	fileTab->listWidgetAnn->installEventFilter(this);
+	fileTab->textEditFile->annotationGutter()->installEventFilter(this);
 
 	connect(git, SIGNAL(loadCompleted(const FileHistory*, const QString&)),
 	        this, SLOT(on_loadCompleted(const FileHistory*, const QString&)));
@@ -98,14 +98,14 @@ FileView::~FileView() {
 
 bool FileView::eventFilter(QObject* obj, QEvent* e) {
 
-	QListWidget* lw = fileTab->listWidgetAnn;
-	if (e->type() == QEvent::ToolTip && obj == lw) {
+	QWidget* gutter = fileTab->textEditFile->annotationGutter();
+	if (e->type() == QEvent::ToolTip && obj == gutter) {
 		QHelpEvent* h = static_cast<QHelpEvent*>(e);
-		int id = fileTab->textEditFile->itemAnnId(lw->itemAt(h->pos()));
+		int id = fileTab->textEditFile->annIdAt(h->pos());
 		QRegularExpression re;
 		SCRef sha(fileTab->histListView->shaFromAnnId(id));
 		SCRef d(git->getDesc(sha, re, re, false, model()));
-		lw->setToolTip(d);
+		gutter->setToolTip(d);
 	}
 	return QObject::eventFilter(obj, e);
 }
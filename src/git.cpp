@@ -26,10 +26,12 @@
 #include "annotate.h"
 #include "cache.h"
 #include "dataloader.h"
+#include "diffcache.h"
 #include "git.h"
 #include "lanes.h"
 #include "myprocess.h"
 #include "rangeselectimpl.h"
+#include "treeindex.h"
 
 #define SHOW_MSG(x) QApplication::postEvent(parent(), new MessageEvent(x)); EM_PROCESS_EVENTS_NO_INPUT;
 
@@ -75,7 +77,11 @@ Git::Git(QObject* p) : QObject(p) {
 	errorReportingEnabled = true; // report errors if run() fails
 	curDomain = NULL;
 	shortHashLen = shortHashLenDefault;
+	refsGen = 0;
 	revData = NULL;
+	treeIndexer = NULL;
+	diffCache = new DiffCache(this);
+	pairFiles.setMaxCost(PAIR_FILES_CNT);
 	revsFiles.reserve(MAX_DICT_SIZE);
 }
 
@@ -601,14 +607,16 @@ int Git::findFileIndex(const RevFile& rf, SCRef name) {
 }
 
 const QString Git::getLaneParent(SCRef fromSHA, int laneNum) {
+// rows are walked by index and the parent is resolved through
+// its key, so only fromSHA is looked up
 
 	const Rev* rs = revLookup(fromSHA);
-	if (!rs)
+	if (!rs || rs->orderIdx > revData->rowRev.count())
 		return "";
 
 	for (int idx = rs->orderIdx - 1; idx >= 0; idx--) {
 
-		const Rev* r = revLookup(revData->revOrder[idx]);
+		const Rev* r = revData->rowRev[idx];
 		if (laneNum >= r->lanes.count())
 			return "";
 
@@ -622,33 +630,30 @@ const QString Git::getLaneParent(SCRef fromSHA, int laneNum) {
 
 				type = r->lanes[--laneNum];
 			}
-			return r->parent(parNum);
+			int row = revData->parentRow(idx, parNum);
+			return (row != -1 ? revData->revOrder[row] : r->parent(parNum));
 		}
 	}
 	return "";
 }
 
-const QStringList Git::getChildren(SCRef parent) {
+const QStringList Git::getChildren(SCRef parent, bool* pending) {
 
-        QStringList children;
+	QStringList children;
 	const Rev* r = revLookup(parent);
-	if (!r)
-                return children;
+	bool ready = revData->isGraphReady(); // children known only after loading
+	if (pending)
+		*pending = !ready;
 
-        for (int i = 0; i < r->children.count(); i++)
-                children.append(revData->revOrder[r->children[i]]);
+	if (!r || !ready)
+		return children;
 
-        // reorder children by loading order
-        QStringList::iterator itC(children.begin());
-        for ( ; itC != children.end(); ++itC) {
-		const Rev* r = revLookup(*itC);
-		(*itC).prepend(QString("%1 ").arg(r->orderIdx, 6));
-	}
-        children.sort();
-        for (itC = children.begin(); itC != children.end(); ++itC)
-		(*itC) = (*itC).section(' ', -1, -1);
+	// already in loading order
+	const FileHistory* fh = revData;
+	for (int i = fh->childOfs[r->orderIdx]; i < fh->childOfs[r->orderIdx + 1]; i++)
+		children.append(fh->revOrder[fh->childIdx[i]]);
 
-        return children;
+	return children;
 }
 
 const QString Git::getShortLog(SCRef sha) {
@@ -657,11 +662,80 @@ const QString Git::getShortLog(SCRef sha) {
 	return (r ? r->shortLog() : "");
 }
 
+const QString Git::diffKey(SCRef sha, SCRef diffToSha, bool combined) {
+// working directory changes, so its patch is never cached
+
+	if (sha == ZERO_SHA)
+		return "";
+
+	return sha + " " + diffToSha + (combined ? " c" : " m");
+}
+
 MyProcess* Git::getDiff(SCRef sha, QObject* receiver, SCRef diffToSha, bool combined) {
+// returns NULL also when the patch is cached, in this case receiver
+// gets procReadyRead() and procFinished() before returning
 
 	if (sha.isEmpty())
 		return NULL;
 
+	const QString key(diffKey(sha, diffToSha, combined));
+	QByteArray patch;
+	if (diffCache->find(key, &patch)) {
+		QMetaObject::invokeMethod(receiver, "procReadyRead", Q_ARG(QByteArray, patch));
+		QMetaObject::invokeMethod(receiver, "procFinished");
+		return NULL;
+	}
+	// a prefetch could be already running, just take it over. If it
+	// has already finished it failed, otherwise the patch was cached,
+	// so run it again to report the error
+	MyProcess* p = prefetching.take(key);
+	bool running = (p && p->state() != QProcess::NotRunning);
+	DiffFetcher* f = (running ? p->findChild<DiffFetcher*>() : NULL);
+	if (f && f->attach(receiver)) {
+		p->setErrorReporting(true); // not a guess anymore
+		return p;
+	}
+	return runDiff(sha, diffToSha, combined, receiver);
+}
+
+void Git::prefetchDiffs(SCList shas, SCRef diffToSha, bool allMergeFiles) {
+// speculative loading of patches likely to be shown next, as
+// example of the revisions around the selected one
+
+	QStringList keys;
+	FOREACH_SL (it, shas) {
+
+		const Rev* r = revLookup(*it);
+		bool combined = (r && r->parentsCount() > 1 && !allMergeFiles);
+		keys.append(r ? diffKey(*it, diffToSha, combined) : "");
+	}
+	// cancel prefetches not needed anymore
+	QHash<QString, QPointer<MyProcess> >::iterator it = prefetching.begin();
+	while (it != prefetching.end()) {
+		if (keys.contains(it.key()))
+			++it;
+		else {
+			cancelProcess(it.value());
+			it = prefetching.erase(it);
+		}
+	}
+	for (int i = 0; i < keys.count(); i++) {
+
+		if (keys[i].isEmpty() || diffCache->contains(keys[i]) || prefetching.value(keys[i]))
+			continue;
+
+		bool combined = keys[i].endsWith(" c");
+		errorReportingEnabled = false; // it is only a guess, no noise
+		MyProcess* p = runDiff(shas[i], diffToSha, combined, NULL);
+		errorReportingEnabled = true;
+		if (p)
+			prefetching.insert(keys[i], p);
+	}
+}
+
+MyProcess* Git::runDiff(SCRef sha, SCRef diffToSha, bool combined, QObject* receiver) {
+// patch is sent to receiver through a DiffFetcher, that caches it
+
 	QString runCmd;
 	if (sha != ZERO_SHA) {
 		runCmd = "git diff-tree --no-color -r --patch-with-stat ";
@@ -675,7 +749,14 @@ MyProcess* Git::getDiff(SCRef sha, QObject* receiver, SCRef diffToSha, bool comb
 	} else
 		runCmd = "git diff-index --no-color -r -m --patch-with-stat HEAD";
 
-	return runAsync(runCmd, receiver);
+	DiffFetcher* f = new DiffFetcher(diffCache, diffKey(sha, diffToSha, combined), receiver);
+	MyProcess* p = runAsync(runCmd, f);
+	if (!p) {
+		delete f;
+		return NULL;
+	}
+	f->setParent(p); // deleted with the process, also when canceled
+	return p;
 }
 
 const QString Git::getWorkDirDiff(SCRef fileName) {
@@ -752,6 +833,22 @@ MyProcess* Git::getFile(SCRef fileSha, QObject* receiver, QByteArray* result, SC
 	return runAsync(runCmd, receiver);
 }
 
+MyProcess* Git::getBlame(SCRef sha, SCRef fileName, QObject* receiver) {
+// incremental output is streamed to receiver as soon as git finds a
+// line origin, with ZERO_SHA the working directory file is blamed
+
+	QString runCmd("git blame --incremental ");
+	if (sha != ZERO_SHA)
+		runCmd.append(sha + " ");
+
+	runCmd.append("-- " + quote(fileName));
+
+	errorReportingEnabled = false; // caller falls back on history annotation
+	MyProcess* p = runAsync(runCmd, receiver);
+	errorReportingEnabled = true;
+	return p;
+}
+
 MyProcess* Git::getHighlightedFile(SCRef fileSha, QObject* receiver, QString* result, SCRef fileName) {
 
 	if (!isTextHighlighter()) {
@@ -892,20 +989,120 @@ bool Git::isTreeModified(SCRef sha) {
 
 bool Git::isParentOf(SCRef par, SCRef child) {
 
-	const Rev* c = revLookup(child);
-	return (c && c->parentsCount() == 1 && QString(c->parent(0)) == par); // no merges
+	int dist;
+	return isLinearAncestor(par, child, NULL, &dist) && dist == 1; // no merges
 }
 
-bool Git::isContiguous(const QStringList &revs)
-{
-	if (revs.count() == 1) return true;
-	for (QStringList::const_iterator it=revs.begin(), end=revs.end()-1; it!=end; ++it) {
-		const Rev* c = revLookup(*it);
-		if (!c->parents().contains(*(it+1))) return false;
+bool Git::isContiguous(SCList revs) {
+// true if each revision is a parent of the previous one
+
+	for (int i = 1; i < revs.count(); i++) {
+
+		const Rev* c = revLookup(revs[i - 1]);
+		if (!c)
+			return false;
+
+		if (!revData->isGraphReady()) { // still loading
+			if (!c->parents().contains(revs[i]))
+				return false;
+			continue;
+		}
+		const Rev* p = revLookup(revs[i]);
+		if (!p || !revData->reach.isParent(p->orderIdx, c->orderIdx))
+			return false;
 	}
 	return true;
 }
 
+bool Git::isAncestor(SCRef anc, SCRef desc, const FileHistory* fh) {
+// true if 'anc' is reached from 'desc' walking along parents
+
+	if (!fh)
+		fh = revData;
+
+	const Rev* a = revLookup(anc, fh);
+	const Rev* d = revLookup(desc, fh);
+	if (!a || !d || a == d)
+		return false;
+
+	if (fh->isGraphReady())
+		return fh->reach.isAncestor(a->orderIdx, d->orderIdx);
+
+	// still loading, ancestors are always loaded after descendants
+	QVector<const Rev*> stack(1, d);
+	QSet<int> seen;
+	while (!stack.isEmpty()) {
+
+		const Rev* r = stack.last();
+		stack.pop_back();
+		for (uint i = 0; i < r->parentsCount(); i++) {
+
+			const Rev* p = revLookup(r->parent(i), fh);
+			if (p == a)
+				return true;
+
+			if (p && p->orderIdx < a->orderIdx && !seen.contains(p->orderIdx)) {
+				seen.insert(p->orderIdx);
+				stack.append(p);
+			}
+		}
+	}
+	return false;
+}
+
+const QVector<bool> Git::areAncestors(SCList ancs, SCRef desc, const FileHistory* fh) {
+// batch version of isAncestor(), for multi selection
+
+	if (!fh)
+		fh = revData;
+
+	QVector<bool> res(ancs.count(), false);
+	const Rev* d = revLookup(desc, fh);
+	if (!d)
+		return res;
+
+	if (!fh->isGraphReady()) {
+		for (int i = 0; i < ancs.count(); i++)
+			res[i] = isAncestor(ancs[i], desc, fh);
+		return res;
+	}
+	QVector<int> rows(ancs.count(), -1);
+	for (int i = 0; i < ancs.count(); i++) {
+		const Rev* a = revLookup(ancs[i], fh);
+		if (a)
+			rows[i] = a->orderIdx;
+	}
+	fh->reach.areAncestors(rows, d->orderIdx, res);
+	return res;
+}
+
+bool Git::isLinearAncestor(SCRef anc, SCRef desc, const FileHistory* fh, int* dist) {
+// true if 'anc' is reached from 'desc' walking along parents of non-merge
+// revisions only, i.e. with no need of the other merged branches to get
+// from 'anc' to 'desc'. A revision is a linear ancestor of itself.
+
+	if (!fh)
+		fh = revData;
+
+	const Rev* a = revLookup(anc, fh);
+	const Rev* r = revLookup(desc, fh);
+	if (!a || !r)
+		return false;
+
+	if (fh->isGraphReady())
+		return fh->reach.isLinearAncestor(a->orderIdx, r->orderIdx, dist);
+
+	int cnt = 0;
+	while (r && r->orderIdx < a->orderIdx && r->parentsCount() == 1) {
+		r = revLookup(r->parent(0), fh);
+		cnt++;
+	}
+	if (dist)
+		*dist = cnt;
+
+	return (r == a);
+}
+
 bool Git::isSameFiles(SCRef tree1Sha, SCRef tree2Sha) {
 
 	// early skip common case of browsing with up and down arrows, i.e.
@@ -926,14 +1123,15 @@ bool Git::isSameFiles(SCRef tree1Sha, SCRef tree2Sha) {
 	return !isChanged;
 }
 
-const QStringList Git::getDescendantBranches(SCRef sha, bool shaOnly) {
+const QStringList Git::getDescendantBranches(SCRef sha, bool shaOnly, bool* pending) {
 
 	QStringList tl;
 	const Rev* r = revLookup(sha);
-	if (!r || (r->descBrnMaster == -1))
+	const TreeIndex* ti = getTreeIndex(pending);
+	if (!r || !ti || r->orderIdx >= ti->count() || ti->descBrnMaster[r->orderIdx] == -1)
 		return tl;
 
-	const QVector<int>& nr = revLookup(revData->revOrder[r->descBrnMaster])->descBranches;
+	const QVector<int>& nr = ti->descBranches[ti->descBrnMaster[r->orderIdx]];
 
 	for (int i = 0; i < nr.count(); i++) {
 
@@ -956,19 +1154,19 @@ const QStringList Git::getDescendantBranches(SCRef sha, bool shaOnly) {
 	return tl;
 }
 
-const QStringList Git::getNearTags(bool goDown, SCRef sha) {
+const QStringList Git::getNearTags(bool goDown, SCRef sha, bool* pending) {
 
 	QStringList tl;
 	const Rev* r = revLookup(sha);
-	if (!r)
+	const TreeIndex* ti = getTreeIndex(pending);
+	if (!r || !ti || r->orderIdx >= ti->count())
 		return tl;
 
-	int nearRefsMaster = (goDown ? r->descRefsMaster : r->ancRefsMaster);
+	int nearRefsMaster = (goDown ? ti->descRefsMaster[r->orderIdx] : ti->ancRefsMaster[r->orderIdx]);
 	if (nearRefsMaster == -1)
 		return tl;
 
-	const QVector<int>& nr = goDown ? revLookup(revData->revOrder[nearRefsMaster])->descRefs :
-	                                  revLookup(revData->revOrder[nearRefsMaster])->ancRefs;
+	const QVector<int>& nr = goDown ? ti->descRefs[nearRefsMaster] : ti->ancRefs[nearRefsMaster];
 
 	for (int i = 0; i < nr.count(); i++) {
 
@@ -1128,7 +1326,7 @@ const QString Git::getDesc(SCRef sha, QRegularExpression& shortLogRE, QRegularEx
 				ts << formatList(QStringList(qt4and5escaping(c->committer())), "Committer");
 
 			ts << formatList(QStringList(qt4and5escaping(c->author())), "Author");
-			ts << formatList(QStringList(getLocalDate(c->authorDate())), " Author date");
+			ts << formatList(QStringList(getLocalDate(c->authorTime())), " Author date");
 
 			if (c->isUnApplied || c->isApplied) {
 
@@ -1137,10 +1335,19 @@ const QString Git::getDesc(SCRef sha, QRegularExpression& shortLogRE, QRegularEx
 				ts << formatList(patches, "Patch");
 			} else {
 				ts << formatList(c->parents(), "Parent", false);
-                                ts << formatList(getChildren(sha), "Child", false);
-				ts << formatList(getDescendantBranches(sha), "Branch", false);
-				ts << formatList(getNearTags(!optGoDown, sha), "Follows");
-				ts << formatList(getNearTags(optGoDown, sha), "Precedes");
+				bool pending = false, idxPending = false;
+				QStringList children(getChildren(sha, &pending));
+				getTreeIndex(&idxPending);
+				if (pending || idxPending) { // we will be called again when index is ready
+					const QStringList wait("<i>computing...</i>");
+					ts << formatList(wait, "Child") << formatList(wait, "Branch");
+					ts << formatList(wait, "Follows") << formatList(wait, "Precedes");
+				} else {
+					ts << formatList(children, "Child", false);
+					ts << formatList(getDescendantBranches(sha), "Branch", false);
+					ts << formatList(getNearTags(!optGoDown, sha), "Follows");
+					ts << formatList(getNearTags(optGoDown, sha), "Precedes");
+				}
 			}
 		}
 		QString longLog(c->longLog());
@@ -1204,7 +1411,7 @@ const QString Git::getDesc(SCRef sha, QRegularExpression& shortLogRE, QRegularEx
 	return text;
 }
 
-const RevFile* Git::insertNewFiles(SCRef sha, SCRef data) {
+RevFile* Git::newRevFile(SCRef data) {
 
 	/* we use an independent FileNamesLoader to avoid data
 	 * corruption if we are loading file names in background
@@ -1214,11 +1421,87 @@ const RevFile* Git::insertNewFiles(SCRef sha, SCRef data) {
 	RevFile* rf = new RevFile();
 	parseDiffFormat(*rf, data, fl);
 	flushFileNames(fl);
+	return rf;
+}
 
+const RevFile* Git::insertNewFiles(SCRef sha, SCRef data) {
+
+	RevFile* rf = newRevFile(data);
 	revsFiles.insert(toPersistentSha(sha, revsFilesShaBackupBuf), rf);
 	return rf;
 }
 
+const RevFile* Git::insertPairFiles(SCRef key, SCRef data) {
+// each entry costs one, so the just inserted list, and the one in
+// use, cannot be evicted by the few prefetched ones that follow
+
+	RevFile* rf = newRevFile(data);
+	pairFiles.insert(key, rf);
+	return rf;
+}
+
+const QString Git::filesKey(SCRef sha, SCRef diffToSha, SCRef path) {
+
+	return sha + " " + diffToSha + " " + path;
+}
+
+void Git::prefetchFiles(SCList shas, SCRef diffToSha) {
+// background 'git diff-tree' of the revisions around the selected
+// one, so that browsing in diff to sha mode does not block
+
+	if (diffToSha.isEmpty())
+		return;
+
+	QStringList keys;
+	FOREACH_SL (it, shas) {
+
+		const Rev* r = revLookup(*it);
+		bool ok = (r && r->parentsCount() > 0 && *it != ZERO_SHA);
+		keys.append(ok ? filesKey(*it, diffToSha, "") : "");
+	}
+	// cancel prefetches not needed anymore
+	QHash<QString, QPointer<MyProcess> >::iterator it = filesPrefetching.begin();
+	while (it != filesPrefetching.end()) {
+		if (keys.contains(it.key()))
+			++it;
+		else {
+			cancelProcess(it.value());
+			it = filesPrefetching.erase(it);
+		}
+	}
+	for (int i = 0; i < keys.count(); i++) {
+
+		if (keys[i].isEmpty() || pairFiles.contains(keys[i]) || filesPrefetching.value(keys[i]))
+			continue;
+
+		// rename detection could fail on big trees, in this
+		// case nothing is stored and getFiles() falls back
+		QString runCmd("git diff-tree -C --no-color -r -m ");
+		runCmd.append(diffToSha + " " + shas[i]);
+
+		FilesFetcher* f = new FilesFetcher(keys[i]);
+		connect(f, SIGNAL(filesReady(const QString&, const QByteArray&)),
+		        this, SLOT(on_pairFilesReady(const QString&, const QByteArray&)));
+
+		errorReportingEnabled = false; // it is only a guess, no noise
+		MyProcess* p = runAsync(runCmd, f);
+		errorReportingEnabled = true;
+		if (!p) {
+			delete f;
+			continue;
+		}
+		f->setParent(p); // deleted with the process, also when canceled
+		filesPrefetching.insert(keys[i], p);
+	}
+}
+
+void Git::on_pairFilesReady(const QString& key, const QByteArray& output) {
+
+	filesPrefetching.remove(key);
+	if (!pairFiles.contains(key)) // computed in the mean time?
+		insertPairFiles(key, QString(output));
+}
+
 bool Git::runDiffTreeWithRenameDetection(SCRef runCmd, QString* runOutput) {
 /* Under some cases git could warn out:
 
@@ -1268,6 +1551,12 @@ const RevFile* Git::getFiles(SCRef sha, SCRef diffToSha, bool allFiles, SCRef pa
 
 	if (!diffToSha.isEmpty() && (sha != ZERO_SHA)) {
 
+		// kept apart from revsFiles, these lists depend on the pair
+		const QString key(filesKey(sha, diffToSha, path));
+		const RevFile* rf = pairFiles.object(key); // moves it to the front
+		if (rf)
+			return rf;
+
 		QString runCmd("git diff-tree --no-color -r -m ");
 		runCmd.append(diffToSha + " " + sha);
 		if (!path.isEmpty())
@@ -1279,9 +1568,10 @@ const RevFile* Git::getFiles(SCRef sha, SCRef diffToSha, bool allFiles, SCRef pa
 		if (!runDiffTreeWithRenameDetection(runCmd, &runOutput))
 			return NULL;
 
-		// we insert a dummy revision file object. It will be
-		// overwritten at each request but we don't care.
-		return insertNewFiles(CUSTOM_SHA, runOutput);
+		if (pairFiles.contains(key)) // prefetched in the mean time?
+			return pairFiles.object(key);
+
+		return insertPairFiles(key, runOutput);
 	}
 	if (revsFiles.contains(r->sha()))
 		return revsFiles[r->sha()]; // ZERO_SHA search arrives here
@@ -1716,7 +2006,7 @@ bool Git::stgPop(SCRef sha) {
 
 
 //! cache for dates conversion. Common among qgit windows
-static QHash<QString, QString> localDates;
+static QHash<qint64, QString> localDates;
 /**
  * Accesses a cache that avoids slow date calculation
  *
@@ -1727,25 +2017,45 @@ static QHash<QString, QString> localDates;
  *   human-readable date
  **/
 const QString Git::getLocalDate(SCRef gitDate) {
-        QString localDate(localDates.value(gitDate));
+
+        return getLocalDate(gitDate.toLongLong());
+}
+
+const QString Git::getLocalDate(qint64 secs) {
+        QString localDate(localDates.value(secs));
 
         // cache miss
         if (localDate.isEmpty()) {
                 static QDateTime d;
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-                d.setTime_t(gitDate.toUInt());
+                d.setTime_t(uint(secs));
 #else
-                d.setSecsSinceEpoch(gitDate.toUInt());
+                d.setSecsSinceEpoch(secs);
 #endif
                 localDate = QLocale::system().toString(d, QLocale::ShortFormat);
 
                 // save to cache
-                localDates[gitDate] = localDate;
+                localDates[secs] = localDate;
         }
 
         return localDate;
 }
 
+int Git::authorId(const Rev* r) {
+// authors are interned by their raw bytes, so that the
+// common case of a known author does not decode anything
+
+        const QByteArray raw(r->authorRaw());
+        QHash<QByteArray, int>::const_iterator it(authorIds.constFind(raw));
+        if (it != authorIds.constEnd())
+                return it.value();
+
+        int id = authorNames.count();
+        authorNames.append(r->author());
+        authorIds.insert(QByteArray(raw.constData(), raw.size()), id); // deep copy
+        return id;
+}
+
 const QStringList Git::getArgs(bool* quit, bool repoChanged) {
 
         QString args;
@@ -1852,6 +2162,8 @@ Git::Reference* Git::lookupReference(const ShaString& sha) {
 
 bool Git::getRefs() {
 
+        refsGen++; // invalidates views caching ref names
+
         // check for a StGIT stack
         QDir d(gitDir);
         QString stgCurBranch;
@@ -2109,8 +2421,7 @@ void Git::getDiffIndex() {
         // then mockup the corresponding Rev
         SCRef log = (isNothingToCommit() ? "Nothing to commit" : "Working directory changes");
         const Rev* r = fakeWorkDirRev(head, log, status, revData->revOrder.count(), revData);
-        revData->revs.insert(ZERO_SHA_RAW, r);
-        revData->revOrder.append(ZERO_SHA_RAW);
+        revData->addRow(ZERO_SHA_RAW, r);
         revData->earlyOutputCntBase = revData->revOrder.count();
 
         // finally send it to GUI
@@ -2329,6 +2640,10 @@ void Git::stop(bool saveCache) {
 
 void Git::clearRevs() {
 
+        stopIndexTree();
+        if (treeIdx)
+                oldTreeIdx = treeIdx; // to reuse the unchanged part on refresh
+        treeIdx.clear();
         revData->clear();
         patchesStillToFind = 0; // TODO TEST WITH FILTERING
         firstNonStGitPatch = "";
@@ -2340,6 +2655,7 @@ void Git::clearFileNames() {
 
         qDeleteAll(revsFiles);
         revsFiles.clear();
+        pairFiles.clear(); // lists refer to file names by index
         fileNamesMap.clear();
         dirNamesMap.clear();
         dirNamesVec.clear();
@@ -2373,12 +2689,14 @@ bool Git::init(SCRef wd, bool askForRange, const QStringList* passedArgs, bool o
                 // check if repository is valid
                 bool repoChanged;
                 isGIT = getGitDBDir(wd, gitDir, repoChanged);
+                diffCache->setGitDir(gitDir);
 
                 if (repoChanged) {
                         bool dummy;
                         getBaseDir(wd, workDir, dummy);
                         localDates.clear();
                         fileCacheAccessed = false;
+                        diffCache->clear(); // patches of another repository
 
                         SHOW_MSG(msg1 + "file names cache...");
                         loadFileCache();
@@ -2516,13 +2834,18 @@ void Git::on_loaded(FileHistory* fh, ulong byteSize, int loadTime,
                                      "time elapsed: %i ms  (%.2f MB/s)",
                                      fh->revs.count(), kb, fh->loadTime, mbs);
 
+                        fh->buildGraph();
+
                         if (!tryFollowRenames(fh))
                                 emit loadCompleted(fh, tmp);
 
-                        if (isMainHistory(fh))
+                        if (isMainHistory(fh)) {
+                                startIndexTree(); // runs in background
+
                                 // wait the dust to settle down before to start
                                 // background file names loading for new revisions
                                 QTimer::singleShot(500, this, SLOT(loadFileNames()));
+                        }
                 }
         }
         if (loadingUnAppliedPatches) {
@@ -2637,8 +2960,6 @@ void Git::loadFileCache() {
 
 void Git::loadFileNames() {
 
-        indexTree(); // we are sure data loading is finished at this point
-
         int revCnt = 0;
         QString diffTreeBuf;
         FOREACH (ShaVect, it, revData->revOrder) {
@@ -2784,8 +3105,7 @@ int Git::addChunk(FileHistory* fh, const QByteArray& ba, int start) {
                 const ShaString& ss = toPersistentSha(mergeSha, shaBackupBuf);
                 r.insert(ss, rev);
         } else {
-                r.insert(sha, rev);
-                fh->revOrder.append(sha);
+                fh->addRow(sha, rev);
 
                 if (rev->parentsCount() == 0 && !isMainHistory(fh))
                         fh->renamedRevs.append(sha);
@@ -2836,8 +3156,7 @@ bool Git::copyDiffIndex(FileHistory* fh, SCRef parent) {
 
         // insert a custom ZERO_SHA rev with proper parent
         const Rev* rf = fakeWorkDirRev(parent, "Working directory changes", "long log\n", 0, fh);
-        fh->revs.insert(ZERO_SHA_RAW, rf);
-        fh->revOrder.append(ZERO_SHA_RAW);
+        fh->addRow(ZERO_SHA_RAW, rf);
         return true;
 }
 
@@ -2845,44 +3164,51 @@ void Git::setLane(SCRef sha, FileHistory* fh) {
 
         Lanes* l = fh->lns;
         uint i = fh->firstFreeLane;
-        QVector<QByteArray> ba;
-        const ShaString& ss = toPersistentSha(sha, ba);
+        const Rev* target = revLookup(sha, fh);
+        uint row = (target ? target->orderIdx : fh->revOrder.count());
         const ShaVect& shaVec(fh->revOrder);
 
         for (uint cnt = shaVec.count(); i < cnt; ++i) {
 
-                const ShaString& curSha = shaVec[i];
-                Rev* r = const_cast<Rev*>(revLookup(curSha, fh));
+                Rev* r = const_cast<Rev*>(revLookup(shaVec[i], fh));
                 if (r->lanes.count() == 0)
-                        updateLanes(*r, *l, curSha);
+                        updateLanes(*r, *l, fh, i);
 
-                if (curSha == ss)
+                if (i == row)
                         break;
         }
         fh->firstFreeLane = ++i;
 }
 
-void Git::updateLanes(Rev& c, Lanes& lns, SCRef sha) {
-// we could get third argument from c.sha(), but we are in fast path here
-// and c.sha() involves a deep copy, so we accept a little redundancy
+void Git::updateLanes(Rev& c, Lanes& lns, const FileHistory* fh, int row) {
+// lanes work on keys given by FileHistory::indexRow(), so
+// that no sha is copied or compared in this fast path
+
+        const int key = fh->rowKey[row];
+        const int* parKeys = fh->parKey.constData() + fh->parKeyOfs[row];
 
         if (lns.isEmpty())
-                lns.init(sha);
+                lns.init(key);
 
         bool isDiscontinuity;
-        bool isFork = lns.isFork(sha, isDiscontinuity);
+        bool isFork = lns.isFork(key, isDiscontinuity);
         bool isMerge = (c.parentsCount() > 1);
         bool isInitial = (c.parentsCount() == 0);
 
         if (isDiscontinuity)
-                lns.changeActiveLane(sha); // uses previous isBoundary state
+                lns.changeActiveLane(key); // uses previous isBoundary state
 
         lns.setBoundary(c.isBoundary()); // update must be here
 
         if (isFork)
-                lns.setFork(sha);
-        if (isMerge)
-                lns.setMerge(c.parents());
+                lns.setFork(key);
+        if (isMerge) {
+                QVector<int> parents(c.parentsCount());
+                for (int i = 0; i < parents.count(); i++)
+                        parents[i] = parKeys[i];
+
+                lns.setMerge(parents);
+        }
         if (c.isApplied)
                 lns.setApplied();
         if (isInitial)
@@ -2890,9 +3216,7 @@ void Git::updateLanes(Rev& c, Lanes& lns, SCRef sha) {
 
         lns.getLanes(c.lanes); // here lanes are snapshotted
 
-        SCRef nextSha = (isInitial) ? "" : QString(c.parent(0));
-
-        lns.nextParent(nextSha);
+        lns.nextParent(isInitial ? int(Lanes::NO_KEY) : parKeys[0]);
 
         if (c.isApplied)
                 lns.afterApplied();
@@ -3009,195 +3333,69 @@ void Git::appendFileName(RevFile& rf, SCRef name, FileNamesLoader& fl) {
                 fl.rfNames.append(*it);
 }
 
-void Git::updateDescMap(const Rev* r,uint idx, QHash<QPair<uint, uint>, bool>& dm,
-                        QHash<uint, QVector<int> >& dv) {
-
-        QVector<int> descVec;
-        if (r->descRefsMaster != -1) {
-
-                const Rev* tmp = revLookup(revData->revOrder[r->descRefsMaster]);
-                const QVector<int>& nr = tmp->descRefs;
-
-                for (int i = 0; i < nr.count(); i++) {
-
-                        if (!dv.contains(nr[i])) {
-                                dbp("ASSERT descendant for %1 not found", r->sha());
-                                return;
-                        }
-                        const QVector<int>& dvv = dv[nr[i]];
-
-                        // copy the whole vector instead of each element
-                        // in the first iteration of the loop below
-                        descVec = dvv; // quick (shared) copy
-
-                        for (int y = 0; y < dvv.count(); y++) {
-
-                                uint v = (uint)dvv[y];
-                                QPair<uint, uint> key = qMakePair(idx, v);
-                                QPair<uint, uint> keyN = qMakePair(v, idx);
-                                dm.insert(key, true);
-                                dm.insert(keyN, false);
-
-                                // we don't want duplicated entry, otherwise 'dvv' grows
-                                // greatly in repos with many tagged development branches
-                                if (i > 0 && !descVec.contains(v)) // i > 0 is rare, no
-                                        descVec.append(v);         // need to optimize
-                        }
-                }
-        }
-        descVec.append(idx);
-        dv.insert(idx, descVec);
-}
-
-void Git::mergeBranches(Rev* p, const Rev* r) {
-
-        int r_descBrnMaster = (checkRef(r->sha(), BRANCH | RMT_BRANCH) ? r->orderIdx : r->descBrnMaster);
-
-        if (p->descBrnMaster == r_descBrnMaster || r_descBrnMaster == -1)
-                return;
-
-        // we want all the descendant branches, so just avoid duplicates
-        const QVector<int>& src1 = revLookup(revData->revOrder[p->descBrnMaster])->descBranches;
-        const QVector<int>& src2 = revLookup(revData->revOrder[r_descBrnMaster])->descBranches;
-        QVector<int> dst(src1);
-        for (int i = 0; i < src2.count(); i++)
-                if (std::find(src1.constBegin(), src1.constEnd(), src2[i]) == src1.constEnd())
-                        dst.append(src2[i]);
+void Git::startIndexTree() {
+// called when data loading is finished, index is computed by TreeIndexer
+// on a snapshot of revOrder and published by on_indexTreeDone()
 
-        p->descBranches = dst;
-        p->descBrnMaster = p->orderIdx;
-}
+        stopIndexTree();
 
-void Git::mergeNearTags(bool down, Rev* p, const Rev* r, const QHash<QPair<uint, uint>, bool>& dm) {
-
-        bool isTag = checkRef(r->sha(), TAG);
-        int r_descRefsMaster = isTag ? r->orderIdx : r->descRefsMaster;
-        int r_ancRefsMaster = isTag ? r->orderIdx : r->ancRefsMaster;
-
-        if (down && (p->descRefsMaster == r_descRefsMaster || r_descRefsMaster == -1))
-                return;
-
-        if (!down && (p->ancRefsMaster == r_ancRefsMaster || r_ancRefsMaster == -1))
-                return;
-
-        // we want the nearest tag only, so remove any tag
-        // that is ancestor of any other tag in p U r
         const ShaVect& ro = revData->revOrder;
-        const ShaString& sha1 = down ? ro[p->descRefsMaster] : ro[p->ancRefsMaster];
-        const ShaString& sha2 = down ? ro[r_descRefsMaster] : ro[r_ancRefsMaster];
-        const QVector<int>& src1 = down ? revLookup(sha1)->descRefs : revLookup(sha1)->ancRefs;
-        const QVector<int>& src2 = down ? revLookup(sha2)->descRefs : revLookup(sha2)->ancRefs;
-        QVector<int> dst(src1);
-
-        for (int s2 = 0; s2 < src2.count(); s2++) {
+        if (ro.count() == 0 || !revData->isGraphReady())
+                return;
 
-                bool add = false;
-                for (int s1 = 0; s1 < src1.count(); s1++) {
+        TreeIndex* ti = new TreeIndex;
+        ti->parOfs = revData->parOfs; // implicitly shared
+        ti->parIdx = revData->parIdx;
+        ti->childOfs = revData->childOfs;
+        ti->childIdx = revData->childIdx;
+        ti->keys.resize(ro.count());
+        ti->refs.resize(ro.count());
+        for (int i = 0; i < ro.count(); i++) {
 
-                        if (src2[s2] == src1[s1]) {
-                                add = false;
-                                break;
-                        }
-                        QPair<uint, uint> key = qMakePair((uint)src2[s2], (uint)src1[s1]);
+                uint type = checkRef(ro[i]);
+                ti->refs[i] = (type & TAG ? TreeIndex::IS_TAG : 0)
+                            | (type & (BRANCH | RMT_BRANCH) ? TreeIndex::IS_BRANCH : 0);
 
-                        if (!dm.contains(key)) { // could be empty if all tags are independent
-                                add = true; // could be an independent path
-                                continue;
-                        }
-                        add = (down && dm[key]) || (!down && !dm[key]);
-                        if (add)
-                                dst[s1] = -1; // mark for removing
-                        else
-                                break;
-                }
-                if (add)
-                        dst.append(src2[s2]);
+                ti->keys[i] = QByteArray::fromRawData(ro[i].latin1(), 16).toULongLong(NULL, 16);
         }
-        QVector<int>& nearRefs = (down ? p->descRefs : p->ancRefs);
-        int& nearRefsMaster = (down ? p->descRefsMaster : p->ancRefsMaster);
-
-        nearRefs.clear();
-        for (int s2 = 0; s2 < dst.count(); s2++)
-                if (dst[s2] != -1)
-                        nearRefs.append(dst[s2]);
 
-        nearRefsMaster = p->orderIdx;
+        treeIndexer = new TreeIndexer(this, ti, oldTreeIdx);
+        oldTreeIdx.clear();
+        connect(treeIndexer, SIGNAL(finished()), this, SLOT(on_indexTreeDone()));
+        treeIndexer->start(QThread::LowPriority);
 }
 
-void Git::indexTree() {
-
-        const ShaVect& ro = revData->revOrder;
-        if (ro.count() == 0)
-                return;
+void Git::stopIndexTree() {
 
-        // we keep the pairs(x, y). Value is true if x is
-        // ancestor of y or false if y is ancestor of x
-        QHash<QPair<uint, uint>, bool> descMap;
-        QHash<uint, QVector<int> > descVect;
-
-        // walk down the tree from latest to oldest,
-        // compute children and nearest descendants
-        for (uint i = 0, cnt = ro.count(); i < cnt; i++) {
+        delete treeIndexer; // cancel and wait
+        treeIndexer = NULL;
+}
 
-                uint type = checkRef(ro[i]);
-                bool isB = (type & (BRANCH | RMT_BRANCH));
-                bool isT = (type & TAG);
+void Git::installTreeIndex() {
 
-                const Rev* r = revLookup(ro[i]);
+        treeIndexer->wait(); // could still be returning from run()
+        TreeIndex* ti = treeIndexer->takeIndex();
+        treeIndexer->deleteLater();
+        treeIndexer = NULL;
+        treeIdx = QSharedPointer<const TreeIndex>(ti);
+        emit indexTreeReady();
+}
 
-                if (isB) {
-                        Rev* rr = const_cast<Rev*>(r);
-                        if (r->descBrnMaster != -1) {
-                                const ShaString& sha = ro[r->descBrnMaster];
-                                rr->descBranches = revLookup(sha)->descBranches;
-                        }
-                        rr->descBranches.append(i);
-                }
-                if (isT) {
-                        updateDescMap(r, i, descMap, descVect);
-                        Rev* rr = const_cast<Rev*>(r);
-                        rr->descRefs.clear();
-                        rr->descRefs.append(i);
-                }
-                for (uint y = 0; y < r->parentsCount(); y++) {
+void Git::on_indexTreeDone() {
 
-                        Rev* p = const_cast<Rev*>(revLookup(r->parent(y)));
-                        if (p) {
-                                p->children.append(i);
+        if (treeIndexer && sender() == treeIndexer) // could be stale
+                installTreeIndex();
+}
 
-                                if (p->descBrnMaster == -1)
-                                        p->descBrnMaster = isB ? r->orderIdx : r->descBrnMaster;
-                                else
-                                        mergeBranches(p, r);
+const TreeIndex* Git::getTreeIndex(bool* pending) {
+// if 'pending' is given caller will wait for indexTreeReady()
+// signal, otherwise we block until indexer has finished
 
-                                if (p->descRefsMaster == -1)
-                                        p->descRefsMaster = isT ? r->orderIdx : r->descRefsMaster;
-                                else
-                                        mergeNearTags(optGoDown, p, r, descMap);
-                        }
-                }
-        }
-        // walk backward through the tree and compute nearest tagged ancestors
-        for (int i = ro.count() - 1; i >= 0; i--) {
+        if (treeIndexer && !pending)
+                installTreeIndex();
 
-                const Rev* r = revLookup(ro[i]);
-                bool isTag = checkRef(ro[i], TAG);
+        if (pending)
+                *pending = (treeIndexer != NULL);
 
-                if (isTag) {
-                        Rev* rr = const_cast<Rev*>(r);
-                        rr->ancRefs.clear();
-                        rr->ancRefs.append(i);
-                }
-                for (int y = 0; y < r->children.count(); y++) {
-
-                        Rev* c = const_cast<Rev*>(revLookup(ro[r->children[y]]));
-                        if (c) {
-                                if (c->ancRefsMaster == -1)
-                                        c->ancRefsMaster = isTag ? r->orderIdx:r->ancRefsMaster;
-                                else
-                                        mergeNearTags(!optGoDown, c, r, descMap);
-                        }
-                }
-        }
+        return treeIdx.data();
 }
-
@@ -7,6 +7,9 @@
 #ifndef GIT_H
 #define GIT_H
 
+#include <QCache>
+#include <QPointer>
+#include <QSharedPointer>
 #include "exceptionmanager.h"
 #include "common.h"
 
@@ -19,10 +22,13 @@ class QRegularExpression;
 class QTextCodec;
 class Annotate;
 //class DataLoader;
+class DiffCache;
 class Domain;
 class FileHistory;
 class Lanes;
 class MyProcess;
+class TreeIndex;
+class TreeIndexer;
 
 
 class Git : public QObject {
@@ -89,11 +95,17 @@ public:
 	bool isTextHighlighter() const { return isTextHighlighterFound; }
 	const QString textHighlighterVersion() const { return textHighlighterVersionFound; }
 	bool isMainHistory(const FileHistory* fh) { return (fh == revData); }
-	bool isContiguous(const QStringList &revs);
+	bool isContiguous(SCList revs);
+	bool isAncestor(SCRef anc, SCRef desc, const FileHistory* fh = NULL);
+	const QVector<bool> areAncestors(SCList ancs, SCRef desc, const FileHistory* fh = NULL);
+	bool isLinearAncestor(SCRef anc, SCRef desc, const FileHistory* fh = NULL, int* dist = NULL);
 	MyProcess* getDiff(SCRef sha, QObject* receiver, SCRef diffToSha, bool combined);
+	void prefetchDiffs(SCList shas, SCRef diffToSha, bool allMergeFiles);
+	void prefetchFiles(SCList shas, SCRef diffToSha);
 	const QString getWorkDirDiff(SCRef fileName = "");
 	MyProcess* getFile(SCRef fileSha, QObject* receiver, QByteArray* result, SCRef fileName);
 	MyProcess* getHighlightedFile(SCRef fileSha, QObject* receiver, QString* result, SCRef fileName);
+	MyProcess* getBlame(SCRef sha, SCRef fileName, QObject* receiver);
 	const QString getFileSha(SCRef file, SCRef revSha);
 	bool saveFile(SCRef fileSha, SCRef fileName, SCRef path);
 	void getFileFilter(SCRef path, ShaSet& shaSet) const;
@@ -101,7 +113,12 @@ public:
 	const RevFile* getFiles(SCRef sha, SCRef sha2 = "", bool all = false, SCRef path = "");
 	bool getTree(SCRef ts, TreeInfo& ti, bool wd, SCRef treePath);
 	static const QString getLocalDate(SCRef gitDate);
+	static const QString getLocalDate(qint64 secs);
+	int authorId(const Rev* r);
+	const QString& authorName(int id) const { return authorNames.at(id); }
 	const QString getCurrentBranchName() const {return curBranchName;}
+	const QString getGitDir() const { return gitDir; }
+	int refsGeneration() const { return refsGen; } // changes at each getRefs()
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 	const QString getDesc(SCRef sha, QRegExp& slogRE, QRegExp& lLogRE, bool showH, FileHistory* fh);
 #else
@@ -110,9 +127,9 @@ public:
 	const QString getLastCommitMsg();
 	const QString getNewCommitMsg();
 	const QString getLaneParent(SCRef fromSHA, int laneNum);
-        const QStringList getChildren(SCRef parent);
-	const QStringList getNearTags(bool goDown, SCRef sha);
-	const QStringList getDescendantBranches(SCRef sha, bool shaOnly = false);
+	const QStringList getChildren(SCRef parent, bool* pending = NULL);
+	const QStringList getNearTags(bool goDown, SCRef sha, bool* pending = NULL);
+	const QStringList getDescendantBranches(SCRef sha, bool shaOnly = false, bool* pending = NULL);
 	const QString getShortLog(SCRef sha);
 	const QString getTagMsg(SCRef sha);
 	const Rev* revLookup(const ShaString& sha, const FileHistory* fh = NULL) const;
@@ -159,6 +176,7 @@ signals:
 	void annotateReady(Annotate*, bool, const QString&);
 	void fileNamesLoad(int, int);
 	void changeFont(const QFont&);
+	void indexTreeReady();
 
 public slots:
 	void procReadyRead(const QByteArray&);
@@ -171,6 +189,8 @@ private slots:
 	void on_getHighlightedFile_eof();
 	void on_newDataReady(const FileHistory*);
 	void on_loaded(FileHistory*, ulong,int,bool,const QString&,const QString&);
+	void on_indexTreeDone();
+	void on_pairFilesReady(const QString& key, const QByteArray& output);
 
 private:
 	friend class MainImpl;
@@ -220,6 +240,9 @@ private:
 	bool run(QByteArray* runOutput, SCRef cmd, QObject* rcv = NULL, SCRef buf = "");
 	MyProcess* runAsync(SCRef cmd, QObject* rcv, SCRef buf = "");
 	MyProcess* runAsScript(SCRef cmd, QObject* rcv = NULL, SCRef buf = "");
+	MyProcess* runDiff(SCRef sha, SCRef diffToSha, bool combined, QObject* rcv);
+	static const QString diffKey(SCRef sha, SCRef diffToSha, bool combined);
+	static const QString filesKey(SCRef sha, SCRef diffToSha, SCRef path);
 	const QStringList getArgs(bool* quit, bool repoChanged);
 	bool getRefs();
 	void parseStGitPatches(SCList patchNames, SCList patchShas);
@@ -240,17 +263,18 @@ private:
 	const Rev* fakeWorkDirRev(SCRef parent, SCRef log, SCRef longLog, int idx, FileHistory* fh);
 	const RevFile* fakeWorkDirRevFile(const WorkingDirInfo& wd);
 	bool copyDiffIndex(FileHistory* fh, SCRef parent);
+	RevFile* newRevFile(SCRef data);
 	const RevFile* insertNewFiles(SCRef sha, SCRef data);
+	const RevFile* insertPairFiles(SCRef key, SCRef data);
 	const RevFile* getAllMergeFiles(const Rev* r);
 	bool runDiffTreeWithRenameDetection(SCRef runCmd, QString* runOutput);
 	bool isParentOf(SCRef par, SCRef child);
 	bool isTreeModified(SCRef sha);
-	void indexTree();
-	void updateDescMap(const Rev* r, uint i, QHash<QPair<uint, uint>,bool>& dm,
-	                   QHash<uint, QVector<int> >& dv);
-	void mergeNearTags(bool down, Rev* p, const Rev* r, const QHash<QPair<uint, uint>, bool>&dm);
-	void mergeBranches(Rev* p, const Rev* r);
-	void updateLanes(Rev& c, Lanes& lns, SCRef sha);
+	void startIndexTree();
+	void stopIndexTree();
+	void installTreeIndex();
+	const TreeIndex* getTreeIndex(bool* pending);
+	void updateLanes(Rev& c, Lanes& lns, const FileHistory* fh, int row);
 	bool mkPatchFromWorkDir(SCRef msg, SCRef patchFile, SCList files);
 	const QStringList getOthersFiles();
 	const QStringList getOtherFiles(SCList selFiles, bool onlyInIndex);
@@ -294,10 +318,20 @@ private:
 	bool fileCacheAccessed;
 	int patchesStillToFind;
 	int shortHashLen;
+	int refsGen;
+	QHash<QByteArray, int> authorIds; // interned authors, never cleared so
+	QVector<QString> authorNames;     // that ids stay valid across reloads
 	QString firstNonStGitPatch;
 	RevFileMap revsFiles;
 	QVector<QByteArray> revsFilesShaBackupBuf;
 	RefMap refsShaMap;
+	TreeIndexer* treeIndexer;
+	DiffCache* diffCache;
+	QHash<QString, QPointer<MyProcess> > prefetching; // diff key -> running prefetch
+	QCache<QString, RevFile> pairFiles; // diff to sha file lists, see filesKey()
+	QHash<QString, QPointer<MyProcess> > filesPrefetching; // files key -> running prefetch
+	QSharedPointer<const TreeIndex> treeIdx;
+	QSharedPointer<const TreeIndex> oldTreeIdx; // kept across a refresh
 	QVector<QByteArray> shaBackupBuf;
 	StrVect fileNamesVec;
 	StrVect dirNamesVec;
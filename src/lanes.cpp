@@ -6,7 +6,6 @@
 	Copyright: See COPYING file that comes with this distribution
 
 */
-#include <QStringList>
 #include "common.h"
 #include "lanes.h"
 
@@ -14,18 +13,18 @@
 
 using namespace QGit;
 
-void Lanes::init(const QString& expectedSha) {
+void Lanes::init(int expectedKey) {
 
 	clear();
 	activeLane = 0;
 	setBoundary(false);
-	add(BRANCH, expectedSha, activeLane);
+	add(BRANCH, expectedKey, activeLane);
 }
 
 void Lanes::clear() {
 
 	typeVec.clear();
-	nextShaVec.clear();
+	nextKeyVec.clear();
 }
 
 void Lanes::setBoundary(bool b) {
@@ -40,19 +39,19 @@ void Lanes::setBoundary(bool b) {
 		typeVec[activeLane] = BOUNDARY;
 }
 
-bool Lanes::isFork(const QString& sha, bool& isDiscontinuity) {
+bool Lanes::isFork(int key, bool& isDiscontinuity) {
 
-	int pos = findNextSha(sha, 0);
+	int pos = findNextKey(key, 0);
 	isDiscontinuity = (activeLane != pos);
 	if (pos == -1) // new branch case
 		return false;
 
-	return (findNextSha(sha, pos + 1) != -1);
+	return (findNextKey(key, pos + 1) != -1);
 /*
 	int cnt = 0;
 	while (pos != -1) {
 		cnt++;
-		pos = findNextSha(sha, pos + 1);
+		pos = findNextKey(key, pos + 1);
 //		if (isDiscontinuity)
 //			isDiscontinuity = (activeLane != pos);
 	}
@@ -60,15 +59,15 @@ bool Lanes::isFork(const QString& sha, bool& isDiscontinuity) {
 */
 }
 
-void Lanes::setFork(const QString& sha) {
+void Lanes::setFork(int key) {
 
 	int rangeStart, rangeEnd, idx;
-	rangeStart = rangeEnd = idx = findNextSha(sha, 0);
+	rangeStart = rangeEnd = idx = findNextKey(key, 0);
 
 	while (idx != -1) {
 		rangeEnd = idx;
 		typeVec[idx] = TAIL;
-		idx = findNextSha(sha, idx + 1);
+		idx = findNextKey(key, idx + 1);
 	}
 	typeVec[activeLane] = NODE;
 
@@ -99,7 +98,7 @@ void Lanes::setFork(const QString& sha) {
 	}
 }
 
-void Lanes::setMerge(const QStringList& parents) {
+void Lanes::setMerge(const QVector<int>& parents) {
 // setFork() must be called before setMerge()
 
 	if (boundary)
@@ -114,10 +113,9 @@ void Lanes::setMerge(const QStringList& parents) {
 	t = NODE;
 
 	int rangeStart = activeLane, rangeEnd = activeLane;
-	QStringList::const_iterator it(parents.constBegin());
-	for (++it; it != parents.constEnd(); ++it) { // skip first parent
+	for (int i = 1; i < parents.count(); i++) { // skip first parent
 
-		int idx = findNextSha(*it, 0);
+		int idx = findNextKey(parents[i], 0);
 		if (idx != -1) {
 
 			if (idx > rangeEnd) {
@@ -134,7 +132,7 @@ void Lanes::setMerge(const QStringList& parents) {
 
 			typeVec[idx] = JOIN;
 		} else
-			rangeEnd = add(HEAD, *it, rangeEnd + 1);
+			rangeEnd = add(HEAD, parents[i], rangeEnd + 1);
 	}
 	int& startT = typeVec[rangeStart];
 	int& endT = typeVec[rangeEnd];
@@ -185,7 +183,7 @@ void Lanes::setApplied() {
 	typeVec[activeLane] = APPLIED; // TODO test with boundaries
 }
 
-void Lanes::changeActiveLane(const QString& sha) {
+void Lanes::changeActiveLane(int key) {
 
 	int& t = typeVec[activeLane];
 	if (t == INITIAL || isBoundary(t))
@@ -193,11 +191,11 @@ void Lanes::changeActiveLane(const QString& sha) {
 	else
 		t = NOT_ACTIVE;
 
-	int idx = findNextSha(sha, 0); // find first sha
+	int idx = findNextKey(key, 0); // find first key
 	if (idx != -1)
 		typeVec[idx] = ACTIVE; // called before setBoundary()
 	else
-		idx = add(BRANCH, sha, activeLane); // new branch
+		idx = add(BRANCH, key, activeLane); // new branch
 
 	activeLane = idx;
 }
@@ -239,7 +237,7 @@ void Lanes::afterFork() {
 	}
 	while (typeVec.last() == EMPTY) {
 		typeVec.pop_back();
-		nextShaVec.pop_back();
+		nextKeyVec.pop_back();
 	}
 }
 
@@ -258,15 +256,15 @@ void Lanes::afterApplied() {
 	typeVec[activeLane] = ACTIVE; // TODO test with boundaries
 }
 
-void Lanes::nextParent(const QString& sha) {
+void Lanes::nextParent(int key) {
 
-	nextShaVec[activeLane] = (boundary ? "" : sha);
+	nextKeyVec[activeLane] = (boundary ? NO_KEY : key);
 }
 
-int Lanes::findNextSha(const QString& next, int pos) {
+int Lanes::findNextKey(int next, int pos) {
 
-	for (int i = pos; i < nextShaVec.count(); i++)
-		if (nextShaVec[i] == next)
+	for (int i = pos; i < nextKeyVec.count(); i++)
+		if (nextKeyVec[i] == next)
 			return i;
 	return -1;
 }
@@ -279,19 +277,19 @@ int Lanes::findType(int type, int pos) {
 	return -1;
 }
 
-int Lanes::add(int type, const QString& next, int pos) {
+int Lanes::add(int type, int next, int pos) {
 
 	// first check empty lanes starting from pos
 	if (pos < (int)typeVec.count()) {
 		pos = findType(EMPTY, pos);
 		if (pos != -1) {
 			typeVec[pos] = type;
-			nextShaVec[pos] = next;
+			nextKeyVec[pos] = next;
 			return pos;
 		}
 	}
 	// if all lanes are occupied add a new lane
 	typeVec.append(type);
-	nextShaVec.append(next);
+	nextKeyVec.append(next);
 	return typeVec.count() - 1;
 }
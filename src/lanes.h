@@ -7,13 +7,13 @@
 #ifndef LANES_H
 #define LANES_H
 
-#include <QString>
 #include <QVector>
 
 
 //
 //  At any given time, the Lanes class represents a single revision (row) of the history graph.
-//  The Lanes class contains a vector of the sha1 hashes of the next commit to appear in each lane (column).
+//  The Lanes class contains a vector of the keys of the next commit to appear in each lane (column).
+//  Keys are integers given by FileHistory, so that no sha1 hash is compared here, NO_KEY means none.
 //  The Lanes class also contains a vector used to decide which glyph to draw on the history graph.
 //
 //  For each revision (row) (from recent (top) to ancient past (bottom)), the Lanes class is updated, and the
@@ -25,33 +25,35 @@
 
 class Lanes {
 public:
+	enum { NO_KEY = -1 };
+
 	Lanes() {} // init() will setup us later, when data is available
 	bool isEmpty() { return typeVec.empty(); }
-	void init(const QString& expectedSha);
+	void init(int expectedKey);
 	void clear();
-	bool isFork(const QString& sha, bool& isDiscontinuity);
+	bool isFork(int key, bool& isDiscontinuity);
 	void setBoundary(bool isBoundary);
-	void setFork(const QString& sha);
-	void setMerge(const QStringList& parents);
+	void setFork(int key);
+	void setMerge(const QVector<int>& parents);
 	void setInitial();
 	void setApplied();
-	void changeActiveLane(const QString& sha);
+	void changeActiveLane(int key);
 	void afterMerge();
 	void afterFork();
 	bool isBranch();
 	void afterBranch();
 	void afterApplied();
-	void nextParent(const QString& sha);
+	void nextParent(int key);
 	void getLanes(QVector<int> &ln) { ln = typeVec; } // O(1) vector is implicitly shared
 
 private:
-	int findNextSha(const QString& next, int pos);
+	int findNextKey(int next, int pos);
 	int findType(int type, int pos);
-	int add(int type, const QString& next, int pos);
+	int add(int type, int next, int pos);
 
 	int activeLane;
 	QVector<int> typeVec;  // Describes which glyphs should be drawn.
-	QVector<QString> nextShaVec;  // The sha1 hashes of the next commit to appear in each lane (column).
+	QVector<int> nextKeyVec;  // The keys of the next commit to appear in each lane (column).
 	bool boundary;
 	int NODE, NODE_L, NODE_R;
 };
@@ -61,6 +61,10 @@ void ListView::setup(Domain* dm, Git* g) {
 
 	connect(this, SIGNAL(customContextMenuRequested(const QPoint&)),
 	        this, SLOT(on_customContextMenuRequested(const QPoint&)));
+
+	// header 'Id' is padded by the model according to number of rows
+	connect(fh, SIGNAL(headerDataChanged(Qt::Orientation, int, int)),
+	        this, SLOT(resizeIdColumn()));
 }
 
 ListView::~ListView() {
@@ -91,18 +95,43 @@ int ListView::row(SCRef sha) const {
 	return lp->mapFromSource(idx).row();
 }
 
+const QStringList ListView::neighbourShas(SCRef sha, int cnt) const {
+// shas of shown rows around the row of 'sha', nearest first
+
+	QStringList shas;
+	int r = row(sha);
+	if (r == -1)
+		return shas;
+
+	for (int i = 1; i <= cnt; i++) {
+
+		SCRef below = this->sha(r + i);
+		if (!below.isEmpty())
+			shas.append(below);
+
+		SCRef above = this->sha(r - i);
+		if (!above.isEmpty())
+			shas.append(above);
+	}
+	return shas;
+}
+
 void ListView::setupGeometry() {
 
+	// all rows have the same height and no children, so
+	// that view layout does not depend on model size
+	setUniformRowHeights(true);
+	setRootIsDecorated(false);
+	setItemsExpandable(false);
+
 	QHeaderView* hv = header();
 	hv->setStretchLastSection(true);
 #if QT_VERSION >= 0x050000
 	hv->setSectionResizeMode(LOG_COL, QHeaderView::Interactive);
 	hv->setSectionResizeMode(TIME_COL, QHeaderView::Interactive);
-	hv->setSectionResizeMode(ANN_ID_COL, QHeaderView::ResizeToContents);
 #else
 	hv->setResizeMode(LOG_COL, QHeaderView::Interactive);
 	hv->setResizeMode(TIME_COL, QHeaderView::Interactive);
-	hv->setResizeMode(ANN_ID_COL, QHeaderView::ResizeToContents);
 #endif
 	hv->resizeSection(GRAPH_COL, DEF_GRAPH_COL_WIDTH);
 	hv->resizeSection(LOG_COL, DEF_LOG_COL_WIDTH);
@@ -117,6 +146,24 @@ void ListView::setupGeometry() {
 	QSettings settings;
 	QVariant v = settings.value(settingsKey);
 	if (v.isValid()) hv->restoreState(v.toByteArray());
+
+	// 'Id' column is not resized to contents, that would measure all
+	// the rows at each insertion, width is set by resizeIdColumn().
+	// Set after restoreState() that could bring back an old mode
+#if QT_VERSION >= 0x050000
+	hv->setSectionResizeMode(ANN_ID_COL, QHeaderView::Fixed);
+#else
+	hv->setResizeMode(ANN_ID_COL, QHeaderView::Fixed);
+#endif
+	resizeIdColumn();
+}
+
+void ListView::resizeIdColumn() {
+// header text is as wide as the biggest row number, see
+// FileHistory::on_changeFont(), so no need to look at data
+
+	if (!isColumnHidden(ANN_ID_COL))
+		header()->resizeSection(ANN_ID_COL, header()->sectionSizeHint(ANN_ID_COL));
 }
 
 void ListView::scrollToNextHighlighted(int direction) {
@@ -183,6 +230,7 @@ void ListView::on_changeFont(const QFont& f) {
 	setFont(f);
 	ListViewDelegate* lvd = static_cast<ListViewDelegate*>(itemDelegate());
 	lvd->setLaneHeight(fontMetrics().height());
+	lvd->clearGlyphCache();
 	scrollToCurrent();
 }
 
@@ -572,8 +620,10 @@ void ListView::dragMoveEvent(QDragMoveEvent* e) {
 			default_action = DropInfo::RebaseAction;
 		}
 
-		// merging is allowed onto any local branch
-		if (targetRefType == Git::BRANCH) {
+		// merging is allowed onto any local branch that
+		// does not already contain all the source shas
+		if (targetRefType == Git::BRANCH &&
+		    git->areAncestors(dropInfo->shas, targetSHA).contains(false)) {
 			accepted_actions |= DropInfo::MergeAction;
 			default_action = DropInfo::MergeAction;
 		}
@@ -802,6 +852,7 @@ ListViewDelegate::ListViewDelegate(Git* g, ListViewProxy* px, QObject* p) : QIte
 	lp = px;
 	laneHeight = 0;
 	diffTargetRow = -1;
+	tagMarks.setMaxCost(500);
 }
 
 QSize ListViewDelegate::sizeHint(const QStyleOptionViewItem&, const QModelIndex&) const {
@@ -1025,11 +1076,36 @@ void ListViewDelegate::paintGraphLane(QPainter* p, int type, int x1, int x2,
 	#undef R_CENTER
 }
 
+const QPixmap& ListViewDelegate::laneGlyph(quint64 key, int type, const QColor& col,
+                                           const QColor& activeCol, const QBrush& back) const {
+// painting a lane with antialiased paths and gradients is slow, so each
+// combination is rendered once and then just blitted. Lines are drawn
+// a bit beyond the lane width, see padding in paintGraphLane()
+
+	QHash<quint64, QPixmap>::const_iterator it(glyphCache.constFind(key));
+	if (it != glyphCache.constEnd())
+		return it.value();
+
+	int w = laneWidth() + 4;
+	QPixmap pm(static_cast<int>(w * dpr()), static_cast<int>(laneHeight * dpr()));
+#if QT_VERSION >= QT_VERSION_CHECK(5,6,0)
+	pm.setDevicePixelRatio(dpr());
+#endif
+	pm.fill(Qt::transparent);
+
+	QPainter gp(&pm);
+	gp.setRenderHints(QPainter::Antialiasing);
+	paintGraphLane(&gp, type, 0, laneWidth(), col, activeCol, back);
+	gp.end();
+
+	return *glyphCache.insert(key, pm);
+}
+
 void ListViewDelegate::paintGraph(QPainter* p, const QStyleOptionViewItem& opt,
                                   const QModelIndex& i) const {
 	// static const QColor & baseColor = QPalette().color(QPalette::WindowText);
-	static const QColor colors[COLORS_NUM] = {
-		QPalette().color(QPalette::WindowText),
+	const QColor colors[COLORS_NUM] = {
+		opt.palette.color(QPalette::WindowText),
 		Qt::red, DARK_GREEN,
 		Qt::blue, Qt::darkGray, BROWN,
 		Qt::magenta, ORANGE
@@ -1055,6 +1131,16 @@ void ListViewDelegate::paintGraph(QPainter* p, const QStyleOptionViewItem& opt,
 		git->setLane(r->sha(), fh);
 
 	QBrush back = opt.palette.base();
+
+	// glyphs depend on DPR and on palette colors, cached ones are dropped
+	// as soon as any of them changes, as example with a new theme
+	QString stamp(QString::number(dpr()) + ' ' + back.color().name() + ' '
+	              + opt.palette.highlightedText().color().name() + ' ' + colors[0].name());
+	if (stamp != glyphStamp) {
+		glyphCache.clear();
+		glyphStamp = stamp;
+	}
+
 	const QVector<int>& lanes(r->lanes);
 	uint laneNum = lanes.count();
 	uint activeLane = 0;
@@ -1067,9 +1153,15 @@ void ListViewDelegate::paintGraph(QPainter* p, const QStyleOptionViewItem& opt,
 	int x1 = 0, x2 = 0;
 	int maxWidth = opt.rect.width();
 	int lw = laneWidth();
+	bool isSel = (opt.state & QStyle::State_Selected);
 	QColor activeColor = colors[activeLane % COLORS_NUM];
-	if (opt.state & QStyle::State_Selected)
+	if (isSel)
 		activeColor = blend(activeColor, opt.palette.highlightedText().color(), 208);
+
+	// glyph key: lane height, selection, active color, lane color and type
+	quint64 rowKey = (quint64(laneHeight & 0xFFFF) << 24) | (isSel ? 1 << 17 : 0)
+	               | ((activeLane % COLORS_NUM) << 8);
+
 	for (uint i = 0; i < laneNum && x2 < maxWidth; i++) {
 
 		x1 = x2;
@@ -1079,8 +1171,10 @@ void ListViewDelegate::paintGraph(QPainter* p, const QStyleOptionViewItem& opt,
 		if (ln == EMPTY)
 			continue;
 
-		QColor color = i == activeLane ? activeColor : colors[i % COLORS_NUM];
-		paintGraphLane(p, ln, x1, x2, color, activeColor, back);
+		bool isAct = (i == activeLane);
+		QColor color = isAct ? activeColor : colors[i % COLORS_NUM];
+		quint64 key = rowKey | (isAct ? 1 << 16 : 0) | ((i % COLORS_NUM) << 12) | (ln & 0xFF);
+		p->drawPixmap(x1, 0, laneGlyph(key, ln, color, activeColor, back));
 	}
 	p->restore();
 }
@@ -1100,17 +1194,16 @@ void ListViewDelegate::paintLog(QPainter* p, const QStyleOptionViewItem& opt,
 		p->fillRect(opt.rect, LIGHT_BLUE);
 
 	bool isHighlighted = lp->isHighlighted(row);
-	QPixmap* pm = getTagMarks(r->sha(), opt);
+	const TagMarks* tm = getTagMarks(r->sha(), opt);
 
-	if (!pm && !isHighlighted) { // fast path in common case
+	if (!tm && !isHighlighted) { // fast path in common case
 		QItemDelegate::paint(p, opt, index);
 		return;
 	}
 	QStyleOptionViewItem newOpt(opt); // we need a copy
-	if (pm) {
-		p->drawPixmap(newOpt.rect.x(), newOpt.rect.y() + 1, *pm); // +1 means leave a pixel spacing above the pixmap
-		newOpt.rect.adjust(static_cast<int>(pm->width() / dpr()), 0, 0, 0);
-		delete pm;
+	if (tm) {
+		p->drawPixmap(newOpt.rect.x(), newOpt.rect.y() + 1, tm->pm); // +1 means leave a pixel spacing above the pixmap
+		newOpt.rect.adjust(tm->ends.last(), 0, 0, 0);
 	}
 	if (isHighlighted)
                 newOpt.font.setBold(true);
@@ -1160,22 +1253,58 @@ void getTagMarkParams(QString &name, QStyleOptionViewItem& o,
 	o.font.setBold(isCurrent);
 }
 
-QPixmap* ListViewDelegate::getTagMarks(SCRef sha, const QStyleOptionViewItem& opt) const {
+const ListViewDelegate::TagMarks* ListViewDelegate::getTagMarks(SCRef sha, const QStyleOptionViewItem& opt) const {
 
 	uint rt = git->checkRef(sha);
 	if (rt == 0)
 		return NULL; // common case: no refs at all
 
-	QPixmap* pm = new QPixmap(); // must be deleted by caller
+	// badges depend on refs, current branch, font, colors and DPR, cached
+	// ones are dropped as soon as any of them changes, see getRefs()
+	QString stamp(QString::number(git->refsGeneration()) + ' ' + QString::number(dpr())
+	              + ' ' + opt.palette.base().color().name() + ' ' + opt.font.key()
+	              + ' ' + git->getCurrentBranchName());
+	if (stamp != tagMarksStamp) {
+		tagMarks.clear();
+		tagMarksStamp = stamp;
+	}
+	const TagMarks* cached = tagMarks.object(sha);
+	if (cached)
+		return cached;
+
+	TagMarks* tm = new TagMarks;
+	QPixmap* pm = new QPixmap();
 
 	for (RefNameIterator it(sha, git); it.valid(); it.next()) {
 		QStyleOptionViewItem o(opt);
 		QString name = it.name();
 		getTagMarkParams(name, o, it.type(), it.isCurrentBranch());
 		addTextPixmap(&pm, name, o);
+		tm->ends.append(static_cast<int>(pm->width() / dpr()));
+		tm->types.append(it.type());
+		tm->names.append(it.name());
+	}
+	tm->pm = *pm;
+	delete pm;
+
+	if (tm->ends.isEmpty()) { // stale ref info
+		delete tm;
+		return NULL;
 	}
+	tagMarks.insert(sha, tm); // takes ownership
+	return tm;
+}
+
+static QString qualifiedRefName(int type, SCRef name) {
+// cf. Git::getRefs() for names
 
-	return pm;
+	switch (type) {
+	   case Git::BRANCH: return name; break;
+	   case Git::TAG: return "tags/" + name; break;
+	   case Git::RMT_BRANCH: return "remotes/" + name; break;
+	   case Git::REF: return "bases/" + name; break;
+	   default: return QString(); break;
+	}
 }
 
 QString ListView::refNameAt(const QPoint &pos)
@@ -1183,8 +1312,18 @@ QString ListView::refNameAt(const QPoint &pos)
 	QModelIndex index = indexAt(pos);
 	if (index.column() != LOG_COL) return QString();
 
-	int spacing = 4; // inner spacing within pixmaps (cf. addTextPixmap)
+	// use geometry of painted badges if still cached
 	int ofs = visualRect(index).left();
+	const ListViewDelegate* lvd = static_cast<ListViewDelegate*>(itemDelegate());
+	const ListViewDelegate::TagMarks* tm = lvd->cachedTagMarks(sha(index.row()));
+	if (tm) {
+		for (int i = 0; i < tm->ends.count(); i++)
+			if (pos.x() <= ofs + tm->ends[i])
+				return qualifiedRefName(tm->types[i], tm->names[i]);
+
+		return QString();
+	}
+	int spacing = 4; // inner spacing within pixmaps (cf. addTextPixmap)
 	for (RefNameIterator it(sha(index.row()), git); it.valid(); it.next()) {
 		QStyleOptionViewItem o;
 		QString name = it.name();
@@ -1192,16 +1331,9 @@ QString ListView::refNameAt(const QPoint &pos)
 
 		QFontMetrics fm(o.font);
 		ofs += fm.boundingRect(name).width() + 2*spacing;
-		if (pos.x() <= ofs) {
-			// name found: return fully-qualified ref name (cf. Git::getRefs() for names)
-			switch (it.type()) {
-			   case Git::BRANCH: return it.name(); break;
-			   case Git::TAG: return "tags/" + it.name(); break;
-			   case Git::RMT_BRANCH: return "remotes/" + it.name(); break;
-			   case Git::REF: return "bases/" + it.name(); break;
-			   default: return QString(); break;
-			}
-		}
+		if (pos.x() <= ofs) // name found: return fully-qualified ref name
+			return qualifiedRefName(it.type(), it.name());
+
 		ofs += 2; // distance between pixmaps (cf. addTextPixmap)
 	}
 	return QString();
@@ -1291,11 +1423,18 @@ bool ListViewProxy::isMatch(SCRef sha) const {
 		dbp("ASSERT in ListViewFilter::isMatch, sha <%1> not found", sha);
 		return false;
 	}
+	if (colNum == AUTH_COL) { // many revisions share the same few authors
+
+		int id = git->authorId(r);
+		QHash<int, bool>::const_iterator it(authorMatch.constFind(id));
+		if (it == authorMatch.constEnd())
+			it = authorMatch.insert(id, git->authorName(id).contains(filter));
+
+		return it.value();
+	}
 	QString target;
 	if (colNum == LOG_COL)
 		target = r->shortLog();
-	else if (colNum == AUTH_COL)
-		target = r->author();
 	else if (colNum == LOG_MSG_COL)
 		target = r->longLog();
 	else if (colNum == COMMIT_COL)
@@ -1336,6 +1475,7 @@ int ListViewProxy::setFilter(bool isOn, bool h, SCRef fl, int cn, ShaSet* s) {
 	filter = QRegExp(fl, Qt::CaseInsensitive, QRegExp::Wildcard);
 #endif
 	colNum = cn;
+	authorMatch.clear();
 	if (s)
 		shaSet = *s;
 
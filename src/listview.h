@@ -7,7 +7,9 @@
 #define LISTVIEW_H
 
 #include <QTreeView>
+#include <QCache>
 #include <QItemDelegate>
+#include <QPixmap>
 #include <QSortFilterProxyModel>
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 #include <QRegExp>
@@ -41,6 +43,7 @@ public:
 	int filterRows(bool, bool, SCRef = QString(), int = -1, ShaSet* = NULL);
 	const QString sha(int row) const;
 	int row(SCRef sha) const;
+	const QStringList neighbourShas(SCRef sha, int cnt) const;
 	QString refNameAt(const QPoint &pos);
 	const QString& selectedRefName() const {return lastRefName;}
 	void markDiffToSha(SCRef sha);
@@ -74,6 +77,7 @@ protected:
 
 private slots:
 	void on_customContextMenuRequested(const QPoint&);
+	void resizeIdColumn();
 	virtual void currentChanged(const QModelIndex&, const QModelIndex&);
 
 private:
@@ -103,6 +107,7 @@ public:
 	virtual QSize sizeHint(const QStyleOptionViewItem& o, const QModelIndex &i) const;
 	int laneWidth() const { return 3 * laneHeight / 4; }
 	void setLaneHeight(int h) { laneHeight = h; }
+	void clearGlyphCache() const { glyphCache.clear(); }
 
 signals:
 	void updateView();
@@ -115,7 +120,15 @@ private:
 	void paintLog(QPainter* p, const QStyleOptionViewItem& o, const QModelIndex &i) const;
 	void paintGraph(QPainter* p, const QStyleOptionViewItem& o, const QModelIndex &i) const;
 	void paintGraphLane(QPainter* p, int type, int x1, int x2, const QColor& col, const QColor& activeCol, const QBrush& back) const;
-	QPixmap* getTagMarks(SCRef sha, const QStyleOptionViewItem& opt) const;
+	const QPixmap& laneGlyph(quint64 key, int type, const QColor& col, const QColor& activeCol, const QBrush& back) const;
+	struct TagMarks {
+		QPixmap pm;
+		QVector<int> ends;  // right edge of each badge in pm, in logical pixels
+		QVector<int> types; // ref type and name of each badge
+		QStringList names;
+	};
+	const TagMarks* getTagMarks(SCRef sha, const QStyleOptionViewItem& opt) const;
+	const TagMarks* cachedTagMarks(SCRef sha) const { return tagMarks.object(sha); }
 	void addTextPixmap(QPixmap** pp, SCRef txt, const QStyleOptionViewItem& opt) const;
 	bool changedFiles(SCRef sha) const;
 	qreal dpr(void) const;
@@ -124,6 +137,10 @@ private:
 	ListViewProxy* lp;
 	int laneHeight;
 	int diffTargetRow;
+	mutable QHash<quint64, QPixmap> glyphCache; // rendered lanes, see laneGlyph()
+	mutable QString glyphStamp; // DPR and colors the cached glyphs were drawn with
+	mutable QCache<QString, TagMarks> tagMarks; // LRU of ref badges by sha
+	mutable QString tagMarksStamp; // style the cached badges were drawn with
 };
 
 class ListViewProxy : public QSortFilterProxyModel {
@@ -150,6 +167,7 @@ private:
 #endif
 	int colNum;
 	ShaSet shaSet;
+	mutable QHash<int, bool> authorMatch; // by author id, see Git::authorId()
 };
 
 #endif
@@ -9,7 +9,6 @@
 #include <QCloseEvent>
 #include <QEvent>
 #include <QFileDialog>
-#include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
@@ -34,10 +33,12 @@
 #include "mainimpl.h"
 #include "inputdialog.h"
 #include "patchview.h"
+#include "patchviewport.h"
 #include "rangeselectimpl.h"
 #include "revdesc.h"
 #include "revsview.h"
 #include "settingsimpl.h"
+#include "textfind.h"
 #include "treeview.h"
 #include "ui_help.h"
 #include "ui_revsview.h"
@@ -72,6 +73,7 @@ MainImpl::MainImpl(SCRef cd, QWidget* p) : QMainWindow(p) {
 
 	// init native types
 	setRepositoryBusy = false;
+	findRegExp = false;
 
 	// init filter match highlighters
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
@@ -164,6 +166,8 @@ connect(tabWdg, SIGNAL(tabCloseRequested(int)), SLOT(tabBar_tabCloseRequested(in
 
 	connect(this, SIGNAL(typeWriterFontChanged()), this, SIGNAL(updateRevDesc()));
 
+	connect(git, SIGNAL(indexTreeReady()), this, SIGNAL(updateRevDesc()));
+
 	connect(this, SIGNAL(changeFont(const QFont&)), git, SIGNAL(changeFont(const QFont&)));
 
 	// connect cross-domain update signals
@@ -1254,13 +1258,21 @@ QTextEdit* MainImpl::getCurrentTextEdit() {
 	return te;
 }
 
+static PatchViewport* bigPatchView(QTextEdit* te) {
+// huge patches are shown by a PatchViewport on top of the text edit
+
+	PatchContent* pc = qobject_cast<PatchContent*>(te);
+	return (pc ? pc->bigPatchView() : NULL);
+}
+
 void MainImpl::scrollTextEdit(int delta) {
 
 	QTextEdit* te = getCurrentTextEdit();
 	if (!te)
 		return;
 
-	QScrollBar* vs = te->verticalScrollBar();
+	PatchViewport* pv = bigPatchView(te);
+	QScrollBar* vs = (pv ? pv->verticalScrollBar() : te->verticalScrollBar());
 	if (delta == 1 || delta == -1)
 		vs->setValue(vs->value() + delta * (vs->pageStep() - vs->singleStep()));
 	else
@@ -2145,15 +2157,48 @@ void MainImpl::ActFilterTree_toggled(bool b) {
 		refreshRepo(true);
 }
 
-void MainImpl::ActFindNext_activated() {
+TextFind* MainImpl::textFind(QTextEdit* te) {
+// created on first use, then lives with the text edit
+
+	TextFind* tf = te->findChild<TextFind*>();
+	if (!tf) {
+		tf = new TextFind(te);
+		connect(tf, SIGNAL(jumpPending(bool)), this, SLOT(textFind_jumpPending(bool)));
+	}
+	return tf;
+}
+
+void MainImpl::textFind_jumpPending(bool backward) {
+
+	QTextEdit* te = getCurrentTextEdit();
+	if (te && sender() == te->findChild<TextFind*>()) // tab could be changed
+		findText(backward);
+}
+
+void MainImpl::findText(bool backward) {
 
 	QTextEdit* te = getCurrentTextEdit();
 	if (!te || textToFind.isEmpty())
 		return;
 
+	PatchViewport* pv = bigPatchView(te);
+	if (pv && findRegExp) {
+		statusBar()->showMessage("Regular expressions are not supported on huge patches");
+		return;
+	}
+	TextFind* tf = (pv ? NULL : textFind(te));
+	if (tf && !tf->search(textToFind, findRegExp)) // same text is not searched again
+		return;
+
 	bool endOfDocument = false;
 	while (true) {
-		if (te->find(textToFind))
+		int res;
+		if (pv)
+			res = (pv->find(textToFind, backward) ? TextFind::FOUND : TextFind::NOT_FOUND);
+		else
+			res = tf->jump(backward);
+
+		if (res != TextFind::NOT_FOUND) // on PENDING we are called again
 			return;
 
 		if (endOfDocument) {
@@ -2166,53 +2211,81 @@ void MainImpl::ActFindNext_activated() {
 		}
 		QMessageBox q(QMessageBox::Question,
 			"Find text - QGit",
-			"End of document reached\n\nDo you want to continue from beginning?",
+			backward ? "Beginning of document reached\n\nDo you want to continue from end?"
+			         : "End of document reached\n\nDo you want to continue from beginning?",
 			QMessageBox::StandardButton::Yes | QMessageBox::StandardButton::No,
 			this);
 		if (q.exec() == QMessageBox::No)
 			return;
 
 		endOfDocument = true;
-		te->moveCursor(QTextCursor::Start);
+		if (pv && backward)
+			pv->moveToEnd();
+		else if (pv)
+			pv->moveToStart();
+		else
+			te->moveCursor(backward ? QTextCursor::End : QTextCursor::Start);
 	}
 }
 
+void MainImpl::ActFindNext_activated() {
+
+	findText(false);
+}
+
+void MainImpl::ActFindPrevious_activated() {
+
+	findText(true);
+}
+
 void MainImpl::ActFind_activated() {
 
 	QTextEdit* te = getCurrentTextEdit();
 	if (!te)
 		return;
 
+	PatchViewport* pv = bigPatchView(te);
 	QString def(textToFind);
-	if (te->textCursor().hasSelection())
+	if (pv && pv->hasSelection())
+		def = pv->selectedText().section('\n', 0, 0);
+	else if (pv)
+		pv->moveToStart();
+	else if (te->textCursor().hasSelection())
 		def = te->textCursor().selectedText().section('\n', 0, 0);
 	else
 		te->moveCursor(QTextCursor::Start);
 
-	bool ok;
-	QString str(QInputDialog::getText(this, "Find text - QGit", "Text to find:",
-	                                  QLineEdit::Normal, def, &ok));
-	if (!ok || str.isEmpty())
+	QStringList modes;
+	modes << "Text" << "Regular expression";
+	if (findRegExp)
+		modes.swap(0, 1); // last used first
+
+	InputDialog::VariableMap dlgVars;
+	dlgVars.insert("TEXT", def);
+	dlgVars.insert("MODES", modes);
+	InputDialog dlg("%lineedit:Text to find=$TEXT%%combobox:Mode=$MODES%",
+	                dlgVars, "Find text - QGit", this);
+
+	if (dlg.exec() != QDialog::Accepted)
 		return;
 
-	// Highlight all occurrences.
-	const QTextCursor origCursor = te->textCursor();
-	te->moveCursor(QTextCursor::Start);
+	const QString str(dlg.value("Text to find").toString());
+	bool isRegExp = (dlg.value("Mode").toString() == "Regular expression");
+	if (str.isEmpty())
+		return;
 
-	QList<QTextEdit::ExtraSelection> extras;
-	while(te->find(str)) {
-		QTextEdit::ExtraSelection extra;
-		extra.format.setBackground(Qt::yellow);
-		extra.cursor = te->textCursor();
-		extras.append(extra);
+	if (!pv && isRegExp && !textFind(te)->search(str, true)) {
+		QMessageBox::warning(this, "Find text - QGit",
+		                     "Invalid regular expression \"" + str + "\"");
+		return;
 	}
-	te->setExtraSelections(extras);
-
-	te->setTextCursor(origCursor);
+	if (pv && !isRegExp) // occurrences are highlighted when painted
+		pv->setFindHighlight(str);
 
-	// Do the normal find().
+	// matches are highlighted by TextFind as soon as found
 	textToFind = str; // update with valid data only
-	ActFindNext_activated();
+	findRegExp = isRegExp;
+	findText(false);
 }
 
 void MainImpl::ActHelp_activated() {
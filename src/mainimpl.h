@@ -34,6 +34,7 @@ class Git;
 class FileHistory;
 class FileView;
 class RevsView;
+class TextFind;
 
 class MainImpl : public QMainWindow, public Ui_MainBase {
 Q_OBJECT
@@ -102,6 +103,8 @@ protected slots:
 	void ActForward_activated();
 	void ActFind_activated();
 	void ActFindNext_activated();
+	void ActFindPrevious_activated();
+	void textFind_jumpPending(bool backward);
 	void ActRangeDlg_activated();
 	void ActViewRev_activated();
 	void ActViewFile_activated();
@@ -172,6 +175,8 @@ private:
 	bool askApplyPatchParameters(bool* commit, bool* fold);
 	void saveCurrentGeometry();
 	QTextEdit* getCurrentTextEdit();
+	TextFind* textFind(QTextEdit* te);
+	void findText(bool backward);
 	template<class X> QList<X*>* getTabs(QWidget* tabPage = NULL);
 	template<class X> X* firstTab(QWidget* startPage = NULL);
 	void openFileTab(FileView* fv = NULL);
@@ -190,6 +195,7 @@ private:
 	QString startUpDir;
 	QString startUpFile;
 	QString textToFind;
+	bool findRegExp;
 	QRegularExpression shortLogRE;
 	QRegularExpression longLogRE;
 	QMap<QString, QVariant> revision_variables; // variables used in generic input dialogs
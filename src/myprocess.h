@@ -22,6 +22,7 @@ public:
 	bool runAsync(SCRef rc, QObject* rcv, SCRef buf);
 	static const QStringList splitArgList(SCRef cmd);
 	const QString& getErrorOutput() const { return accError; }
+	void setErrorReporting(bool b) { errorReportingEnabled = b; }
 
 signals:
 	void procDataReady(const QByteArray&);
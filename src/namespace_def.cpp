@@ -201,6 +201,8 @@ const QString QGit::EXT_EDITOR_DEF  = "emacs";
 // cache file
 const QString QGit::BAK_EXT          = ".bak";
 const QString QGit::C_DAT_FILE       = "/qgit_cache.dat";
+const QString QGit::A_DAT_DIR        = "/qgit_annotate";
+const QString QGit::D_DAT_DIR        = "/qgit_diff";
 
 // misc
 const QString QGit::QUOTE_CHAR = "$";
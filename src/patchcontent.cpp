@@ -4,21 +4,60 @@
 	Copyright: See COPYING file that comes with this distribution
 
 */
+#include <algorithm>
 #include <QScrollBar>
+#include <QTextBlock>
 #include <QTextCharFormat>
 #include "common.h"
 #include "domain.h"
 #include "git.h"
 #include "myprocess.h"
 #include "patchcontent.h"
+#include "patchviewport.h"
+#include "sidebyside.h"
 
 void DiffHighlighter::highlightBlock(const QString& text) {
 
-	// state is used to count paragraphs, starting from 0
-	setCurrentBlockState(previousBlockState() + 1);
+	// blocks far from the viewport are left alone, state tells
+	// if the block is formatted with the current matches
+	PatchContent* pc = static_cast<PatchContent*>(parent());
+	const int para = currentBlock().blockNumber();
+	if (para < pc->hlFirst || para > pc->hlLast) {
+		setCurrentBlockState(0);
+		return;
+	}
+	setCurrentBlockState(pc->hlGen);
 	if (text.isEmpty())
 		return;
 
+	QTextCharFormat myFormat(lineFormat(text, cl));
+	if (myFormat.isValid())
+		setFormat(0, text.length(), myFormat);
+
+	if (pc->matches.count() > 0) {
+		int indexFrom, indexTo;
+		if (pc->getMatch(para, &indexFrom, &indexTo)) {
+
+			QTextEdit* te = dynamic_cast<QTextEdit*>(parent());
+			QTextCharFormat fmt;
+			fmt.setFont(te->currentFont());
+			fmt.setFontWeight(QFont::Bold);
+			fmt.setForeground(Qt::blue);
+			if (indexTo == 0)
+				indexTo = text.length();
+
+			setFormat(indexFrom, indexTo - indexFrom, fmt);
+		}
+	}
+}
+
+QTextCharFormat DiffHighlighter::lineFormat(const QString& text, uint cl) {
+// color of a whole patch line, PatchViewport uses it when painting
+
+	QTextCharFormat myFormat;
+	if (text.isEmpty())
+		return myFormat;
+
 	const bool useDark = QPalette().color(QPalette::Window).value() > QPalette().color(QPalette::WindowText).value();
 
 	QBrush blue    = useDark ? Qt::darkBlue    : QColor(Qt::cyan);
@@ -26,7 +65,6 @@ void DiffHighlighter::highlightBlock(const QString& text) {
 	QBrush magenta = useDark ? Qt::darkMagenta : QColor(Qt::magenta);
 	QBrush backgroundPurple = useDark ? QGit::PURPLE : QGit::PURPLE.darker(600);
 
-	QTextCharFormat myFormat;
 	const char firstChar = text.at(0).toLatin1();
 	switch (firstChar) {
 	case '@':
@@ -70,30 +108,18 @@ void DiffHighlighter::highlightBlock(const QString& text) {
 		}
 		break;
 	}
-	if (myFormat.isValid())
-		setFormat(0, text.length(), myFormat);
-
-	PatchContent* pc = static_cast<PatchContent*>(parent());
-	if (pc->matches.count() > 0) {
-		int indexFrom, indexTo;
-		if (pc->getMatch(currentBlockState(), &indexFrom, &indexTo)) {
-
-			QTextEdit* te = dynamic_cast<QTextEdit*>(parent());
-			QTextCharFormat fmt;
-			fmt.setFont(te->currentFont());
-			fmt.setFontWeight(QFont::Bold);
-			fmt.setForeground(Qt::blue);
-			if (indexTo == 0)
-				indexTo = text.length();
-
-			setFormat(indexFrom, indexTo - indexFrom, fmt);
-		}
-	}
+	return myFormat;
 }
 
 PatchContent::PatchContent(QWidget* parent) : QTextEdit(parent) {
 
-	diffLoaded = seekTarget = false;
+	diffLoaded = seekTarget = bigPatch = sideBySide = false;
+	bigView = NULL;
+	sideView = NULL;
+	matcher = NULL;
+	hlFirst = hlLast = -1;
+	hlGen = 1;
+	hlBusy = false;
 	curFilter = prevFilter = VIEW_ALL;
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 	pickAxeRE.setMinimal(true);
@@ -103,6 +129,9 @@ PatchContent::PatchContent(QWidget* parent) : QTextEdit(parent) {
 #endif
 	setFont(QGit::TYPE_WRITER_FONT);
 	diffHighlighter = new DiffHighlighter(this);
+
+	connect(verticalScrollBar(), SIGNAL(valueChanged(int)),
+	        this, SLOT(on_scrolled()));
 }
 
 void PatchContent::setup(Domain*, Git* g) {
@@ -113,17 +142,136 @@ void PatchContent::setup(Domain*, Git* g) {
 void PatchContent::clear() {
 
 	git->cancelProcess(proc);
+	stopMatcher();
+	hlFirst = hlLast = -1; // new text is not formatted until shown
 	QTextEdit::clear();
 	patchRowData.clear();
 	halfLine = "";
 	matches.clear();
 	diffLoaded = false;
 	seekTarget = !target.isEmpty();
+	if (bigPatch) {
+		bigPatch = false;
+		bigView->clear();
+		bigView->hide();
+		setFocusProxy(NULL);
+	}
+	showSideBySide(); // cleared until the new patch is loaded
+}
+
+PatchViewport* PatchContent::bigPatchView() const {
+
+	return (bigPatch ? bigView : NULL);
+}
+
+void PatchContent::switchToBigPatch() {
+// a huge patch is not loaded in the document, raw bytes are
+// handed to a PatchViewport that covers the whole widget
+
+	if (!bigView) {
+		bigView = new PatchViewport(this);
+		bigView->setFont(QGit::TYPE_WRITER_FONT);
+	}
+	QTextEdit::clear();
+	halfLine = "";
+	bigPatch = true;
+	bigView->clear();
+	bigView->setCombinedLength(diffHighlighter->combinedLength());
+	bigView->setFilter(curFilter != VIEW_REMOVED, curFilter != VIEW_ADDED);
+	bigView->appendData(patchRowData);
+	patchRowData.clear();
+	bigView->setGeometry(rect());
+	bigView->show();
+	bigView->raise();
+	setFocusProxy(bigView);
+}
+
+void PatchContent::setSideBySide(bool b) {
+
+	sideBySide = b;
+	showSideBySide();
+}
+
+void PatchContent::showSideBySide() {
+// the side by side view covers the whole widget, as the big patch one,
+// and is fed with the raw patch once completely loaded
+
+	bool show = sideBySide && diffHighlighter->combinedLength() == 0;
+	if (!show) {
+		if (sideView && sideView->isVisible()) {
+			sideView->clear();
+			sideView->hide();
+			setFocusProxy(bigPatch ? bigView : NULL);
+		}
+		return;
+	}
+	if (!sideView) {
+		sideView = new SideBySideView(this);
+		sideView->setFont(QGit::TYPE_WRITER_FONT);
+	}
+	if (!diffLoaded)
+		sideView->clear();
+	else
+		sideView->setPatch(bigPatch ? bigView->data() : patchRowData);
+
+	sideView->setGeometry(rect());
+	sideView->show();
+	sideView->raise();
+	setFocusProxy(sideView);
+}
+
+void PatchContent::resizeEvent(QResizeEvent* e) {
+
+	QTextEdit::resizeEvent(e);
+	if (bigView)
+		bigView->setGeometry(rect());
+
+	if (sideView)
+		sideView->setGeometry(rect());
+
+	highlightVisible();
+}
+
+void PatchContent::on_scrolled() {
+
+	highlightVisible();
+}
+
+void PatchContent::highlightVisible(bool force) {
+// DiffHighlighter formats only blocks around the viewport, here the
+// window is moved and blocks scrolled in view are formatted, if 'force'
+// also the ones formatted with outdated matches
+
+	if (bigPatch || hlBusy || document()->isEmpty())
+		return;
+
+	const int margin = 100; // blocks, keep short scrolls smooth
+	if (force)
+		hlGen++;
+
+	int first = cursorForPosition(QPoint(0, 0)).blockNumber();
+	int last = cursorForPosition(QPoint(0, viewport()->height())).blockNumber();
+	hlFirst = qMax(first - margin, 0);
+	hlLast = last + margin;
+
+	hlBusy = true; // formatting could change scroll bars
+	QTextBlock b = document()->findBlockByNumber(hlFirst);
+	for (int para = hlFirst; b.isValid() && para <= hlLast; b = b.next(), para++)
+		if (b.userState() != hlGen)
+			diffHighlighter->rehighlightBlock(b);
+
+	hlBusy = false;
 }
 
 void PatchContent::refresh() {
 
+	if (bigPatch) { // no need to reload, just reindex shown lines
+		bigView->setFilter(curFilter != VIEW_REMOVED, curFilter != VIEW_ADDED);
+		return;
+	}
+
 	int topPara = topToLineNum();
+	bool loaded = diffLoaded;
 	setUpdatesEnabled(false);
 	QByteArray tmp(patchRowData);
 	clear();
@@ -131,6 +279,10 @@ void PatchContent::refresh() {
 	processData(patchRowData, &topPara);
 	scrollLineToTop(topPara);
 	setUpdatesEnabled(true);
+	if (loaded) { // same patch, filtered in a different way
+		diffLoaded = true;
+		showSideBySide();
+	}
 }
 
 void PatchContent::scrollCursorToTop() {
@@ -163,6 +315,9 @@ int PatchContent::topToLineNum() {
 
 bool PatchContent::centerTarget(SCRef target) {
 
+	if (bigPatch)
+		return bigView->scrollToText(target);
+
 	moveCursor(QTextCursor::Start);
 
 	// find() updates cursor position
@@ -206,6 +361,13 @@ void PatchContent::centerMatch(int id) {
 
 void PatchContent::procReadyRead(const QByteArray& data) {
 
+	if (!bigPatch && patchRowData.size() + data.size() > QGit::BIG_PATCH_SIZE)
+		switchToBigPatch();
+
+	if (bigPatch) {
+		bigView->appendData(data);
+		return;
+	}
 	patchRowData.append(data);
 	if (document()->isEmpty() && isVisible())
 		processData(data);
@@ -215,6 +377,12 @@ void PatchContent::typeWriterFontChanged() {
 
 	setFont(QGit::TYPE_WRITER_FONT);
 	setPlainText(toPlainText());
+	highlightVisible();
+	if (bigView)
+		bigView->setFont(QGit::TYPE_WRITER_FONT);
+
+	if (sideView)
+		sideView->setFont(QGit::TYPE_WRITER_FONT);
 }
 
 void PatchContent::processData(const QByteArray& fileChunk, int* prevLineNum) {
@@ -298,11 +466,22 @@ skip_filter:
 	}
 	QScrollBar* vsb = verticalScrollBar();
 	vsb->setValue(vsb->value() + cursorRect().top());
+	highlightVisible();
 	setUpdatesEnabled(true);
 }
 
 void PatchContent::procFinished() {
 
+	if (bigPatch) {
+		bigView->flush();
+		if (seekTarget)
+			seekTarget = !centerTarget(target);
+
+		diffLoaded = true;
+		computeMatches();
+		showSideBySide();
+		return;
+	}
 	if (!patchRowData.endsWith("\n"))
 		patchRowData.append('\n'); // flush pending half lines
 
@@ -312,78 +491,79 @@ void PatchContent::procFinished() {
 		seekTarget = !centerTarget(target);
 
 	diffLoaded = true;
-	if (computeMatches()) {
-		diffHighlighter->rehighlight(); // slow on big data
-		centerMatch();
-	}
+	computeMatches();
+	showSideBySide();
 }
 
-#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-int PatchContent::doSearch(SCRef txt, int pos) {
+void PatchContent::stopMatcher() {
 
-	if (isRegExp)
-		return txt.indexOf(pickAxeRE, pos);
-
-	return txt.indexOf(pickAxeRE.pattern(), pos, Qt::CaseInsensitive);
+	delete matcher; // cancel and wait
+	matcher = NULL;
 }
-#endif
 
-bool PatchContent::computeMatches() {
+void PatchContent::computeMatches() {
+// matches are searched by a PatchMatcher, on_matchesReady() formats them
 
-	matches.clear();
+	stopMatcher();
+	if (bigPatch) { // matches are found on visible lines only, when painted
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-	if (pickAxeRE.isEmpty())
+		bigView->setPickAxe(pickAxeRE.pattern(), isRegExp);
 #else
-	if (pickAxeRE.pattern().isEmpty())
+		bigView->setPickAxe(pickAxeRE.pattern(), true); // already escaped
 #endif
-		return false;
-
-	SCRef txt = toPlainText();
-	int pos, lastPos = 0, lastPara = 0;
-
-	// must be at the end to catch patterns across more the one chunk
+		return;
+	}
+	if (!matches.isEmpty()) {
+		matches.clear();
+		highlightVisible(true); // remove old matches
+	}
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-	while ((pos = doSearch(txt, lastPos)) != -1)
-#else
-	QRegularExpressionMatch match;
-	while ((pos = txt.indexOf(pickAxeRE, pos, &match)) != -1)
-#endif
-	{
-		matches.append(MatchSelection());
-		MatchSelection& s = matches.last();
-
-		s.paraFrom = txt.mid(lastPos, pos - lastPos).count('\n');
-		s.paraFrom += lastPara;
-		s.indexFrom = pos - txt.lastIndexOf('\n', pos) - 1; // index starts from 0
+	if (pickAxeRE.isEmpty())
+		return;
 
-		lastPos = pos;
-#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-		pos += (isRegExp ? pickAxeRE.matchedLength() : pickAxeRE.pattern().length());
+	matcher = new PatchMatcher(this, toPlainText(), pickAxeRE, isRegExp);
 #else
-		pos += match.capturedLength();
+	if (pickAxeRE.pattern().isEmpty())
+		return;
+
+	matcher = new PatchMatcher(this, toPlainText(), pickAxeRE);
 #endif
-		pos--;
+	connect(matcher, SIGNAL(finished()), this, SLOT(on_matchesReady()));
+	matcher->start(QThread::LowPriority);
+}
+
+void PatchContent::on_matchesReady() {
 
-		s.paraTo = s.paraFrom + txt.mid(lastPos, pos - lastPos).count('\n');
-		s.indexTo = pos - txt.lastIndexOf('\n', pos) - 1;
-		s.indexTo++; // in QTextEdit::setSelection() indexTo is not included
+	if (!matcher || sender() != matcher) // could be stale
+		return;
 
-		lastPos = pos;
-		lastPara = s.paraTo;
+	matcher->wait(); // could still be returning from run()
+	matches = matcher->takeMatches();
+	matcher->deleteLater();
+	matcher = NULL;
+	if (!matches.isEmpty()) {
+		highlightVisible(true);
+		centerMatch();
 	}
-	return !matches.isEmpty();
+}
+
+static bool paraToLess(const PatchContent::MatchSelection& m, int para) {
+
+	return m.paraTo < para;
 }
 
 bool PatchContent::getMatch(int para, int* indexFrom, int* indexTo) {
+// matches are sorted and do not overlap, so also paraTo is sorted
 
-	for (int i = 0; i < matches.count(); i++)
-		if (matches[i].paraFrom <= para && matches[i].paraTo >= para) {
+	Matches::const_iterator it = std::lower_bound(matches.constBegin(),
+	                             matches.constEnd(), para, paraToLess);
 
-			*indexFrom = (para == matches[i].paraFrom ? matches[i].indexFrom : 0);
-			*indexTo = (para == matches[i].paraTo ? matches[i].indexTo : 0);
-			return true;
-		}
-	return false;
+	if (it == matches.constEnd() || (*it).paraFrom > para)
+		return false;
+
+	*indexFrom = (para == (*it).paraFrom ? (*it).indexFrom : 0);
+	*indexTo = (para == (*it).paraTo ? (*it).indexTo : 0);
+	return true;
 }
 
 void PatchContent::on_highlightPatch(const QString& exp, bool re) {
@@ -394,7 +574,7 @@ void PatchContent::on_highlightPatch(const QString& exp, bool re) {
 	pickAxeRE.setPattern(re ? exp : QRegularExpression::escape(exp));
 #endif
 	if (diffLoaded)
-		procFinished();
+		computeMatches(); // no need to reload the patch
 }
 
 void PatchContent::update(StateInfo& st) {
@@ -410,3 +590,77 @@ void PatchContent::update(StateInfo& st) {
 	clear();
 	proc = git->getDiff(st.sha(), this, st.diffToSha(), combined); // non blocking
 }
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+PatchMatcher::PatchMatcher(QObject* p, SCRef t, const QRegExp& r, bool isRE)
+                           : QThread(p), txt(t), re(r), isRegExp(isRE), canceled(false) {}
+#else
+PatchMatcher::PatchMatcher(QObject* p, SCRef t, const QRegularExpression& r)
+                           : QThread(p), txt(t), re(r), canceled(false) {}
+#endif
+
+PatchMatcher::~PatchMatcher() {
+
+	cancel();
+	wait();
+}
+
+PatchContent::Matches PatchMatcher::takeMatches() {
+// to be called once the thread is finished
+
+	PatchContent::Matches m(matches);
+	matches.clear();
+	return m;
+}
+
+int PatchMatcher::search(int pos, int* len) {
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	if (!isRegExp) {
+		*len = re.pattern().length();
+		return txt.indexOf(re.pattern(), pos, Qt::CaseInsensitive);
+	}
+	int idx = re.indexIn(txt, pos);
+	*len = re.matchedLength();
+	return idx;
+#else
+	QRegularExpressionMatch m(re.match(txt, pos));
+	*len = m.capturedLength();
+	return (m.hasMatch() ? m.capturedStart() : -1);
+#endif
+}
+
+int PatchMatcher::lineStart(int pos) const {
+
+	return (pos > 0 ? txt.lastIndexOf('\n', pos - 1) + 1 : 0);
+}
+
+void PatchMatcher::run() {
+
+	const QChar* d = txt.constData();
+	int pos = 0, len, lastPos = 0, para = 0;
+	while (!canceled && (pos = search(pos, &len)) != -1) {
+
+		if (len <= 0) { // empty match, e.g. 'a*'
+			pos++;
+			continue;
+		}
+		PatchContent::MatchSelection s;
+
+		for ( ; lastPos < pos; lastPos++)
+			if (d[lastPos] == '\n')
+				para++;
+
+		s.paraFrom = para;
+		s.indexFrom = pos - lineStart(pos); // index starts from 0
+
+		pos += len;
+		for ( ; lastPos < pos - 1; lastPos++)
+			if (d[lastPos] == '\n')
+				para++;
+
+		s.paraTo = para;
+		s.indexTo = pos - lineStart(pos - 1); // not included, like QTextEdit::setSelection()
+		matches.append(s);
+	}
+}
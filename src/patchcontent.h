@@ -13,20 +13,27 @@
 #else
 #include <QRegularExpression>
 #endif
+#include <QTextCharFormat>
 #include <QTextEdit>
+#include <QThread>
 #include <QSyntaxHighlighter>
 #include "common.h"
 
 class Domain;
 class Git;
 class MyProcess;
+class PatchMatcher;
+class PatchViewport;
+class SideBySideView;
 class StateInfo;
 
 class DiffHighlighter : public QSyntaxHighlighter {
 public:
 	DiffHighlighter(QTextEdit* p) : QSyntaxHighlighter(p), cl(0) {}
 	void setCombinedLength(uint c) { cl = c; }
+	uint combinedLength() const { return cl; }
 	virtual void highlightBlock(const QString& text);
+	static QTextCharFormat lineFormat(const QString& text, uint cl);
 private:
 	uint cl;
 };
@@ -40,6 +47,8 @@ public:
 	void centerOnFileHeader(StateInfo& st);
 	void refresh();
 	void update(StateInfo& st);
+	PatchViewport* bigPatchView() const; // NULL unless a huge patch is shown
+	void setSideBySide(bool b);
 
 	enum PatchFilter {
 		VIEW_ALL,
@@ -48,12 +57,27 @@ public:
 	};
 	PatchFilter curFilter, prevFilter;
 
+	struct MatchSelection {
+		int paraFrom;
+		int indexFrom;
+		int paraTo;
+		int indexTo;
+	};
+	typedef QVector<MatchSelection> Matches;
+
 public slots:
 	void on_highlightPatch(const QString&, bool);
 	void typeWriterFontChanged();
 	void procReadyRead(const QByteArray& data);
 	void procFinished();
 
+protected:
+	virtual void resizeEvent(QResizeEvent* e);
+
+private slots:
+	void on_scrolled();
+	void on_matchesReady();
+
 private:
 	friend class DiffHighlighter;
 
@@ -62,17 +86,26 @@ private:
 	int positionToLineNum(int pos);
 	int topToLineNum();
 	void saveRestoreSizes(bool startup = false);
-#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-	int doSearch(const QString& txt, int pos);
-#endif
-	bool computeMatches();
+	void computeMatches();
+	void stopMatcher();
+	void highlightVisible(bool force = false);
 	bool getMatch(int para, int* indexFrom, int* indexTo);
 	void centerMatch(int id = 0);
 	bool centerTarget(SCRef target);
 	void processData(const QByteArray& data, int* prevLineNum = NULL);
+	void switchToBigPatch();
+	void showSideBySide();
 
 	Git* git;
 	DiffHighlighter* diffHighlighter;
+	int hlFirst, hlLast; // blocks DiffHighlighter is allowed to format
+	int hlGen;           // state of blocks formatted with current matches
+	bool hlBusy;
+	PatchMatcher* matcher;
+	PatchViewport* bigView; // created on first huge patch
+	bool bigPatch;
+	SideBySideView* sideView; // created on first use
+	bool sideBySide;
 	QPointer<MyProcess> proc;
 	bool diffLoaded;
 	QByteArray patchRowData;
@@ -85,15 +118,41 @@ private:
 #endif
 	QString target;
 	bool seekTarget;
-
-	struct MatchSelection {
-		int paraFrom;
-		int indexFrom;
-		int paraTo;
-		int indexTo;
-	};
-	typedef QVector<MatchSelection> Matches;
 	Matches matches;
 };
 
+//
+//  PatchMatcher finds pickaxe matches in a copy of the shown patch, so
+//  that highlighting does not block the GUI on big patches.
+//
+class PatchMatcher : public QThread {
+Q_OBJECT
+public:
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	PatchMatcher(QObject* p, const QString& txt, const QRegExp& re, bool isRegExp);
+#else
+	PatchMatcher(QObject* p, const QString& txt, const QRegularExpression& re);
+#endif
+	~PatchMatcher();
+	void cancel() { canceled = true; }
+	PatchContent::Matches takeMatches();
+
+protected:
+	virtual void run();
+
+private:
+	int search(int pos, int* len);
+	int lineStart(int pos) const;
+
+	QString txt;
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	QRegExp re;
+	bool isRegExp;
+#else
+	QRegularExpression re;
+#endif
+	PatchContent::Matches matches;
+	volatile bool canceled;
+};
+
 #endif
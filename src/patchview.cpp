@@ -45,6 +45,9 @@ PatchView::PatchView(MainImpl* mi, Git* g) : Domain(mi, g, false) {
 
 	connect(patchTab->buttonFilterPatch, SIGNAL(clicked()),
 	        this, SLOT(buttonFilterPatch_clicked()));
+
+	connect(patchTab->buttonSideBySide, SIGNAL(toggled(bool)),
+	        this, SLOT(buttonSideBySide_toggled(bool)));
 }
 
 PatchView::~PatchView() {
@@ -87,6 +90,11 @@ void PatchView::buttonFilterPatch_clicked() {
 	patchTab->textEditDiff->refresh();
 }
 
+void PatchView::buttonSideBySide_toggled(bool b) {
+
+	patchTab->textEditDiff->setSideBySide(b);
+}
+
 void PatchView::on_contextMenu(const QString& data, int type) {
 
 	if (isLinked()) // skip if not linked to main view
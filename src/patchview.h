@@ -30,6 +30,7 @@ public slots:
 	void lineEditDiff_returnPressed();
 	void button_clicked(int);
 	void buttonFilterPatch_clicked();
+	void buttonSideBySide_toggled(bool b);
 
 protected slots:
 	virtual void on_contextMenu(const QString&, int);
@@ -0,0 +1,567 @@
+/*
+	Description: lightweight viewer for huge patches
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <string.h>
+#include <algorithm>
+#include <QApplication>
+#include <QClipboard>
+#include <QContextMenuEvent>
+#include <QKeyEvent>
+#include <QMenu>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTextCharFormat>
+#include "patchcontent.h"
+#include "patchviewport.h"
+
+static const int MARGIN = 4; // pixels, as QTextDocument default margin
+static const int TAB_WIDTH = 8;
+static const int MAX_LINE_BYTES = 64 * 1024; // longer lines are shown truncated
+static const int SEARCH_CHUNK = 1024 * 1024;
+
+static QString expandTabs(SCRef line) {
+
+	if (!line.contains('\t'))
+		return line;
+
+	QString txt;
+	txt.reserve(line.length() + TAB_WIDTH);
+	for (int i = 0; i < line.length(); i++) {
+		if (line.at(i) == '\t')
+			txt.append(QString(TAB_WIDTH - txt.length() % TAB_WIDTH, ' '));
+		else
+			txt.append(line.at(i));
+	}
+	return txt;
+}
+
+static int toVisual(SCRef line, int idx) {
+// column where character 'idx' is painted
+
+	int v = 0;
+	for (int i = 0; i < idx; i++)
+		v = (i < line.length() && line.at(i) == '\t' ? (v / TAB_WIDTH + 1) * TAB_WIDTH : v + 1);
+	return v;
+}
+
+static int toIndex(SCRef line, int col) {
+// reverse of toVisual(), a column inside a tab maps to the tab
+
+	int v = 0;
+	for (int i = 0; i < line.length(); i++) {
+		if (v >= col)
+			return i;
+		v = (line.at(i) == '\t' ? (v / TAB_WIDTH + 1) * TAB_WIDTH : v + 1);
+	}
+	return line.length();
+}
+
+static int indexOfNoCase(const QByteArray& buf, const QByteArray& lowNeedle, int from, int end) {
+// ASCII only case insensitive search, the buffer is lowered a chunk at a time
+
+	for (int pos = from; pos < end; pos += SEARCH_CHUNK) {
+
+		int len = qMin(SEARCH_CHUNK + lowNeedle.size() - 1, end - pos);
+		int i = buf.mid(pos, len).toLower().indexOf(lowNeedle);
+		if (i != -1)
+			return pos + i;
+	}
+	return -1;
+}
+
+static int lastIndexOfNoCase(const QByteArray& buf, const QByteArray& lowNeedle, int before, int end) {
+// as indexOfNoCase() but backward, finds the last match starting before 'before'
+
+	for (int pos = before; pos > 0; pos -= SEARCH_CHUNK) {
+
+		int from = qMax(pos - SEARCH_CHUNK, 0);
+		int len = qMin(pos - from + lowNeedle.size() - 1, end - from);
+		int i = buf.mid(from, len).toLower().lastIndexOf(lowNeedle, pos - from - 1);
+		if (i != -1)
+			return from + i;
+	}
+	return -1;
+}
+
+PatchViewport::PatchViewport(QWidget* parent) : QAbstractScrollArea(parent) {
+
+	indexed = maxCols = 0;
+	cl = 0;
+	showAdded = showRemoved = true;
+	viewport()->setCursor(Qt::IBeamCursor);
+	setFocusPolicy(Qt::StrongFocus);
+	updateMetrics();
+}
+
+void PatchViewport::clear() {
+
+	buf = QByteArray(); // release memory, could be a lot
+	rows = QVector<int>();
+	indexed = maxCols = 0;
+	anchor = cursor = Pos();
+	findTxt = "";
+	updateScrollBars();
+	viewport()->update();
+}
+
+void PatchViewport::appendData(const QByteArray& data) {
+
+	buf.append(data);
+	indexLines();
+	updateScrollBars();
+	viewport()->update();
+}
+
+void PatchViewport::flush() {
+
+	if (!buf.isEmpty() && !buf.endsWith('\n'))
+		appendData("\n"); // index pending half line
+}
+
+void PatchViewport::indexLines() {
+// only complete lines are indexed, a trailing half line waits for more data
+
+	const char* data = buf.constData();
+	const int end = buf.size();
+	int ofs = indexed;
+	while (ofs < end) {
+
+		const char* nl = static_cast<const char*>(memchr(data + ofs, '\n', end - ofs));
+		if (!nl)
+			break;
+
+		int len = nl - data - ofs;
+
+		// same rule of PatchContent::processData(), diff header is kept
+		bool n = (data[ofs] == '-' && !(len >= 3 && !strncmp(data + ofs, "---", 3)));
+		bool p = (data[ofs] == '+' && !(len >= 3 && !strncmp(data + ofs, "+++", 3)));
+
+		if ((!n || showRemoved) && (!p || showAdded)) {
+			rows.append(ofs);
+			maxCols = qMax(maxCols, qMin(len, MAX_LINE_BYTES));
+		}
+		ofs = nl - data + 1;
+	}
+	indexed = ofs;
+}
+
+void PatchViewport::setFilter(bool added, bool removed) {
+
+	if (added == showAdded && removed == showRemoved)
+		return;
+
+	int topOfs = rowToOffset(topRow());
+	showAdded = added;
+	showRemoved = removed;
+	rows.clear();
+	indexed = maxCols = 0;
+	anchor = cursor = Pos();
+	indexLines();
+	updateScrollBars();
+	scrollRowToTop(qMax(offsetToRow(topOfs), 0)); // nearest shown line
+	viewport()->update();
+}
+
+void PatchViewport::setPickAxe(SCRef pattern, bool isRegExp) {
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	pickAxeRE = QRegExp(pattern, Qt::CaseInsensitive,
+	                    isRegExp ? QRegExp::RegExp : QRegExp::FixedString);
+	pickAxeRE.setMinimal(true);
+#else
+	pickAxeRE.setPattern(isRegExp ? pattern : QRegularExpression::escape(pattern));
+	pickAxeRE.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+#endif
+	viewport()->update();
+}
+
+void PatchViewport::setFindHighlight(SCRef txt) {
+
+	findTxt = txt;
+	viewport()->update();
+}
+
+int PatchViewport::rowToOffset(int row) const {
+
+	if (row >= 0 && row < rows.count())
+		return rows[row];
+
+	return (row < 0 ? 0 : indexed);
+}
+
+int PatchViewport::offsetToRow(int ofs) const {
+// row of the shown line starting at or before ofs, -1 if none
+
+	return std::upper_bound(rows.constBegin(), rows.constEnd(), ofs) - rows.constBegin() - 1;
+}
+
+int PatchViewport::lineEnd(int row) const {
+
+	const char* data = buf.constData();
+	const char* nl = static_cast<const char*>(memchr(data + rows[row], '\n', indexed - rows[row]));
+	return (nl ? nl - data : indexed);
+}
+
+QString PatchViewport::lineText(int row) const {
+
+	int len = qMin(lineEnd(row) - rows[row], MAX_LINE_BYTES);
+	return QString::fromLocal8Bit(buf.constData() + rows[row], len);
+}
+
+bool PatchViewport::scrollToText(SCRef txt) {
+// case sensitive, used to center on a file header
+
+	const QByteArray needle(txt.toLocal8Bit());
+	if (needle.isEmpty())
+		return false;
+
+	int ofs = 0;
+	while ((ofs = buf.indexOf(needle, ofs)) != -1 && ofs < indexed) {
+
+		int row = offsetToRow(ofs);
+		if (row != -1 && ofs < lineEnd(row)) {
+			anchor = cursor = Pos(row, 0);
+			scrollRowToTop(row);
+			viewport()->update();
+			return true;
+		}
+		ofs++;
+	}
+	return false;
+}
+
+bool PatchViewport::find(SCRef txt, bool backward) {
+// search from the selection, like QTextEdit::find()
+
+	if (txt.isEmpty() || rows.isEmpty())
+		return false;
+
+	const QByteArray needle(txt.toLocal8Bit().toLower());
+	const Pos start(backward ? qMin(anchor, cursor) : qMax(anchor, cursor));
+	int ofs = rowToOffset(start.row);
+	if (start.row < rows.count())
+		ofs += lineText(start.row).left(start.col).toLocal8Bit().size();
+
+	while (true) {
+		if (backward)
+			ofs = lastIndexOfNoCase(buf, needle, ofs, indexed);
+		else
+			ofs = indexOfNoCase(buf, needle, ofs, indexed);
+
+		if (ofs == -1)
+			return false;
+
+		int row = offsetToRow(ofs);
+		if (row != -1 && ofs < lineEnd(row)) {
+
+			int col = QString::fromLocal8Bit(buf.constData() + rows[row], ofs - rows[row]).length();
+			anchor = Pos(row, col);
+			cursor = Pos(row, col + txt.length());
+			ensureVisible(cursor);
+			ensureVisible(anchor);
+			viewport()->update();
+			return true;
+		}
+		// match is in a filtered out line, skip it
+		if (backward)
+			continue; // next search ends before ofs
+
+		const char* nl = static_cast<const char*>(memchr(buf.constData() + ofs, '\n', indexed - ofs));
+		ofs = (nl ? nl - buf.constData() + 1 : indexed);
+	}
+}
+
+void PatchViewport::moveToStart() {
+
+	anchor = cursor = Pos();
+	verticalScrollBar()->setValue(0);
+	horizontalScrollBar()->setValue(0);
+	viewport()->update();
+}
+
+void PatchViewport::moveToEnd() {
+
+	int last = rows.count() - 1;
+	anchor = cursor = (last >= 0 ? Pos(last, lineText(last).length()) : Pos());
+	verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+	horizontalScrollBar()->setValue(0);
+	viewport()->update();
+}
+
+bool PatchViewport::hasSelection() const {
+
+	return !(anchor == cursor) && !rows.isEmpty();
+}
+
+QString PatchViewport::selectedText() const {
+
+	if (!hasSelection())
+		return "";
+
+	const Pos from(qMin(anchor, cursor)), to(qMax(anchor, cursor));
+	QString txt;
+	for (int r = from.row; r <= to.row && r < rows.count(); r++) {
+
+		const QString line(lineText(r));
+		int a = (r == from.row ? from.col : 0);
+		int b = (r == to.row ? to.col : line.length());
+		txt.append(line.mid(a, b - a));
+		if (r != to.row)
+			txt.append('\n');
+	}
+	return txt;
+}
+
+void PatchViewport::copy() {
+
+	if (hasSelection())
+		QApplication::clipboard()->setText(selectedText());
+}
+
+void PatchViewport::selectAll() {
+
+	if (rows.isEmpty())
+		return;
+
+	anchor = Pos();
+	cursor = Pos(rows.count() - 1, lineText(rows.count() - 1).length());
+	viewport()->update();
+}
+
+int PatchViewport::topRow() const {
+
+	return verticalScrollBar()->value();
+}
+
+void PatchViewport::scrollRowToTop(int row) {
+
+	verticalScrollBar()->setValue(row);
+}
+
+void PatchViewport::updateMetrics() {
+
+	QFontMetrics fm(font());
+	lineHeight = qMax(fm.lineSpacing(), 1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+	charWidth = qMax(fm.horizontalAdvance(QLatin1Char('x')), 1);
+#else
+	charWidth = qMax(fm.width(QLatin1Char('x')), 1);
+#endif
+	updateScrollBars();
+}
+
+void PatchViewport::updateScrollBars() {
+
+	int visible = qMax(viewport()->height() / lineHeight, 1);
+	QScrollBar* vsb = verticalScrollBar();
+	vsb->setRange(0, qMax(rows.count() - visible, 0));
+	vsb->setPageStep(visible);
+	vsb->setSingleStep(1);
+
+	QScrollBar* hsb = horizontalScrollBar();
+	hsb->setRange(0, qMax(maxCols * charWidth + 2 * MARGIN - viewport()->width(), 0));
+	hsb->setPageStep(viewport()->width());
+	hsb->setSingleStep(charWidth);
+}
+
+void PatchViewport::ensureVisible(const Pos& p) {
+
+	QScrollBar* vsb = verticalScrollBar();
+	int visible = qMax(viewport()->height() / lineHeight, 1);
+	if (p.row < vsb->value())
+		vsb->setValue(p.row);
+	else if (p.row >= vsb->value() + visible)
+		vsb->setValue(p.row - visible + 1);
+
+	if (p.row >= rows.count())
+		return;
+
+	QScrollBar* hsb = horizontalScrollBar();
+	int x = toVisual(lineText(p.row), p.col) * charWidth;
+	if (x < hsb->value())
+		hsb->setValue(x);
+	else if (x > hsb->value() + viewport()->width() - 2 * MARGIN)
+		hsb->setValue(x - viewport()->width() + 2 * MARGIN);
+}
+
+PatchViewport::Pos PatchViewport::posAt(const QPoint& pt) const {
+
+	if (rows.isEmpty())
+		return Pos();
+
+	int row = topRow() + (pt.y() < 0 ? -1 : pt.y() / lineHeight);
+	row = qBound(0, row, rows.count() - 1);
+	int col = (pt.x() - MARGIN + horizontalScrollBar()->value() + charWidth / 2) / charWidth;
+	return Pos(row, toIndex(lineText(row), qMax(col, 0)));
+}
+
+void PatchViewport::drawSpan(QPainter& p, SCRef line, int y, int from, int to,
+                             const QBrush& bg, const QColor& fg, bool bold) {
+// from, to are columns of the tab expanded line, only visible part is drawn
+
+	const int hOfs = horizontalScrollBar()->value();
+	const int c0 = hOfs / charWidth;
+	from = qMax(from, c0);
+	to = qMin(to, c0 + viewport()->width() / charWidth + 2);
+	if (from >= to)
+		return;
+
+	int x = MARGIN - hOfs + from * charWidth;
+	if (bg.style() != Qt::NoBrush)
+		p.fillRect(x, y, (to - from) * charWidth, lineHeight, bg);
+
+	QFont f(font());
+	f.setBold(bold);
+	p.setFont(f);
+	p.setPen(fg);
+	p.drawText(x, y + fontMetrics().ascent(), line.mid(from, to - from));
+}
+
+void PatchViewport::paintEvent(QPaintEvent*) {
+
+	QPainter p(viewport());
+	const QColor textColor(palette().color(QPalette::Text));
+	const Pos from(qMin(anchor, cursor)), to(qMax(anchor, cursor));
+	const bool sel = hasSelection();
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	const bool pickAxe = !pickAxeRE.isEmpty();
+#else
+	const bool pickAxe = !pickAxeRE.pattern().isEmpty();
+#endif
+	int widest = maxCols;
+	int y = 0;
+	for (int r = topRow(); r < rows.count() && y < viewport()->height(); r++, y += lineHeight) {
+
+		const QString raw(lineText(r));
+		const QString txt(expandTabs(raw));
+		widest = qMax(widest, txt.length());
+
+		const QTextCharFormat fmt(DiffHighlighter::lineFormat(raw, cl));
+		if (fmt.hasProperty(QTextFormat::BackgroundBrush))
+			p.fillRect(0, y, viewport()->width(), lineHeight, fmt.background());
+
+		QColor fg(fmt.hasProperty(QTextFormat::ForegroundBrush) ? fmt.foreground().color() : textColor);
+		drawSpan(p, txt, y, 0, txt.length(), Qt::NoBrush, fg, false);
+
+		if (!findTxt.isEmpty()) {
+			int i = raw.indexOf(findTxt, 0, Qt::CaseInsensitive);
+			while (i != -1) {
+				int e = i + findTxt.length();
+				drawSpan(p, txt, y, toVisual(raw, i), toVisual(raw, e), QBrush(Qt::yellow), fg, false);
+				i = raw.indexOf(findTxt, e, Qt::CaseInsensitive);
+			}
+		}
+		if (pickAxe) { // same look of DiffHighlighter matches
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+			int i = pickAxeRE.indexIn(raw);
+			while (i != -1 && pickAxeRE.matchedLength() > 0) {
+				int e = i + pickAxeRE.matchedLength();
+				drawSpan(p, txt, y, toVisual(raw, i), toVisual(raw, e), Qt::NoBrush, Qt::blue, true);
+				i = pickAxeRE.indexIn(raw, e);
+			}
+#else
+			QRegularExpressionMatchIterator it(pickAxeRE.globalMatch(raw));
+			while (it.hasNext()) {
+				QRegularExpressionMatch m(it.next());
+				if (m.capturedLength() > 0)
+					drawSpan(p, txt, y, toVisual(raw, m.capturedStart()),
+					         toVisual(raw, m.capturedEnd()), Qt::NoBrush, Qt::blue, true);
+			}
+#endif
+		}
+		if (sel && r >= from.row && r <= to.row) {
+			int a = (r == from.row ? toVisual(raw, from.col) : 0);
+			int b = (r == to.row ? toVisual(raw, to.col) : txt.length() + 1); // show newline
+			drawSpan(p, txt, y, a, b, palette().highlight(),
+			         palette().color(QPalette::HighlightedText), false);
+		}
+	}
+	if (widest > maxCols) { // tabs and long lines are known only once painted
+		maxCols = widest;
+		updateScrollBars();
+	}
+}
+
+void PatchViewport::resizeEvent(QResizeEvent* e) {
+
+	QAbstractScrollArea::resizeEvent(e);
+	updateScrollBars();
+}
+
+void PatchViewport::changeEvent(QEvent* e) {
+
+	if (e->type() == QEvent::FontChange)
+		updateMetrics();
+
+	QAbstractScrollArea::changeEvent(e);
+}
+
+void PatchViewport::keyPressEvent(QKeyEvent* e) {
+
+	if (e->matches(QKeySequence::Copy))
+		copy();
+
+	else if (e->matches(QKeySequence::SelectAll))
+		selectAll();
+
+	else if (e->matches(QKeySequence::MoveToStartOfDocument))
+		verticalScrollBar()->setValue(0);
+
+	else if (e->matches(QKeySequence::MoveToEndOfDocument))
+		verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+	else
+		QAbstractScrollArea::keyPressEvent(e);
+}
+
+void PatchViewport::mousePressEvent(QMouseEvent* e) {
+
+	if (e->button() != Qt::LeftButton)
+		return;
+
+	cursor = posAt(e->pos());
+	if (!(e->modifiers() & Qt::ShiftModifier))
+		anchor = cursor;
+
+	viewport()->update();
+}
+
+void PatchViewport::mouseMoveEvent(QMouseEvent* e) {
+
+	if (!(e->buttons() & Qt::LeftButton))
+		return;
+
+	// dragging outside the viewport scrolls one line at a time
+	QScrollBar* vsb = verticalScrollBar();
+	if (e->pos().y() < 0)
+		vsb->setValue(vsb->value() - 1);
+	else if (e->pos().y() > viewport()->height())
+		vsb->setValue(vsb->value() + 1);
+
+	cursor = posAt(e->pos());
+	viewport()->update();
+}
+
+void PatchViewport::mouseReleaseEvent(QMouseEvent* e) {
+
+	if (e->button() != Qt::LeftButton || !hasSelection())
+		return;
+
+	QClipboard* cb = QApplication::clipboard();
+	if (cb->supportsSelection())
+		cb->setText(selectedText(), QClipboard::Selection);
+}
+
+void PatchViewport::contextMenuEvent(QContextMenuEvent* e) {
+
+	QMenu menu(this);
+	QAction* act = menu.addAction("&Copy");
+	act->setEnabled(hasSelection());
+	connect(act, SIGNAL(triggered()), this, SLOT(copy()));
+	act = menu.addAction("Select &All");
+	connect(act, SIGNAL(triggered()), this, SLOT(selectAll()));
+	menu.exec(e->globalPos());
+}
@@ -0,0 +1,98 @@
+/*
+	Description: lightweight viewer for huge patches
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef PATCHVIEWPORT_H
+#define PATCHVIEWPORT_H
+
+#include <QAbstractScrollArea>
+#include <QByteArray>
+#include <QVector>
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+#include <QRegExp>
+#else
+#include <QRegularExpression>
+#endif
+
+//
+//  PatchViewport shows a patch kept as raw bytes, without building any
+//  QTextDocument. Only start offsets of shown lines are indexed, lines are
+//  decoded and colored when painted, so cost does not depend on patch size.
+//
+//  Positions are (row, col) where row is a shown line and col a character
+//  index in the decoded line, tabs are expanded only when painting.
+//
+class PatchViewport : public QAbstractScrollArea {
+Q_OBJECT
+public:
+	PatchViewport(QWidget* parent);
+	void clear();
+	void appendData(const QByteArray& data);
+	void flush();
+	const QByteArray& data() const { return buf; }
+	void setCombinedLength(uint c) { cl = c; }
+	void setFilter(bool showAdded, bool showRemoved);
+	void setPickAxe(const QString& pattern, bool isRegExp);
+	void setFindHighlight(const QString& txt);
+	bool scrollToText(const QString& txt);
+	bool find(const QString& txt, bool backward = false);
+	void moveToStart();
+	void moveToEnd();
+	bool hasSelection() const;
+	QString selectedText() const;
+	int topRow() const;
+	void scrollRowToTop(int row);
+	int rowToOffset(int row) const;
+	int offsetToRow(int ofs) const;
+
+public slots:
+	void copy();
+	void selectAll();
+
+protected:
+	virtual void paintEvent(QPaintEvent* e);
+	virtual void resizeEvent(QResizeEvent* e);
+	virtual void changeEvent(QEvent* e);
+	virtual void keyPressEvent(QKeyEvent* e);
+	virtual void mousePressEvent(QMouseEvent* e);
+	virtual void mouseMoveEvent(QMouseEvent* e);
+	virtual void mouseReleaseEvent(QMouseEvent* e);
+	virtual void contextMenuEvent(QContextMenuEvent* e);
+
+private:
+	struct Pos {
+		Pos() : row(0), col(0) {}
+		Pos(int r, int c) : row(r), col(c) {}
+		bool operator<(const Pos& o) const { return row < o.row || (row == o.row && col < o.col); }
+		bool operator==(const Pos& o) const { return row == o.row && col == o.col; }
+		int row, col;
+	};
+	void indexLines();
+	void updateMetrics();
+	void updateScrollBars();
+	void ensureVisible(const Pos& p);
+	int lineEnd(int row) const;
+	QString lineText(int row) const;
+	Pos posAt(const QPoint& pt) const;
+	void drawSpan(QPainter& p, const QString& line, int y, int from, int to,
+	              const QBrush& bg, const QColor& fg, bool bold);
+
+	QByteArray buf;
+	int indexed;            // bytes of buf already split in lines
+	QVector<int> rows;      // start offset of each shown line
+	int maxCols;            // widest line seen so far, in characters
+	uint cl;                // combined diff length, see DiffHighlighter
+	bool showAdded, showRemoved;
+	int lineHeight, charWidth;
+	Pos anchor, cursor;
+	QString findTxt;
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	QRegExp pickAxeRE;
+#else
+	QRegularExpression pickAxeRE;
+#endif
+};
+
+#endif
@@ -0,0 +1,265 @@
+/*
+	Description: ancestor queries over the revision graph
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include "reachability.h"
+
+void Reachability::clear() {
+
+	parOfs.clear();
+	parIdx.clear();
+	gen.clear();
+	pre.clear();
+	post.clear();
+	low.clear();
+	linPre.clear();
+	linPost.clear();
+	linDepth.clear();
+	visited.clear();
+	target.clear();
+	stack.clear();
+	stamp = 0;
+}
+
+void Reachability::build(const QVector<int>& parentOfs, const QVector<int>& parentIdx,
+                         const QVector<int>& linearParent) {
+
+	clear();
+	if (parentOfs.count() < 2)
+		return;
+
+	parOfs = parentOfs;
+	parIdx = parentIdx;
+	int cnt = parOfs.count() - 1;
+	gen.fill(0, cnt);
+	pre.fill(-1, cnt);
+	post.fill(0, cnt);
+	low.fill(0, cnt);
+	visited.fill(0, cnt);
+	target.fill(0, cnt);
+
+	// iterative DFS along parent links, graph is a DAG so a
+	// parent already discovered has always been finished too
+	QVector<int> edge(parOfs);
+	int preCnt = 0, postCnt = 0;
+	for (int s = 0; s < cnt; s++) {
+
+		if (pre[s] != -1)
+			continue;
+
+		pre[s] = preCnt++;
+		stack.append(s);
+		while (!stack.isEmpty()) {
+
+			int v = stack.last();
+			if (edge[v] < parOfs[v + 1]) {
+
+				int p = parIdx[edge[v]++];
+				if (pre[p] == -1) {
+					pre[p] = preCnt++;
+					stack.append(p);
+				}
+				continue;
+			}
+			stack.pop_back();
+			int l = post[v] = postCnt++;
+			int g = 0;
+			for (int i = parOfs[v]; i < parOfs[v + 1]; i++) {
+				int p = parIdx[i];
+				l = qMin(l, low[p]);
+				g = qMax(g, gen[p]);
+			}
+			low[v] = l;
+			gen[v] = g + 1;
+		}
+	}
+	// linear forest, each row is linked to its parent
+	// only if it is not a merge, then label the trees
+	QVector<int> linPar(linearParent);
+	if (linPar.count() != cnt) {
+		linPar.fill(-1, cnt);
+		for (int i = 0; i < cnt; i++)
+			if (parOfs[i + 1] - parOfs[i] == 1)
+				linPar[i] = parIdx[parOfs[i]];
+	}
+	QVector<int> linOfs(cnt + 1, 0), linIdx;
+	for (int i = 0; i < cnt; i++)
+		if (linPar[i] != -1)
+			linOfs[linPar[i] + 1]++;
+
+	for (int i = 0; i < cnt; i++)
+		linOfs[i + 1] += linOfs[i];
+
+	edge = linOfs;
+	linIdx.resize(linOfs[cnt]);
+	for (int i = 0; i < cnt; i++)
+		if (linPar[i] != -1)
+			linIdx[edge[linPar[i]]++] = i;
+
+	linPre.fill(-1, cnt);
+	linPost.fill(0, cnt);
+	linDepth.fill(0, cnt);
+	edge = linOfs;
+	preCnt = postCnt = 0;
+	for (int s = 0; s < cnt; s++) {
+
+		if (linPar[s] != -1)
+			continue;
+
+		linPre[s] = preCnt++;
+		stack.append(s);
+		while (!stack.isEmpty()) {
+
+			int v = stack.last();
+			if (edge[v] < linOfs[v + 1]) {
+
+				int c = linIdx[edge[v]++];
+				linPre[c] = preCnt++;
+				linDepth[c] = linDepth[v] + 1;
+				stack.append(c);
+				continue;
+			}
+			stack.pop_back();
+			linPost[v] = postCnt++;
+		}
+	}
+}
+
+void Reachability::nextStamp() const {
+
+	if (++stamp <= 0) { // wrapped around, reset the stamps
+		visited.fill(0);
+		target.fill(0);
+		stamp = 1;
+	}
+}
+
+bool Reachability::isParent(int par, int child) const {
+
+	if (!isValid(par) || !isValid(child))
+		return false;
+
+	for (int i = parOfs[child]; i < parOfs[child + 1]; i++)
+		if (parIdx[i] == par)
+			return true;
+
+	return false;
+}
+
+bool Reachability::isLinearAncestor(int anc, int desc, int* dist) const {
+// true if 'anc' is reached from 'desc' walking along parents of non-merge
+// revisions only, a row is considered a linear ancestor of itself
+
+	if (!isValid(anc) || !isValid(desc) || linPre[anc] == -1 || linPre[desc] == -1)
+		return false;
+
+	if (linPre[anc] > linPre[desc] || linPost[desc] > linPost[anc])
+		return false;
+
+	if (dist)
+		*dist = linDepth[desc] - linDepth[anc];
+
+	return true;
+}
+
+bool Reachability::isAncestor(int anc, int desc) const {
+
+	if (anc == desc || !isValid(anc) || !isValid(desc))
+		return false;
+
+	if (gen[anc] >= gen[desc] || !mayReach(desc, anc))
+		return false;
+
+	if (treeReach(desc, anc))
+		return true;
+
+	nextStamp();
+	stack.clear();
+	stack.append(desc);
+	visited[desc] = stamp;
+	while (!stack.isEmpty()) {
+
+		int v = stack.last();
+		stack.pop_back();
+		for (int i = parOfs[v]; i < parOfs[v + 1]; i++) {
+
+			int p = parIdx[i];
+			if (p == anc)
+				return true;
+
+			if (visited[p] == stamp)
+				continue;
+
+			visited[p] = stamp;
+			if (gen[p] <= gen[anc] || !mayReach(p, anc))
+				continue;
+
+			if (treeReach(p, anc))
+				return true;
+
+			stack.append(p);
+		}
+	}
+	return false;
+}
+
+void Reachability::areAncestors(const QVector<int>& ancs, int desc, QVector<bool>& res) const {
+// batch version of isAncestor(), rows not decided by
+// labels alone are looked for with a single shared walk
+
+	res.fill(false, ancs.count());
+	if (!isValid(desc))
+		return;
+
+	nextStamp();
+	QVector<int> undecided;
+	int minGen = gen[desc], maxLow = -1, minPost = post[desc];
+	for (int i = 0; i < ancs.count(); i++) {
+
+		int a = ancs[i];
+		if (a == desc || !isValid(a) || gen[a] >= gen[desc] || !mayReach(desc, a))
+			continue;
+
+		if (treeReach(desc, a)) {
+			res[i] = true;
+			continue;
+		}
+		undecided.append(i);
+		target[a] = stamp;
+		minGen = qMin(minGen, gen[a]);
+		maxLow = qMax(maxLow, low[a]);
+		minPost = qMin(minPost, post[a]);
+	}
+	int left = undecided.count(); // could count duplicates, no harm
+	stack.clear();
+	if (left)
+		stack.append(desc);
+
+	visited[desc] = stamp;
+	while (!stack.isEmpty() && left > 0) {
+
+		int v = stack.last();
+		stack.pop_back();
+		for (int i = parOfs[v]; i < parOfs[v + 1]; i++) {
+
+			int p = parIdx[i];
+			if (visited[p] == stamp)
+				continue;
+
+			visited[p] = stamp;
+			if (target[p] == stamp) {
+				target[p] = -stamp;
+				left--;
+			}
+			// cannot reach any of the remaining rows
+			if (gen[p] <= minGen || low[p] > maxLow || post[p] < minPost)
+				continue;
+
+			stack.append(p);
+		}
+	}
+	for (int i = 0; i < undecided.count(); i++)
+		res[undecided[i]] = (target[ancs[undecided[i]]] == -stamp);
+}
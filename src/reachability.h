@@ -0,0 +1,67 @@
+/*
+	Description: ancestor queries over the revision graph
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include <QVector>
+
+//
+//  Reachability answers 'is row a an ancestor of row b' over the loaded
+//  history without walking it in the common cases.
+//
+//  Rows are indices in loading order, parents are given in compressed sparse
+//  row form: parents of row i are parIdx[parOfs[i]] .. parIdx[parOfs[i+1] - 1].
+//
+//  Each row gets a generation number (1 + max generation of its parents) and
+//  a GRAIL style interval [low, post] from a DFS along parent links, post is
+//  the DFS finish rank and low the minimum finish rank reachable from the row.
+//  If a is an ancestor of b then gen(a) < gen(b) and [low(a), post(a)] is
+//  contained in [low(b), post(b)], so a failed test is a definite 'no'. The
+//  DFS tree interval [pre, post] gives a definite 'yes'. Only the remaining
+//  cases fall back on a walk, pruned by both labels.
+//
+//  Rows with exactly one parent are also linked in a 'linear' forest, so
+//  that reaching a row through non-merge revisions only is an interval test
+//  too. Caller can give the linear parents, as example when some parents are
+//  not loaded, otherwise rows with exactly one indexed parent are used.
+//
+class Reachability {
+public:
+	Reachability() : stamp(0) {}
+	void clear();
+	void build(const QVector<int>& parentOfs, const QVector<int>& parentIdx,
+	           const QVector<int>& linearParent = QVector<int>());
+	int count() const { return gen.count(); }
+	bool isParent(int par, int child) const;
+	bool isLinearAncestor(int anc, int desc, int* dist = NULL) const;
+
+	// not thread safe, see 'visited'
+	bool isAncestor(int anc, int desc) const;
+	void areAncestors(const QVector<int>& ancs, int desc, QVector<bool>& res) const;
+
+private:
+	bool mayReach(int from, int to) const {
+		return low[from] <= low[to] && post[to] <= post[from];
+	}
+	bool treeReach(int from, int to) const {
+		return pre[from] < pre[to] && post[to] < post[from];
+	}
+	bool isValid(int row) const { return row >= 0 && row < gen.count(); }
+	void nextStamp() const;
+
+	QVector<int> parOfs, parIdx; // implicitly shared with the caller
+	QVector<int> gen, pre, post, low;
+	QVector<int> linPre, linPost, linDepth;
+
+	// scratch area of fallback walk, stamped to avoid clearing at each query
+	mutable QVector<int> visited;
+	mutable QVector<int> target; // batch queries, -stamp once found
+	mutable QVector<int> stack;
+	mutable int stamp;
+};
+
+#endif
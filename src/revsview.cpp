@@ -285,6 +285,11 @@ bool RevsView::doUpdate(bool force) {
 			newFiles = true;
 
 			tab()->textEditDiff->update(st);
+
+			// browsing with Up/Down shows next patch without waiting git
+			const QStringList nb(tab()->listViewLog->neighbourShas(st.sha(), 1));
+			git->prefetchDiffs(nb, st.diffToSha(), st.allMergeFiles());
+			git->prefetchFiles(nb, st.diffToSha());
 		}
 		// call always to allow a simple refresh
 		tab()->fileList->update(files, newFiles);
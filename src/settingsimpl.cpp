@@ -56,6 +56,7 @@ SettingsImpl::SettingsImpl(QWidget* p, Git* g, int defTab) : QDialog(p), git(g)
 	checkBoxMsgOnNewSHA->setChecked(f & MSG_ON_NEW_F);
 	checkBoxEnableDragnDrop->setChecked(f & ENABLE_DRAGNDROP_F);
 	checkBoxShowShortRef->setChecked(f & ENABLE_SHORTREF_F);
+	checkBoxPatchCache->setChecked(f & PATCH_CACHE_F);
 
 	QSettings set;
 	SCRef APOpt(set.value(AM_P_OPT_KEY).toString());
@@ -330,6 +331,11 @@ void SettingsImpl::checkBoxShowShortRef_toggled(bool b) {
 	changeFlag(ENABLE_SHORTREF_F, b);
 }
 
+void SettingsImpl::checkBoxPatchCache_toggled(bool b) {
+
+	changeFlag(PATCH_CACHE_F, b);
+}
+
 void SettingsImpl::checkBoxCommitSign_toggled(bool b) {
 
 	changeFlag(SIGN_CMT_F, b);
@@ -32,6 +32,7 @@ protected slots:
 	void checkBoxMsgOnNewSHA_toggled(bool b);
 	void checkBoxEnableDragnDrop_toggled(bool b);
 	void checkBoxShowShortRef_toggled(bool b);
+	void checkBoxPatchCache_toggled(bool b);
 	void checkBoxDiffCache_toggled(bool b);
 	void checkBoxCommitSign_toggled(bool b);
 	void checkBoxCommitVerify_toggled(bool b);
@@ -0,0 +1,366 @@
+/*
+	Description: side by side patch viewer
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <QPainter>
+#include <QScrollBar>
+#include <QTextCharFormat>
+#include "patchcontent.h"
+#include "sidebyside.h"
+
+static const int MARGIN = 4; // pixels, as QTextDocument default margin
+static const int TAB_WIDTH = 8;
+static const int MAX_LINE_BYTES = 64 * 1024; // longer lines are shown truncated
+
+static QString expandTabs(SCRef line) {
+
+	if (!line.contains('\t'))
+		return line;
+
+	QString txt;
+	txt.reserve(line.length() + TAB_WIDTH);
+	for (int i = 0; i < line.length(); i++) {
+		if (line.at(i) == '\t')
+			txt.append(QString(TAB_WIDTH - txt.length() % TAB_WIDTH, ' '));
+		else
+			txt.append(line.at(i));
+	}
+	return txt;
+}
+
+QString SideBySideView::lineText(const QByteArray& buf, int ofs, bool hunkLine) {
+// used also by WordDiffer, so that spans columns match the painted text
+
+	const char* data = buf.constData();
+	const char* nl = static_cast<const char*>(memchr(data + ofs, '\n', buf.size() - ofs));
+	int len = (nl ? nl - data : buf.size()) - ofs;
+	if (hunkLine && len > 0) { // skip the +, - or space marker
+		ofs++;
+		len--;
+	}
+	return expandTabs(QString::fromLocal8Bit(data + ofs, qMin(len, MAX_LINE_BYTES)));
+}
+
+SideBySideView::SideBySideView(QWidget* parent) : QAbstractScrollArea(parent) {
+
+	differ = NULL;
+	maxCols = 0;
+	numDigits = 1;
+	setFocusPolicy(Qt::StrongFocus);
+	updateMetrics();
+}
+
+SideBySideView::~SideBySideView() {
+
+	stopDiffer();
+}
+
+void SideBySideView::stopDiffer() {
+
+	delete differ; // cancel and wait
+	differ = NULL;
+}
+
+void SideBySideView::clear() {
+
+	stopDiffer();
+	buf = QByteArray();
+	rows = QVector<Row>();
+	pairLeft = pairRight = QVector<int>();
+	wordDiffs = WordDiffs();
+	maxCols = 0;
+	numDigits = 1;
+	updateScrollBars();
+	viewport()->update();
+}
+
+void SideBySideView::setPatch(const QByteArray& patch) {
+// rows are built at once, word differences in background
+
+	clear();
+	buf = patch;
+	parse();
+	updateScrollBars();
+	verticalScrollBar()->setValue(0);
+	horizontalScrollBar()->setValue(0);
+	viewport()->update();
+
+	if (pairLeft.isEmpty())
+		return;
+
+	differ = new WordDiffer(this, buf, pairLeft, pairRight);
+	connect(differ, SIGNAL(finished()), this, SLOT(on_wordDiffsReady()));
+	differ->start(QThread::LowPriority);
+}
+
+void SideBySideView::on_wordDiffsReady() {
+
+	if (!differ || sender() != differ) // could be stale
+		return;
+
+	differ->wait(); // could still be returning from run()
+	wordDiffs = differ->takeWordDiffs();
+	differ->deleteLater();
+	differ = NULL;
+	viewport()->update();
+}
+
+void SideBySideView::addRow(int type, int left, int right, int leftNum, int rightNum) {
+
+	Row r;
+	r.type = type;
+	r.left = left;
+	r.right = right;
+	r.leftNum = leftNum;
+	r.rightNum = rightNum;
+	r.pair = -1;
+	if (type == CHANGED && left != -1 && right != -1) {
+		r.pair = pairLeft.count();
+		pairLeft.append(left);
+		pairRight.append(right);
+	}
+	rows.append(r);
+}
+
+void SideBySideView::flushChange(QVector<int>& removed, QVector<int>& added, int* oldNum, int* newNum) {
+// removed and added lines of a change are paired in order
+
+	int cnt = qMax(removed.count(), added.count());
+	for (int i = 0; i < cnt; i++) {
+
+		int l = (i < removed.count() ? removed[i] : -1);
+		int r = (i < added.count() ? added[i] : -1);
+		addRow(CHANGED, l, r, (l != -1 ? (*oldNum)++ : 0), (r != -1 ? (*newNum)++ : 0));
+	}
+	removed.clear();
+	added.clear();
+}
+
+static void hunkStart(const char* data, int len, int* oldNum, int* newNum) {
+// "@@ -12,5 +12,7 @@", a missing count means 1 line
+
+	const QByteArray h(data, len);
+	int m = h.indexOf(" -");
+	int p = h.indexOf(" +");
+	*oldNum = (m != -1 ? atoi(h.constData() + m + 2) : 0);
+	*newNum = (p != -1 ? atoi(h.constData() + p + 2) : 0);
+}
+
+void SideBySideView::parse() {
+// combined diffs are not handled, PatchContent shows them unified
+
+	QVector<int> removed, added;
+	const char* data = buf.constData();
+	const int end = buf.size();
+	bool inHunk = false;
+	int oldNum = 0, newNum = 0, maxNum = 0;
+	int ofs = 0;
+	while (ofs < end) {
+
+		const char* nl = static_cast<const char*>(memchr(data + ofs, '\n', end - ofs));
+		int len = (nl ? nl - data : end) - ofs;
+		char c = (len > 0 ? data[ofs] : ' '); // an empty line is an empty context line
+		maxCols = qMax(maxCols, qMin(len, MAX_LINE_BYTES));
+
+		if (inHunk && c == '-')
+			removed.append(ofs);
+
+		else if (inHunk && c == '+')
+			added.append(ofs);
+
+		else {
+			flushChange(removed, added, &oldNum, &newNum);
+			maxNum = qMax(maxNum, qMax(oldNum, newNum));
+
+			if (inHunk && c == ' ')
+				addRow(CONTEXT, ofs, ofs, oldNum++, newNum++);
+
+			else if (inHunk && c == '\\') // "\ No newline at end of file"
+				addRow(HEADER, ofs, -1, 0, 0);
+
+			else {
+				inHunk = (len > 3 && !strncmp(data + ofs, "@@ -", 4));
+				if (inHunk)
+					hunkStart(data + ofs, len, &oldNum, &newNum);
+
+				addRow(HEADER, ofs, -1, 0, 0);
+			}
+		}
+		ofs += len + 1;
+	}
+	flushChange(removed, added, &oldNum, &newNum);
+	maxNum = qMax(maxNum, qMax(oldNum, newNum));
+	numDigits = QString::number(maxNum).length();
+}
+
+void SideBySideView::updateMetrics() {
+
+	QFontMetrics fm(font());
+	lineHeight = qMax(fm.lineSpacing(), 1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+	charWidth = qMax(fm.horizontalAdvance(QLatin1Char('x')), 1);
+#else
+	charWidth = qMax(fm.width(QLatin1Char('x')), 1);
+#endif
+	updateScrollBars();
+}
+
+void SideBySideView::updateScrollBars() {
+// horizontal scroll is shared by the two sides
+
+	int visible = qMax(viewport()->height() / lineHeight, 1);
+	QScrollBar* vsb = verticalScrollBar();
+	vsb->setRange(0, qMax(rows.count() - visible, 0));
+	vsb->setPageStep(visible);
+	vsb->setSingleStep(1);
+
+	int textWidth = qMax(viewport()->width() / 2 - (numDigits * charWidth + 2 * MARGIN), 1);
+	QScrollBar* hsb = horizontalScrollBar();
+	hsb->setRange(0, qMax(maxCols * charWidth + 2 * MARGIN - textWidth, 0));
+	hsb->setPageStep(textWidth);
+	hsb->setSingleStep(charWidth);
+}
+
+void SideBySideView::drawSide(QPainter& p, int x0, int w, int y, SCRef txt, const WordSpans* spans,
+                              const QColor& bg, const QColor& wordBg, const QColor& fg) {
+// x0 and w are the text area of a side, only its visible part is drawn
+
+	if (w <= 0)
+		return;
+
+	p.save();
+	p.setClipRect(x0, y, w, lineHeight);
+	if (bg.isValid())
+		p.fillRect(x0, y, w, lineHeight, bg);
+
+	const int x = x0 + MARGIN - horizontalScrollBar()->value();
+	const int c0 = horizontalScrollBar()->value() / charWidth;
+	const int c1 = c0 + w / charWidth + 2;
+	if (spans) {
+		FOREACH (WordSpans, it, *spans) {
+			int from = qMax((*it).from, c0);
+			int to = qMin((*it).to, c1);
+			if (from < to)
+				p.fillRect(x + from * charWidth, y, (to - from) * charWidth, lineHeight, wordBg);
+		}
+	}
+	int from = qMin(c0, txt.length());
+	p.setPen(fg);
+	p.drawText(x + from * charWidth, y + fontMetrics().ascent(), txt.mid(from, c1 - from));
+	p.restore();
+}
+
+void SideBySideView::paintEvent(QPaintEvent*) {
+
+	QPainter p(viewport());
+	p.setFont(font());
+
+	// same test of DiffHighlighter::lineFormat()
+	const bool light = palette().color(QPalette::Window).value() > palette().color(QPalette::WindowText).value();
+	const QColor removedBg(light ? QColor(255, 225, 225) : QColor(75, 30, 30));
+	const QColor removedWord(light ? QColor(255, 170, 170) : QColor(140, 45, 45));
+	const QColor addedBg(light ? QColor(225, 255, 225) : QColor(30, 70, 30));
+	const QColor addedWord(light ? QColor(160, 240, 160) : QColor(45, 130, 45));
+	const QColor emptyBg(palette().color(QPalette::Window));
+	const QColor textColor(palette().color(QPalette::Text));
+	const QColor numColor(palette().color(QPalette::Disabled, QPalette::Text));
+
+	const int w = viewport()->width();
+	const int half = w / 2;
+	const int gutter = numDigits * charWidth + 2 * MARGIN;
+	int widest = maxCols;
+	int y = 0;
+	for (int r = verticalScrollBar()->value(); r < rows.count() && y < viewport()->height(); r++, y += lineHeight) {
+
+		const Row& row = rows[r];
+		if (row.type == HEADER) {
+			const QString txt(lineText(buf, row.left, false));
+			const QTextCharFormat fmt(DiffHighlighter::lineFormat(txt, 0));
+			QColor bg(fmt.hasProperty(QTextFormat::BackgroundBrush) ? fmt.background().color() : QColor());
+			QColor fg(fmt.hasProperty(QTextFormat::ForegroundBrush) ? fmt.foreground().color() : textColor);
+			drawSide(p, 0, w, y, txt, NULL, bg, bg, fg);
+			widest = qMax(widest, txt.length());
+			continue;
+		}
+		const WordDiff* wd = (row.pair != -1 && row.pair < wordDiffs.count() ? &wordDiffs[row.pair] : NULL);
+		const bool changed = (row.type == CHANGED);
+
+		p.setPen(numColor);
+		if (row.leftNum)
+			p.drawText(QRect(0, y, gutter - MARGIN, lineHeight),
+			           Qt::AlignRight | Qt::AlignVCenter, QString::number(row.leftNum));
+		if (row.rightNum)
+			p.drawText(QRect(half, y, gutter - MARGIN, lineHeight),
+			           Qt::AlignRight | Qt::AlignVCenter, QString::number(row.rightNum));
+
+		if (row.left != -1) {
+			const QString txt(lineText(buf, row.left, true));
+			drawSide(p, gutter, half - gutter, y, txt, (wd ? &wd->left : NULL),
+			         (changed ? removedBg : QColor()), removedWord, textColor);
+			widest = qMax(widest, txt.length());
+		} else
+			p.fillRect(gutter, y, half - gutter, lineHeight, emptyBg);
+
+		if (row.right != -1) {
+			const QString txt(row.right == row.left ? lineText(buf, row.left, true)
+			                                        : lineText(buf, row.right, true));
+			drawSide(p, half + gutter, w - half - gutter, y, txt, (wd ? &wd->right : NULL),
+			         (changed ? addedBg : QColor()), addedWord, textColor);
+			widest = qMax(widest, txt.length());
+		} else
+			p.fillRect(half + gutter, y, w - half - gutter, lineHeight, emptyBg);
+	}
+	p.setPen(palette().color(QPalette::Mid));
+	p.drawLine(half, 0, half, viewport()->height());
+
+	if (widest > maxCols) { // tabs are known only once painted
+		maxCols = widest;
+		updateScrollBars();
+	}
+}
+
+void SideBySideView::resizeEvent(QResizeEvent* e) {
+
+	QAbstractScrollArea::resizeEvent(e);
+	updateScrollBars();
+}
+
+void SideBySideView::changeEvent(QEvent* e) {
+
+	if (e->type() == QEvent::FontChange)
+		updateMetrics();
+
+	QAbstractScrollArea::changeEvent(e);
+}
+
+WordDiffer::WordDiffer(QObject* p, const QByteArray& b, const QVector<int>& l, const QVector<int>& r)
+                       : QThread(p), buf(b), left(l), right(r), canceled(false) {}
+
+WordDiffer::~WordDiffer() {
+
+	cancel();
+	wait();
+}
+
+WordDiffs WordDiffer::takeWordDiffs() {
+// to be called once the thread is finished
+
+	WordDiffs w(wordDiffs);
+	wordDiffs.clear();
+	return w;
+}
+
+void WordDiffer::run() {
+
+	wordDiffs.resize(left.count());
+	for (int i = 0; i < left.count() && !canceled; i++) {
+
+		const QString a(SideBySideView::lineText(buf, left[i], true));
+		const QString b(SideBySideView::lineText(buf, right[i], true));
+		wordDiff(a, b, &wordDiffs[i]);
+	}
+}
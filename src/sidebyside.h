@@ -0,0 +1,92 @@
+/*
+	Description: side by side patch viewer
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef SIDEBYSIDE_H
+#define SIDEBYSIDE_H
+
+#include <QAbstractScrollArea>
+#include <QByteArray>
+#include <QThread>
+#include <QVector>
+#include "common.h"
+#include "worddiff.h"
+
+class WordDiffer;
+
+//
+//  SideBySideView shows a patch, as output by git, with old and new lines
+//  in two columns. Rows point to lines in the raw bytes and are decoded
+//  only when painted. Removed and added lines of a change are paired in
+//  order and their word level differences are found by a WordDiffer.
+//
+class SideBySideView : public QAbstractScrollArea {
+Q_OBJECT
+public:
+	SideBySideView(QWidget* parent);
+	~SideBySideView();
+	void clear();
+	void setPatch(const QByteArray& patch);
+
+	static QString lineText(const QByteArray& buf, int ofs, bool hunkLine);
+
+protected:
+	virtual void paintEvent(QPaintEvent* e);
+	virtual void resizeEvent(QResizeEvent* e);
+	virtual void changeEvent(QEvent* e);
+
+private slots:
+	void on_wordDiffsReady();
+
+private:
+	enum RowType {
+		HEADER,  // whole width line, file header, hunk header, stat
+		CONTEXT, // same line on both sides
+		CHANGED  // removed line on the left, added on the right
+	};
+	struct Row {
+		int type;
+		int left, right;      // line offsets in buf, -1 if empty side
+		int leftNum, rightNum;
+		int pair;             // index of word differences, -1 if none
+	};
+	void parse();
+	void addRow(int type, int left, int right, int leftNum, int rightNum);
+	void flushChange(QVector<int>& removed, QVector<int>& added, int* oldNum, int* newNum);
+	void stopDiffer();
+	void updateMetrics();
+	void updateScrollBars();
+	void drawSide(QPainter& p, int x0, int w, int y, SCRef txt, const WordSpans* spans,
+	              const QColor& bg, const QColor& wordBg, const QColor& fg);
+
+	QByteArray buf;
+	QVector<Row> rows;
+	QVector<int> pairLeft, pairRight; // line offsets of paired changed lines
+	WordDiffs wordDiffs;
+	WordDiffer* differ;
+	int maxCols;   // widest line seen so far, in characters
+	int numDigits; // of the biggest line number
+	int lineHeight, charWidth;
+};
+
+class WordDiffer : public QThread {
+Q_OBJECT
+public:
+	WordDiffer(QObject* p, const QByteArray& buf, const QVector<int>& left, const QVector<int>& right);
+	~WordDiffer();
+	void cancel() { canceled = true; }
+	WordDiffs takeWordDiffs();
+
+protected:
+	virtual void run();
+
+private:
+	QByteArray buf;
+	QVector<int> left, right;
+	WordDiffs wordDiffs;
+	volatile bool canceled;
+};
+
+#endif
@@ -75,20 +75,20 @@ OBJECTS_DIR = $$BUILD_DIR
 FORMS += commit.ui console.ui customaction.ui fileview.ui help.ui \
          mainview.ui patchview.ui rangeselect.ui revsview.ui settings.ui
 
-HEADERS += annotate.h cache.h commitimpl.h common.h config.h consoleimpl.h \
-           customactionimpl.h dataloader.h domain.h exceptionmanager.h \
+HEADERS += annotate.h bigfileview.h blameparser.h cache.h commitimpl.h common.h config.h consoleimpl.h \
+           customactionimpl.h dataloader.h diffcache.h domain.h exceptionmanager.h \
            filecontent.h filelist.h fileview.h git.h help.h inputdialog.h lanes.h \
-           listview.h mainimpl.h myprocess.h patchcontent.h patchview.h \
-           rangeselectimpl.h revdesc.h revsview.h settingsimpl.h \
-           smartbrowse.h treeview.h \
+           listview.h mainimpl.h myprocess.h patchcontent.h patchview.h patchviewport.h \
+           rangeselectimpl.h reachability.h revdesc.h revsview.h settingsimpl.h sidebyside.h \
+           smartbrowse.h textfind.h treeindex.h treeview.h worddiff.h \
     FileHistory.h
 
-SOURCES += annotate.cpp cache.cpp commitimpl.cpp consoleimpl.cpp \
-           customactionimpl.cpp dataloader.cpp domain.cpp exceptionmanager.cpp \
+SOURCES += annotate.cpp bigfileview.cpp blameparser.cpp cache.cpp commitimpl.cpp consoleimpl.cpp \
+           customactionimpl.cpp dataloader.cpp diffcache.cpp domain.cpp exceptionmanager.cpp \
            filecontent.cpp filelist.cpp fileview.cpp git.cpp inputdialog.cpp \
            lanes.cpp listview.cpp mainimpl.cpp myprocess.cpp namespace_def.cpp \
-           patchcontent.cpp patchview.cpp qgit.cpp rangeselectimpl.cpp \
-           revdesc.cpp revsview.cpp settingsimpl.cpp smartbrowse.cpp treeview.cpp \
+           patchcontent.cpp patchview.cpp patchviewport.cpp qgit.cpp rangeselectimpl.cpp \
+           reachability.cpp revdesc.cpp revsview.cpp settingsimpl.cpp sidebyside.cpp smartbrowse.cpp textfind.cpp treeindex.cpp treeview.cpp worddiff.cpp \
     FileHistory.cc \
     common.cpp
 
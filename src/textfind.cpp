@@ -0,0 +1,268 @@
+/*
+	Description: find text in text views
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <algorithm>
+#include <QScrollBar>
+#include <QTextDocument>
+#include <QTextEdit>
+#include "textfind.h"
+
+TextFind::TextFind(QTextEdit* t) : QObject(t), te(t) {
+
+	matcher = NULL;
+	isRegExp = hasExtras = pending = pendingBackward = false;
+	maxLen = 0;
+
+	connect(te->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(on_scrolled()));
+	connect(te->verticalScrollBar(), SIGNAL(rangeChanged(int, int)), this, SLOT(on_scrolled()));
+	connect(te->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(on_scrolled()));
+	connect(te->document(), SIGNAL(contentsChange(int, int, int)),
+	        this, SLOT(on_contentsChange(int, int, int)));
+}
+
+TextFind::~TextFind() {
+
+	stop();
+}
+
+void TextFind::stop() {
+
+	delete matcher; // cancel and wait
+	matcher = NULL;
+	pending = false;
+}
+
+bool TextFind::search(SCRef pat, bool isRE) {
+// returns false only on an invalid regular expression
+
+	if (pat == pattern && isRE == isRegExp)
+		return true; // index is ready or being built
+
+	stop();
+	matches.clear();
+	maxLen = 0;
+	pattern = "";
+	highlightVisible();
+
+	if (isRE) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+		if (!QRegExp(pat).isValid())
+#else
+		if (!QRegularExpression(pat).isValid())
+#endif
+			return false;
+	}
+	pattern = pat;
+	isRegExp = isRE;
+	if (pattern.isEmpty())
+		return true;
+
+	matcher = new TextMatcher(this, te->toPlainText(), pattern, isRegExp);
+	connect(matcher, SIGNAL(finished()), this, SLOT(on_matchesReady()));
+	matcher->start(QThread::LowPriority);
+	return true;
+}
+
+void TextFind::on_matchesReady() {
+
+	if (!matcher || sender() != matcher) // could be stale
+		return;
+
+	matcher->wait(); // could still be returning from run()
+	matches = matcher->takeMatches();
+	matcher->deleteLater();
+	matcher = NULL;
+
+	maxLen = 0;
+	FOREACH (Matches, it, matches)
+		maxLen = qMax(maxLen, (*it).len);
+
+	highlightVisible();
+	if (pending) {
+		pending = false;
+		emit jumpPending(pendingBackward);
+	}
+}
+
+int TextFind::jump(bool backward) {
+// search starts from the selection, as QTextEdit::find()
+
+	if (matcher) {
+		pending = true;
+		pendingBackward = backward;
+		return PENDING;
+	}
+	QTextCursor c(te->textCursor());
+	Matches::const_iterator it;
+	if (!backward) {
+		it = std::lower_bound(matches.constBegin(), matches.constEnd(), Match(c.selectionEnd(), 0));
+		if (it == matches.constEnd())
+			return NOT_FOUND;
+	} else {
+		it = std::lower_bound(matches.constBegin(), matches.constEnd(), Match(c.selectionStart(), 0));
+		if (it == matches.constBegin())
+			return NOT_FOUND;
+		--it;
+	}
+	c.setPosition((*it).pos);
+	c.setPosition((*it).pos + (*it).len, QTextCursor::KeepAnchor);
+	te->setTextCursor(c); // scrolls to make it visible
+	return FOUND;
+}
+
+void TextFind::on_scrolled() {
+
+	highlightVisible();
+}
+
+void TextFind::on_contentsChange(int, int removed, int added) {
+// the index is of the old content, a new search is needed
+
+	if (removed == 0 && added == 0) // only formatting changed
+		return;
+
+	if (!pattern.isEmpty() || hasExtras) {
+		stop();
+		matches.clear();
+		pattern = "";
+		highlightVisible();
+	}
+}
+
+void TextFind::highlightVisible() {
+// an ExtraSelection for each match of the whole document is way
+// too slow on big files, so only the ones on screen are created
+
+	if (matches.isEmpty() && !hasExtras)
+		return;
+
+	QList<QTextEdit::ExtraSelection> extras;
+	if (!matches.isEmpty()) {
+
+		QWidget* vp = te->viewport();
+		int first = te->cursorForPosition(QPoint(0, 0)).position();
+		int last = te->cursorForPosition(QPoint(vp->width(), vp->height())).position();
+
+		Matches::const_iterator it = std::lower_bound(matches.constBegin(),
+		                             matches.constEnd(), Match(first - maxLen, 0));
+
+		for ( ; it != matches.constEnd() && (*it).pos <= last; ++it) {
+
+			QTextEdit::ExtraSelection extra;
+			extra.format.setBackground(Qt::yellow);
+			extra.cursor = QTextCursor(te->document());
+			extra.cursor.setPosition((*it).pos);
+			extra.cursor.setPosition((*it).pos + (*it).len, QTextCursor::KeepAnchor);
+			extras.append(extra);
+		}
+	}
+	te->setExtraSelections(extras);
+	hasExtras = !extras.isEmpty();
+}
+
+TextMatcher::TextMatcher(QObject* p, SCRef t, SCRef pat, bool isRE)
+                         : QThread(p), txt(t), pattern(pat), isRegExp(isRE), canceled(false) {}
+
+TextMatcher::~TextMatcher() {
+
+	cancel();
+	wait();
+}
+
+TextFind::Matches TextMatcher::takeMatches() {
+// to be called once the thread is finished
+
+	TextFind::Matches m(matches);
+	matches.clear();
+	return m;
+}
+
+void TextMatcher::run() {
+
+	if (isRegExp)
+		searchRegExp();
+	else
+		searchText();
+}
+
+static inline ushort foldCase(ushort c) {
+
+	if (c < 128)
+		return (c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c);
+
+	return QChar(c).toCaseFolded().unicode();
+}
+
+void TextMatcher::searchText() {
+// case insensitive Boyer-Moore-Horspool, the skip table is indexed by
+// the low byte of the character and keeps the smallest shift in case of
+// collisions. Matches do not overlap, as with repeated QTextEdit::find()
+
+	const int m = pattern.length();
+	const int n = txt.length();
+	if (m == 0 || m > n)
+		return;
+
+	QVector<ushort> p(m);
+	for (int i = 0; i < m; i++)
+		p[i] = foldCase(pattern.at(i).unicode());
+
+	int skip[256];
+	for (int i = 0; i < 256; i++)
+		skip[i] = m;
+
+	for (int i = 0; i < m - 1; i++)
+		skip[p[i] & 0xFF] = m - 1 - i;
+
+	const ushort* d = txt.utf16();
+	const ushort lastChar = p[m - 1];
+	int pos = 0;
+	while (pos <= n - m && !canceled) {
+
+		ushort c = foldCase(d[pos + m - 1]);
+		if (c == lastChar) {
+			int i = m - 2;
+			while (i >= 0 && foldCase(d[pos + i]) == p[i])
+				i--;
+
+			if (i < 0) {
+				matches.append(TextFind::Match(pos, m));
+				pos += m;
+				continue;
+			}
+		}
+		pos += skip[c & 0xFF];
+	}
+}
+
+void TextMatcher::searchRegExp() {
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	QRegExp re(pattern, Qt::CaseInsensitive);
+#else
+	QRegularExpression re(pattern, QRegularExpression::CaseInsensitiveOption);
+#endif
+	int pos = 0, len;
+	while (!canceled) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+		pos = re.indexIn(txt, pos);
+		len = re.matchedLength();
+#else
+		QRegularExpressionMatch match(re.match(txt, pos));
+		pos = (match.hasMatch() ? match.capturedStart() : -1);
+		len = match.capturedLength();
+#endif
+		if (pos == -1)
+			break;
+
+		if (len <= 0) { // empty match, e.g. 'a*'
+			pos++;
+			continue;
+		}
+		matches.append(TextFind::Match(pos, len));
+		pos += len;
+	}
+}
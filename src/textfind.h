@@ -0,0 +1,94 @@
+/*
+	Description: find text in text views
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef TEXTFIND_H
+#define TEXTFIND_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+#include <QRegExp>
+#else
+#include <QRegularExpression>
+#endif
+#include "common.h"
+
+class QTextEdit;
+class TextMatcher;
+
+//
+//  TextFind is attached to a QTextEdit and keeps the sorted index of all
+//  the matches of the searched text. Index is built by a TextMatcher on a
+//  copy of the document, only matches in the visible area are highlighted
+//  and jumping to next or previous one is a binary search on the index.
+//
+class TextFind : public QObject {
+Q_OBJECT
+public:
+	explicit TextFind(QTextEdit* te);
+	~TextFind();
+	bool search(SCRef pattern, bool isRegExp);
+	int jump(bool backward);
+
+	enum JumpResult {
+		FOUND,
+		NOT_FOUND,
+		PENDING // called again through jumpPending() when index is ready
+	};
+	struct Match {
+		Match() : pos(0), len(0) {}
+		Match(int p, int l) : pos(p), len(l) {}
+		bool operator<(const Match& m) const { return pos < m.pos; }
+		int pos, len;
+	};
+	typedef QVector<Match> Matches;
+
+signals:
+	void jumpPending(bool backward);
+
+private slots:
+	void on_scrolled();
+	void on_contentsChange(int pos, int removed, int added);
+	void on_matchesReady();
+
+private:
+	void stop();
+	void highlightVisible();
+
+	QTextEdit* te;
+	TextMatcher* matcher;
+	Matches matches;
+	QString pattern;
+	bool isRegExp;
+	bool hasExtras;
+	bool pending, pendingBackward;
+	int maxLen; // longest match, for the ones starting above the view
+};
+
+class TextMatcher : public QThread {
+Q_OBJECT
+public:
+	TextMatcher(QObject* p, SCRef txt, SCRef pattern, bool isRegExp);
+	~TextMatcher();
+	void cancel() { canceled = true; }
+	TextFind::Matches takeMatches();
+
+protected:
+	virtual void run();
+
+private:
+	void searchText();
+	void searchRegExp();
+
+	QString txt;
+	QString pattern;
+	bool isRegExp;
+	TextFind::Matches matches;
+	volatile bool canceled;
+};
+
+#endif
@@ -0,0 +1,362 @@
+/*
+	Description: nearest tags and branches computation
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <algorithm>
+#include <QHash>
+#include <QPair>
+#include "common.h"
+#include "treeindex.h"
+
+TreeIndexer::TreeIndexer(QObject* p, TreeIndex* idx, TreeIndexPtr prevIdx)
+                         : QThread(p), ti(idx), prev(prevIdx), canceled(false) {}
+
+TreeIndexer::~TreeIndexer() {
+
+	cancel();
+	wait();
+	delete ti;
+}
+
+TreeIndex* TreeIndexer::takeIndex() {
+// to be called once the thread is finished
+
+	TreeIndex* idx = ti;
+	ti = NULL;
+	return idx;
+}
+
+void TreeIndexer::mergeBranches(int p, int r) {
+
+	int r_descBrnMaster = (ti->refs[r] & TreeIndex::IS_BRANCH ? r : ti->descBrnMaster[r]);
+
+	if (ti->descBrnMaster[p] == r_descBrnMaster || r_descBrnMaster == -1)
+		return;
+
+	// we want all the descendant branches, so just avoid duplicates
+	const QVector<int> src1(ti->descBranches[ti->descBrnMaster[p]]);
+	const QVector<int> src2(ti->descBranches[r_descBrnMaster]);
+	QVector<int> dst(src1);
+	for (int i = 0; i < src2.count(); i++)
+		if (std::find(src1.constBegin(), src1.constEnd(), src2[i]) == src1.constEnd())
+			dst.append(src2[i]);
+
+	ti->descBranches[p] = dst;
+	ti->descBrnMaster[p] = p;
+}
+
+void TreeIndexer::mergeNearTags(bool down, int p, int r) {
+
+	bool isTag = (ti->refs[r] & TreeIndex::IS_TAG);
+	QVector<int>& masters = (down ? ti->descRefsMaster : ti->ancRefsMaster);
+	QVector<QVector<int> >& nearRefs = (down ? ti->descRefs : ti->ancRefs);
+	int r_master = isTag ? r : masters[r];
+
+	if (masters[p] == r_master || r_master == -1)
+		return;
+
+	// we want the nearest tag only, so remove any tag
+	// that is ancestor of any other tag in p U r
+	const QVector<int> src1(nearRefs[masters[p]]);
+	const QVector<int> src2(nearRefs[r_master]);
+	QVector<int> dst(src1);
+
+	for (int s2 = 0; s2 < src2.count(); s2++) {
+
+		bool add = false;
+		for (int s1 = 0; s1 < src1.count(); s1++) {
+
+			if (src2[s2] == src1[s1]) {
+				add = false;
+				break;
+			}
+			bool isAnc2 = reach.isAncestor(src2[s2], src1[s1]);
+			bool isAnc1 = !isAnc2 && reach.isAncestor(src1[s1], src2[s2]);
+
+			if (!isAnc1 && !isAnc2) {
+				add = true; // could be an independent path
+				continue;
+			}
+			add = (down && isAnc2) || (!down && isAnc1);
+			if (add)
+				dst[s1] = -1; // mark for removing
+			else
+				break;
+		}
+		if (add)
+			dst.append(src2[s2]);
+	}
+	QVector<int>& refs = nearRefs[p];
+	refs.clear();
+	for (int s2 = 0; s2 < dst.count(); s2++)
+		if (dst[s2] != -1)
+			refs.append(dst[s2]);
+
+	masters[p] = p;
+}
+
+bool TreeIndexer::reuseTail(const TreeIndex& pi) {
+// after a refresh new revisions are normally loaded on top of the
+// old ones. In this case ancestor tags of the old rows are unchanged
+// because only ancestors, already indexed, are involved.
+
+	int cnt = ti->count(), oldCnt = pi.count();
+	int k = cnt - oldCnt;
+	if (oldCnt == 0 || k < 0 || pi.ancRefsMaster.count() != oldCnt)
+		return false;
+
+	for (int i = 0; i < oldCnt; i++) {
+
+		if (   ti->keys[k + i] != pi.keys[i]
+		    || (ti->refs[k + i] & TreeIndex::IS_TAG) != (pi.refs[i] & TreeIndex::IS_TAG)
+		    || ti->parOfs[k + i + 1] - ti->parOfs[k + i] != pi.parOfs[i + 1] - pi.parOfs[i])
+			return false;
+
+		for (int y = pi.parOfs[i]; y < pi.parOfs[i + 1]; y++)
+			if (ti->parIdx[ti->parOfs[k + i] + y - pi.parOfs[i]] != pi.parIdx[y] + k)
+				return false;
+	}
+	for (int i = 0; i < oldCnt; i++) {
+
+		int m = pi.ancRefsMaster[i];
+		ti->ancRefsMaster[k + i] = (m == -1 ? -1 : m + k);
+
+		const QVector<int>& src = pi.ancRefs[i];
+		if (src.isEmpty())
+			continue;
+
+		QVector<int>& dst = ti->ancRefs[k + i];
+		dst.resize(src.count());
+		for (int y = 0; y < src.count(); y++)
+			dst[y] = src[y] + k;
+	}
+	ti->reusedCnt = oldCnt;
+	return true;
+}
+
+//
+//  Pair map algorithm used before the reachability index, kept only to
+//  check the index, see checkNearTags(). Branches do not depend on it.
+//
+typedef QHash<QPair<int, int>, bool> PairMap; // true if first is ancestor of second
+
+static void updateDescMap(int idx, const QVector<int>& masters, const QVector<QVector<int> >& nearRefs,
+                          PairMap& dm, QHash<int, QVector<int> >& dv) {
+
+	QVector<int> descVec;
+	if (masters[idx] != -1) {
+
+		const QVector<int>& nr = nearRefs[masters[idx]];
+		for (int i = 0; i < nr.count(); i++) {
+
+			const QVector<int> dvv(dv.value(nr[i]));
+			if (i == 0)
+				descVec = dvv;
+
+			for (int y = 0; y < dvv.count(); y++) {
+
+				dm.insert(qMakePair(idx, dvv[y]), true);
+				dm.insert(qMakePair(dvv[y], idx), false);
+				if (i > 0 && !descVec.contains(dvv[y]))
+					descVec.append(dvv[y]);
+			}
+		}
+	}
+	descVec.append(idx);
+	dv.insert(idx, descVec);
+}
+
+static void mergePairMap(bool down, int p, int r, const TreeIndex& ti, const PairMap& dm,
+                         QVector<int>& masters, QVector<QVector<int> >& nearRefs) {
+
+	int r_master = (ti.refs[r] & TreeIndex::IS_TAG ? r : masters[r]);
+	if (masters[p] == r_master || r_master == -1)
+		return;
+
+	const QVector<int> src1(nearRefs[masters[p]]);
+	const QVector<int> src2(nearRefs[r_master]);
+	QVector<int> dst(src1);
+
+	for (int s2 = 0; s2 < src2.count(); s2++) {
+
+		bool add = false;
+		for (int s1 = 0; s1 < src1.count(); s1++) {
+
+			if (src2[s2] == src1[s1]) {
+				add = false;
+				break;
+			}
+			PairMap::const_iterator it(dm.constFind(qMakePair(src2[s2], src1[s1])));
+			if (it == dm.constEnd()) {
+				add = true; // could be an independent path
+				continue;
+			}
+			add = (down && it.value()) || (!down && !it.value());
+			if (add)
+				dst[s1] = -1;
+			else
+				break;
+		}
+		if (add)
+			dst.append(src2[s2]);
+	}
+	QVector<int>& refs = nearRefs[p];
+	refs.clear();
+	for (int s2 = 0; s2 < dst.count(); s2++)
+		if (dst[s2] != -1)
+			refs.append(dst[s2]);
+
+	masters[p] = p;
+}
+
+static bool checkRow(bool down, int row, const QVector<int>& oldRefs, const QVector<int>& newRefs) {
+
+	if (oldRefs == newRefs)
+		return true;
+
+	dbp(down ? "ASSERT in checkNearTags: descendant tags of row %1 differ"
+	         : "ASSERT in checkNearTags: ancestor tags of row %1 differ", row);
+	return false;
+}
+
+bool TreeIndexer::checkNearTags(const TreeIndex& ti) {
+
+	const int cnt = ti.count();
+
+	PairMap dm;
+	QHash<int, QVector<int> > dv;
+	QVector<QVector<int> > descRefs(cnt), ancRefs(cnt);
+	QVector<int> descMasters(cnt, -1), ancMasters(cnt, -1);
+
+	for (int i = 0; i < cnt; i++) {
+
+		bool isT = (ti.refs[i] & TreeIndex::IS_TAG);
+		if (isT) {
+			updateDescMap(i, descMasters, descRefs, dm, dv);
+			descRefs[i] = QVector<int>(1, i);
+		}
+		for (int y = ti.parOfs[i]; y < ti.parOfs[i + 1]; y++) {
+
+			int p = ti.parIdx[y];
+			if (descMasters[p] == -1)
+				descMasters[p] = isT ? i : descMasters[i];
+			else
+				mergePairMap(true, p, i, ti, dm, descMasters, descRefs);
+		}
+	}
+	for (int i = cnt - 1; i >= 0; i--) {
+
+		bool isT = (ti.refs[i] & TreeIndex::IS_TAG);
+		if (isT)
+			ancRefs[i] = QVector<int>(1, i);
+
+		for (int y = ti.childOfs[i]; y < ti.childOfs[i + 1]; y++) {
+
+			int c = ti.childIdx[y];
+			if (ancMasters[c] == -1)
+				ancMasters[c] = isT ? i : ancMasters[i];
+			else
+				mergePairMap(false, c, i, ti, dm, ancMasters, ancRefs);
+		}
+	}
+	// compare what getNearTags() would return for each row
+	bool ok = true;
+	for (int i = 0; i < cnt; i++) {
+
+		int m = descMasters[i], nm = ti.descRefsMaster[i];
+		ok &= checkRow(true, i, (m != -1 ? descRefs[m] : QVector<int>()),
+		               (nm != -1 ? ti.descRefs[nm] : QVector<int>()));
+
+		m = ancMasters[i];
+		nm = ti.ancRefsMaster[i];
+		ok &= checkRow(false, i, (m != -1 ? ancRefs[m] : QVector<int>()),
+		               (nm != -1 ? ti.ancRefs[nm] : QVector<int>()));
+	}
+	return ok;
+}
+
+void TreeIndexer::run() {
+
+	const int cnt = ti->count();
+	if (cnt == 0)
+		return;
+
+	reach.build(ti->parOfs, ti->parIdx);
+	ti->descRefs.resize(cnt);
+	ti->ancRefs.resize(cnt);
+	ti->descBranches.resize(cnt);
+	ti->descRefsMaster.fill(-1, cnt);
+	ti->ancRefsMaster.fill(-1, cnt);
+	ti->descBrnMaster.fill(-1, cnt);
+	ti->reusedCnt = 0;
+
+	// walk down the tree from latest to oldest, compute nearest
+	// descendants. A moved branch or a new tag changes them for
+	// the whole history, so this is always done from scratch
+	for (int i = 0; i < cnt; i++) {
+
+		if (canceled)
+			return;
+
+		bool isB = (ti->refs[i] & TreeIndex::IS_BRANCH);
+		bool isT = (ti->refs[i] & TreeIndex::IS_TAG);
+
+		if (isB) {
+			if (ti->descBrnMaster[i] != -1)
+				ti->descBranches[i] = ti->descBranches[ti->descBrnMaster[i]];
+
+			ti->descBranches[i].append(i);
+		}
+		if (isT) {
+			ti->descRefs[i].clear();
+			ti->descRefs[i].append(i);
+		}
+		for (int y = ti->parOfs[i]; y < ti->parOfs[i + 1]; y++) {
+
+			int p = ti->parIdx[y];
+
+			if (ti->descBrnMaster[p] == -1)
+				ti->descBrnMaster[p] = isB ? i : ti->descBrnMaster[i];
+			else
+				mergeBranches(p, i);
+
+			if (ti->descRefsMaster[p] == -1)
+				ti->descRefsMaster[p] = isT ? i : ti->descRefsMaster[i];
+			else
+				mergeNearTags(true, p, i);
+		}
+	}
+	// walk backward through the tree and compute nearest tagged
+	// ancestors, rows of an unchanged tail only feed new children
+	int tail = (prev && reuseTail(*prev) ? cnt - prev->count() : cnt);
+	prev.clear(); // release old index as soon as possible
+
+	for (int i = cnt - 1; i >= 0; i--) {
+
+		if (canceled)
+			return;
+
+		bool isTag = (ti->refs[i] & TreeIndex::IS_TAG);
+
+		if (isTag && i < tail) {
+			ti->ancRefs[i].clear();
+			ti->ancRefs[i].append(i);
+		}
+		for (int y = ti->childOfs[i]; y < ti->childOfs[i + 1]; y++) {
+
+			int c = ti->childIdx[y];
+			if (c >= tail)
+				continue;
+
+			if (ti->ancRefsMaster[c] == -1)
+				ti->ancRefsMaster[c] = isTag ? i : ti->ancRefsMaster[i];
+			else
+				mergeNearTags(false, c, i);
+		}
+	}
+#ifdef QGIT_CHECK_INDEX_TREE
+	checkNearTags(*ti);
+#endif
+}
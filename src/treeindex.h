@@ -0,0 +1,73 @@
+/*
+	Description: nearest tags and branches computation
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef TREEINDEX_H
+#define TREEINDEX_H
+
+#include <QSharedPointer>
+#include <QThread>
+#include <QVector>
+#include "reachability.h"
+
+//
+//  TreeIndex is created on the GUI thread with a snapshot of the loaded
+//  history, rows are indices in revOrder. The TreeIndexer thread fills
+//  the results and, once published by Git, the index is read only.
+//
+class TreeIndex {
+public:
+	enum RefType {
+		IS_TAG    = 1,
+		IS_BRANCH = 2
+	};
+	int count() const { return refs.count(); }
+
+	// snapshot, filled by Git before starting the indexer
+	QVector<quint64> keys; // sha prefixes, used to detect an unchanged tail
+	QVector<uchar> refs;   // RefType flags of each row
+	QVector<int> parOfs, parIdx; // parents of row i are parIdx[parOfs[i]..parOfs[i+1])
+	QVector<int> childOfs, childIdx; // same for children, in loading order
+
+	// results
+	QVector<QVector<int> > descRefs;     // descendant refs index, normally tags
+	QVector<QVector<int> > ancRefs;      // ancestor refs index, normally tags
+	QVector<QVector<int> > descBranches; // descendant branches index
+	QVector<int> descRefsMaster; // in case of many rows have the same descRefs,
+	QVector<int> ancRefsMaster;  // ancRefs or descBranches these are stored only
+	QVector<int> descBrnMaster;  // once in the row pointed by xxxMaster
+	int reusedCnt; // tail rows whose ancestor tags come from previous index
+};
+
+typedef QSharedPointer<const TreeIndex> TreeIndexPtr;
+
+class TreeIndexer : public QThread {
+Q_OBJECT
+public:
+	TreeIndexer(QObject* p, TreeIndex* ti, TreeIndexPtr prevIdx);
+	~TreeIndexer();
+	void cancel() { canceled = true; }
+	bool isCanceled() const { return canceled; }
+	TreeIndex* takeIndex();
+
+	// runs the pair map algorithm used before the reachability
+	// index on a filled index and compares the near tags
+	static bool checkNearTags(const TreeIndex& ti);
+
+protected:
+	virtual void run();
+
+private:
+	bool reuseTail(const TreeIndex& prev);
+	void mergeBranches(int p, int r);
+	void mergeNearTags(bool down, int p, int r);
+
+	TreeIndex* ti;
+	TreeIndexPtr prev;
+	Reachability reach; // not shared, queries are not thread safe
+	volatile bool canceled;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+	Description: word level differences of a changed line
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include "worddiff.h"
+
+static const int MAX_TOKENS = 2000; // longer lines are not refined
+static const int MAX_EDITS = 200;   // more different lines are not refined
+
+struct Token {
+	int from, to;
+	uint hash;
+};
+
+static void tokenize(SCRef s, QVector<Token>* tokens) {
+// words, blank runs and single punctuation characters, hashed up front
+
+	const int n = s.length();
+	int i = 0;
+	while (i < n) {
+
+		const int start = i;
+		const QChar c(s.at(i));
+		if (c.isLetterOrNumber() || c == '_')
+			while (i < n && (s.at(i).isLetterOrNumber() || s.at(i) == '_'))
+				i++;
+		else if (c.isSpace())
+			while (i < n && s.at(i).isSpace())
+				i++;
+		else
+			i++;
+
+		Token t;
+		t.from = start;
+		t.to = i;
+		t.hash = 2166136261u; // FNV-1a
+		for (int j = start; j < i; j++) {
+			t.hash ^= s.at(j).unicode();
+			t.hash *= 16777619u;
+		}
+		tokens->append(t);
+	}
+}
+
+static void backtrack(const QVector<QVector<int> >& trace, int d, int x, int y, int off,
+                      QVector<bool>* ca, QVector<bool>* cb) {
+
+	for ( ; d > 0; d--) {
+
+		const QVector<int>& v = trace[d];
+		int k = x - y;
+		bool down = (k == -d || (k != d && v[off + k - 1] < v[off + k + 1]));
+		int prevK = (down ? k + 1 : k - 1);
+		int prevX = v[off + prevK];
+		int prevY = prevX - prevK;
+
+		while (x > prevX && y > prevY) { // equal tokens
+			x--;
+			y--;
+		}
+		if (down)
+			(*cb)[prevY] = true; // inserted
+		else
+			(*ca)[prevX] = true; // deleted
+
+		x = prevX;
+		y = prevY;
+	}
+}
+
+static bool myersDiff(const QVector<uint>& a, const QVector<uint>& b, QVector<bool>* ca, QVector<bool>* cb) {
+// Myers O(ND) greedy algorithm on token hashes, the V array of each step
+// is kept to walk back the edit script. Gives up after MAX_EDITS edits
+
+	const int n = a.count(), m = b.count();
+	const int max = n + m;
+	const int off = max + 1;
+	QVector<int> v(2 * max + 3, 0);
+	QVector<QVector<int> > trace;
+	for (int d = 0; d <= qMin(max, MAX_EDITS); d++) {
+
+		trace.append(v);
+		for (int k = -d; k <= d; k += 2) {
+
+			int x;
+			if (k == -d || (k != d && v[off + k - 1] < v[off + k + 1]))
+				x = v[off + k + 1];
+			else
+				x = v[off + k - 1] + 1;
+
+			int y = x - k;
+			while (x < n && y < m && a[x] == b[y]) {
+				x++;
+				y++;
+			}
+			v[off + k] = x;
+			if (x >= n && y >= m) {
+				backtrack(trace, d, n, m, off, ca, cb);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void toSpans(const QVector<Token>& t, int first, const QVector<bool>& changed,
+                    WordSpans* spans) {
+
+	for (int i = 0; i < changed.count(); i++) {
+
+		if (!changed[i])
+			continue;
+
+		const Token& tk = t[first + i];
+		if (!spans->isEmpty() && spans->last().to == tk.from)
+			spans->last().to = tk.to; // adjacent tokens are merged
+		else
+			spans->append(WordSpan(tk.from, tk.to));
+	}
+}
+
+void wordDiff(SCRef a, SCRef b, WordDiff* wd) {
+// nothing is marked when lines are too long or have nothing in common
+
+	QVector<Token> ta, tb;
+	tokenize(a, &ta);
+	tokenize(b, &tb);
+	if (ta.count() + tb.count() > MAX_TOKENS)
+		return;
+
+	// common head and tail are skipped, usually most of the line
+	const int na = ta.count(), nb = tb.count();
+	int pre = 0;
+	while (pre < na && pre < nb && ta[pre].hash == tb[pre].hash)
+		pre++;
+
+	int suf = 0;
+	while (suf < na - pre && suf < nb - pre && ta[na - 1 - suf].hash == tb[nb - 1 - suf].hash)
+		suf++;
+
+	QVector<uint> ha, hb;
+	for (int i = pre; i < na - suf; i++)
+		ha.append(ta[i].hash);
+
+	for (int i = pre; i < nb - suf; i++)
+		hb.append(tb[i].hash);
+
+	QVector<bool> ca(ha.count(), false), cb(hb.count(), false);
+	if (!myersDiff(ha, hb, &ca, &cb))
+		return;
+
+	if (pre == 0 && suf == 0 && !ca.contains(false) && !cb.contains(false))
+		return;
+
+	toSpans(ta, pre, ca, &wd->left);
+	toSpans(tb, pre, cb, &wd->right);
+}
@@ -0,0 +1,29 @@
+/*
+	Description: word level differences of a changed line
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#ifndef WORDDIFF_H
+#define WORDDIFF_H
+
+#include <QVector>
+#include "common.h"
+
+struct WordSpan {
+	WordSpan() : from(0), to(0) {}
+	WordSpan(int f, int t) : from(f), to(t) {}
+	int from, to; // columns of the tab expanded line
+};
+typedef QVector<WordSpan> WordSpans;
+
+struct WordDiff {
+	WordSpans left, right; // changed words of the removed and added line
+};
+typedef QVector<WordDiff> WordDiffs;
+
+// fills the spans of the words that differ between a removed and an
+// added line, nothing is marked if lines are too long or too different
+void wordDiff(SCRef a, SCRef b, WordDiff* wd);
+
+#endif
@@ -0,0 +1,144 @@
+/*
+	Description: tests of the annotation run table
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <QtTest>
+#include "common.h"
+
+class TestAnnotationLines : public QObject {
+Q_OBJECT
+private slots:
+	void appendRuns();
+	void at();
+	void vectorRoundTrip();
+	void appendRange();
+	void mapOrigins();
+	void streamRoundTrip();
+};
+
+static AnnotationLines sample() {
+// lines 0-2 from 3, 3-4 from 5, line 5 from a merge, 6-9 from 3
+
+	AnnotationLines al;
+	al.append(3, 3);
+	al.append(5, 2);
+	al.append(AnnotationLines::MERGE);
+	al.append(3, 4);
+	return al;
+}
+
+void TestAnnotationLines::appendRuns() {
+
+	AnnotationLines al;
+	QVERIFY(al.isEmpty());
+	QCOMPARE(al.count(), 0);
+
+	al.append(7, 0); // nothing to add
+	QVERIFY(al.isEmpty());
+
+	al.append(7);
+	al.append(7, 2); // same origin, joined to the last run
+	QCOMPARE(al.count(), 3);
+	QCOMPARE(al.toVector(), QVector<int>() << 7 << 7 << 7);
+
+	al = sample();
+	QCOMPARE(al.count(), 10);
+	al.clear();
+	QVERIFY(al.isEmpty());
+}
+
+void TestAnnotationLines::at() {
+
+	const AnnotationLines al(sample());
+	const QVector<int> v(QVector<int>() << 3 << 3 << 3 << 5 << 5
+	                     << AnnotationLines::MERGE << 3 << 3 << 3 << 3);
+	for (int i = 0; i < v.count(); i++)
+		QCOMPARE(al.at(i), v[i]);
+
+	QCOMPARE(al.at(-1), int(AnnotationLines::NO_ORIGIN));
+	QCOMPARE(al.at(al.count()), int(AnnotationLines::NO_ORIGIN));
+	QCOMPARE(AnnotationLines().at(0), int(AnnotationLines::NO_ORIGIN));
+}
+
+void TestAnnotationLines::vectorRoundTrip() {
+
+	const AnnotationLines al(sample());
+	AnnotationLines copy;
+	copy.fromVector(al.toVector());
+	QCOMPARE(copy.count(), al.count());
+	QCOMPARE(copy.toVector(), al.toVector());
+
+	copy.fromVector(QVector<int>());
+	QVERIFY(copy.isEmpty());
+}
+
+void TestAnnotationLines::appendRange() {
+
+	const AnnotationLines src(sample());
+	const QVector<int> v(src.toVector());
+
+	// every range, also the ones crossing the end of source
+	for (int from = 0; from <= src.count(); from++)
+		for (int cnt = 0; cnt <= src.count() - from + 2; cnt++) {
+
+			AnnotationLines al;
+			al.append(9);
+			al.append(src, from, cnt);
+
+			QVector<int> expected(1, 9);
+			expected += v.mid(from, qMin(cnt, src.count() - from));
+			QCOMPARE(al.toVector(), expected);
+		}
+}
+
+void TestAnnotationLines::mapOrigins() {
+
+	AnnotationLines al(sample());
+	QVector<int> newIds(6, AnnotationLines::NO_ORIGIN);
+	newIds[3] = 1;
+	newIds[5] = 2;
+	QVERIFY(al.mapOrigins(newIds));
+	QCOMPARE(al.toVector(), QVector<int>() << 1 << 1 << 1 << 2 << 2
+	         << AnnotationLines::MERGE << 1 << 1 << 1 << 1);
+
+	// an origin without a new id cannot be mapped
+	al = sample();
+	newIds[5] = AnnotationLines::NO_ORIGIN;
+	QVERIFY(!al.mapOrigins(newIds));
+
+	al = sample();
+	QVERIFY(!al.mapOrigins(QVector<int>(4, 1))); // 5 is out of range
+}
+
+void TestAnnotationLines::streamRoundTrip() {
+
+	const AnnotationLines al(sample());
+	QByteArray buf;
+	{
+		QDataStream out(&buf, QIODevice::WriteOnly);
+		al >> out;
+	}
+	AnnotationLines copy;
+	{
+		QDataStream in(buf);
+		copy << in;
+	}
+	QCOMPARE(copy.toVector(), al.toVector());
+
+	// runs without their ends are corrupted data
+	buf.clear();
+	{
+		QDataStream out(&buf, QIODevice::WriteOnly);
+		out << (QVector<int>() << 3 << 5) << (QVector<int>() << 2);
+	}
+	{
+		QDataStream in(buf);
+		copy << in;
+	}
+	QVERIFY(copy.isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestAnnotationLines)
+#include "tst_annotationlines.moc"
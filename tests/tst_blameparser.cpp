@@ -0,0 +1,137 @@
+/*
+	Description: tests of the 'git blame --incremental' parser
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <QtTest>
+#include "blameparser.h"
+
+static const QByteArray SHA1(40, '1');
+static const QByteArray SHA2(40, '2');
+static const QByteArray SHA3(40, '3');
+
+//
+//  Output of a file of 6 lines: lines 1-2 and 5-6 from a boundary commit,
+//  3 and 4 from two later ones. Commit info is given only the first time
+//  and a summary can have the same number of fields of an entry line.
+//
+static QByteArray blameOutput() {
+
+	QByteArray out;
+	out += SHA2 + " 3 3 1\n";
+	out += "author A U Thor\n";
+	out += "author-mail <author@example.com>\n";
+	out += "author-time 1500000000\n";
+	out += "author-tz +0200\n";
+	out += "committer C O Mitter\n";
+	out += "committer-mail <committer@example.com>\n";
+	out += "committer-time 1500000000\n";
+	out += "committer-tz +0200\n";
+	out += "summary Fix the second function\n";
+	out += "previous " + SHA1 + " file.c\n";
+	out += "filename file.c\n";
+	out += SHA3 + " 3 4 1\n";
+	out += "author A U Thor\n";
+	out += "summary Add a call\n";
+	out += "previous " + SHA2 + " file.c\n";
+	out += "filename file.c\n";
+	out += SHA1 + " 1 1 2\n";
+	out += "author A U Thor\n";
+	out += "summary Initial import\n";
+	out += "boundary\n";
+	out += "filename file.c\n";
+	out += SHA1 + " 4 5 2\n";
+	out += "filename file.c\n";
+	return out;
+}
+
+static QVector<int> annotate(const BlameParser& bp, const QVector<int>& origins) {
+
+	AnnotationLines al;
+	bp.toAnnotation(origins, &al);
+	return al.toVector();
+}
+
+class TestBlameParser : public QObject {
+Q_OBJECT
+private slots:
+	void parse();
+	void streamed();
+	void outOfOrder();
+	void unknownCommits();
+	void badLines();
+};
+
+void TestBlameParser::parse() {
+
+	BlameParser bp;
+	QVERIFY(bp.isEmpty());
+	bp.append(blameOutput());
+	bp.finish();
+
+	QCOMPARE(bp.commits(), QVector<QByteArray>() << SHA2 << SHA3 << SHA1);
+	QCOMPARE(annotate(bp, QVector<int>() << 7 << 8 << 3),
+	         QVector<int>() << 3 << 3 << 7 << 8 << 3 << 3);
+
+	bp.clear();
+	QVERIFY(bp.isEmpty());
+	QVERIFY(bp.commits().isEmpty());
+}
+
+void TestBlameParser::streamed() {
+// lines split among chunks, last one without new line
+
+	const QByteArray out(blameOutput());
+	for (int size = 1; size < 64; size += 7) {
+
+		BlameParser bp;
+		for (int i = 0; i < out.size(); i += size)
+			bp.append(out.mid(i, size));
+
+		bp.finish();
+		QCOMPARE(annotate(bp, QVector<int>() << 7 << 8 << 3),
+		         QVector<int>() << 3 << 3 << 7 << 8 << 3 << 3);
+	}
+	BlameParser bp;
+	bp.append(SHA1 + " 1 1 2\nfilename file.c\n" + SHA2 + " 3 3 1");
+	QCOMPARE(annotate(bp, QVector<int>() << 5 << 6), QVector<int>() << 5 << 5);
+	bp.finish();
+	QCOMPARE(annotate(bp, QVector<int>() << 5 << 6), QVector<int>() << 5 << 5 << 6);
+}
+
+void TestBlameParser::outOfOrder() {
+// lines are known as soon as their entry starts, the other ones have no origin
+
+	BlameParser bp;
+	bp.append(SHA1 + " 5 5 2\n");
+	QVERIFY(!bp.isEmpty());
+	QCOMPARE(annotate(bp, QVector<int>(1, 4)), QVector<int>() << 0 << 0 << 0 << 0 << 4 << 4);
+
+	bp.append("author A U Thor\nfilename file.c\n" + SHA2 + " 1 2 1\n");
+	QCOMPARE(annotate(bp, QVector<int>() << 4 << 9), QVector<int>() << 0 << 9 << 0 << 0 << 4 << 4);
+}
+
+void TestBlameParser::unknownCommits() {
+// origins not given yet, as example while the caller looks them up
+
+	BlameParser bp;
+	bp.append(blameOutput());
+	QCOMPARE(annotate(bp, QVector<int>(1, 7)), QVector<int>() << 0 << 0 << 7 << 0 << 0 << 0);
+	QCOMPARE(annotate(bp, QVector<int>()), QVector<int>(6, int(AnnotationLines::NO_ORIGIN)));
+}
+
+void TestBlameParser::badLines() {
+
+	BlameParser bp;
+	bp.append("fatal: no such path 'file.c' in HEAD\n");
+	bp.append("1234 1 1 1\n"); // not a sha
+	bp.append(SHA1 + " 0 0 1\n"); // lines start from 1
+	bp.append("filename file.c\n");
+	bp.append(SHA1 + " 1 1 0\n");
+	bp.finish();
+	QVERIFY(bp.isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestBlameParser)
+#include "tst_blameparser.moc"
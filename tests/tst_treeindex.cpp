@@ -0,0 +1,260 @@
+/*
+	Description: tests of the reachability index and of the nearest tags
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <algorithm>
+#include <QtTest>
+#include "reachability.h"
+#include "treeindex.h"
+
+//
+//  A history is given as the parents of each row. Rows are in loading
+//  order, so parents always come after their children.
+//
+typedef QVector<QVector<int> > Parents;
+typedef QVector<QVector<bool> > Matrix;
+
+static void toCsr(const Parents& par, QVector<int>* ofs, QVector<int>* idx) {
+
+	ofs->clear();
+	idx->clear();
+	for (int i = 0; i < par.count(); i++) {
+		ofs->append(idx->count());
+		*idx += par[i];
+	}
+	ofs->append(idx->count());
+}
+
+static Parents randomHistory(int cnt, uint seed) {
+// mostly linear with some merges and a few roots, parents are
+// near their children as in a real history
+
+	Parents par(cnt);
+	for (int i = 0; i < cnt - 1; i++) {
+
+		seed = seed * 1103515245 + 12345;
+		uint n = (seed >> 16) % 8;
+		int parCnt = (n == 0 ? 0 : (n < 6 ? 1 : 2));
+		for (int y = 0; y < parCnt; y++) {
+
+			seed = seed * 1103515245 + 12345;
+			int p = i + 1 + int((seed >> 16) % uint(qMin(cnt - i - 1, 5)));
+			if (!par[i].contains(p))
+				par[i].append(p);
+		}
+	}
+	return par;
+}
+
+static QVector<int> randomTags(int cnt, uint seed) {
+
+	QVector<int> tags;
+	for (int i = 0; i < cnt; i++) {
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) % 4 == 0)
+			tags.append(i);
+	}
+	return tags;
+}
+
+static Matrix ancestors(const Parents& par) {
+// anc[d][a] is true if a is an ancestor of d, by a plain walk
+
+	const int cnt = par.count();
+	Matrix anc(cnt, QVector<bool>(cnt, false));
+	for (int d = cnt - 1; d >= 0; d--)
+		for (int i = 0; i < par[d].count(); i++) {
+			int p = par[d][i];
+			anc[d][p] = true;
+			for (int a = p + 1; a < cnt; a++)
+				if (anc[p][a])
+					anc[d][a] = true;
+		}
+	return anc;
+}
+
+static QVector<int> nearTags(bool down, int row, const QVector<int>& tags, const Matrix& anc) {
+// tags below (down) or above the row, without the ones beyond another of them
+
+	QVector<int> cand, res;
+	for (int i = 0; i < tags.count(); i++)
+		if (down ? anc[tags[i]][row] : anc[row][tags[i]])
+			cand.append(tags[i]);
+
+	for (int i = 0; i < cand.count(); i++) {
+
+		bool isNear = true;
+		for (int y = 0; y < cand.count() && isNear; y++)
+			if (y != i)
+				isNear = !(down ? anc[cand[i]][cand[y]] : anc[cand[y]][cand[i]]);
+		if (isNear)
+			res.append(cand[i]);
+	}
+	return res; // sorted as tags
+}
+
+static QVector<int> indexTags(const TreeIndex& ti, bool down, int row) {
+// as Git::getNearTags() reads them
+
+	int m = (down ? ti.descRefsMaster[row] : ti.ancRefsMaster[row]);
+	QVector<int> res;
+	if (m != -1)
+		res = (down ? ti.descRefs[m] : ti.ancRefs[m]);
+
+	std::sort(res.begin(), res.end());
+	return res;
+}
+
+static TreeIndex* runIndexer(const Parents& par, const QVector<int>& tags) {
+
+	const int cnt = par.count();
+	TreeIndex* ti = new TreeIndex;
+	ti->keys.fill(0, cnt);
+	ti->refs.fill(0, cnt);
+	for (int i = 0; i < tags.count(); i++)
+		ti->refs[tags[i]] |= TreeIndex::IS_TAG;
+
+	Parents children(cnt);
+	for (int i = 0; i < cnt; i++)
+		for (int y = 0; y < par[i].count(); y++)
+			children[par[i][y]].append(i);
+
+	toCsr(par, &ti->parOfs, &ti->parIdx);
+	toCsr(children, &ti->childOfs, &ti->childIdx);
+
+	TreeIndexer indexer(NULL, ti, TreeIndexPtr());
+	indexer.start();
+	indexer.wait();
+	return indexer.takeIndex();
+}
+
+class TestTreeIndex : public QObject {
+Q_OBJECT
+private slots:
+	void isAncestor();
+	void areAncestors();
+	void isLinearAncestor();
+	void nearTags();
+	void severalNearestTags();
+};
+
+void TestTreeIndex::isAncestor() {
+
+	for (uint seed = 1; seed <= 20; seed++) {
+
+		const Parents par(randomHistory(60, seed));
+		const Matrix anc(ancestors(par));
+		QVector<int> ofs, idx;
+		toCsr(par, &ofs, &idx);
+		Reachability reach;
+		reach.build(ofs, idx);
+		QCOMPARE(reach.count(), par.count());
+
+		for (int d = 0; d < par.count(); d++)
+			for (int a = 0; a < par.count(); a++) {
+				QCOMPARE(reach.isAncestor(a, d), bool(anc[d][a]));
+				QCOMPARE(reach.isParent(a, d), par[d].contains(a));
+			}
+		QVERIFY(!reach.isAncestor(-1, 0));
+		QVERIFY(!reach.isAncestor(0, par.count()));
+	}
+}
+
+void TestTreeIndex::areAncestors() {
+
+	for (uint seed = 1; seed <= 20; seed++) {
+
+		const Parents par(randomHistory(60, seed));
+		const Matrix anc(ancestors(par));
+		QVector<int> ofs, idx;
+		toCsr(par, &ofs, &idx);
+		Reachability reach;
+		reach.build(ofs, idx);
+
+		QVector<int> rows;
+		for (int i = par.count() - 1; i >= 0; i--)
+			rows.append(i);
+		rows.append(rows.last()); // duplicates are allowed
+
+		QVector<bool> res;
+		for (int d = 0; d < par.count(); d++) {
+			reach.areAncestors(rows, d, res);
+			QCOMPARE(res.count(), rows.count());
+			for (int i = 0; i < rows.count(); i++)
+				QCOMPARE(bool(res[i]), bool(anc[d][rows[i]]));
+		}
+	}
+}
+
+void TestTreeIndex::isLinearAncestor() {
+
+	const Parents par(randomHistory(60, 7));
+	QVector<int> ofs, idx;
+	toCsr(par, &ofs, &idx);
+	Reachability reach;
+	reach.build(ofs, idx);
+
+	for (int d = 0; d < par.count(); d++)
+		for (int a = 0; a < par.count(); a++) {
+
+			// walk parents while there is only one
+			int v = d, steps = 0;
+			while (v != a && par[v].count() == 1) {
+				v = par[v].first();
+				steps++;
+			}
+			int dist = -1;
+			QCOMPARE(reach.isLinearAncestor(a, d, &dist), v == a);
+			if (v == a)
+				QCOMPARE(dist, steps);
+		}
+}
+
+void TestTreeIndex::nearTags() {
+// tagged rows list their own tag, so only the other ones are compared
+
+	for (uint seed = 1; seed <= 30; seed++) {
+
+		const Parents par(randomHistory(50, seed));
+		const QVector<int> tags(randomTags(par.count(), seed));
+		const Matrix anc(ancestors(par));
+		TreeIndex* ti = runIndexer(par, tags);
+		QVERIFY(ti);
+
+		for (int i = 0; i < par.count(); i++) {
+			if (tags.contains(i))
+				continue;
+
+			QCOMPARE(indexTags(*ti, true, i), ::nearTags(true, i, tags, anc));
+			QCOMPARE(indexTags(*ti, false, i), ::nearTags(false, i, tags, anc));
+		}
+		QVERIFY(TreeIndexer::checkNearTags(*ti));
+		delete ti;
+	}
+}
+
+void TestTreeIndex::severalNearestTags() {
+// row 1 merges tag 2 and tag 5, tag 5 is also an ancestor of tag 2 through
+// tag 4. Tag 4 has three nearest descendant tags, when updateDescMap() kept
+// only the ones below the last of them both 2 and 5 were listed
+
+	Parents par(6);
+	par[0] << 4;
+	par[1] << 5 << 2;
+	par[2] << 4;
+	par[3] << 4;
+	par[4] << 5;
+	const QVector<int> tags(QVector<int>() << 0 << 2 << 3 << 4 << 5);
+
+	TreeIndex* ti = runIndexer(par, tags);
+	QVERIFY(ti);
+	QCOMPARE(indexTags(*ti, false, 1), QVector<int>() << 2);
+	QCOMPARE(indexTags(*ti, true, 1), QVector<int>());
+	QVERIFY(TreeIndexer::checkNearTags(*ti));
+	delete ti;
+}
+
+QTEST_GUILESS_MAIN(TestTreeIndex)
+#include "tst_treeindex.moc"
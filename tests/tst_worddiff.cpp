@@ -0,0 +1,74 @@
+/*
+	Description: tests of the word level differences
+
+	Copyright: See COPYING file that comes with this distribution
+
+*/
+#include <QtTest>
+#include "worddiff.h"
+
+static QString toString(const WordSpans& spans) {
+// as "from-to from-to", easier to read when a comparison fails
+
+	QStringList sl;
+	FOREACH (WordSpans, it, spans)
+		sl.append(QString("%1-%2").arg((*it).from).arg((*it).to));
+	return sl.join(" ");
+}
+
+class TestWordDiff : public QObject {
+Q_OBJECT
+private slots:
+	void wordDiff_data();
+	void wordDiff();
+	void tooManyTokens();
+};
+
+void TestWordDiff::wordDiff_data() {
+
+	QTest::addColumn<QString>("removed");
+	QTest::addColumn<QString>("added");
+	QTest::addColumn<QString>("left");
+	QTest::addColumn<QString>("right");
+
+	QTest::newRow("same line") << "int a = 1;" << "int a = 1;" << "" << "";
+	QTest::newRow("empty lines") << "" << "" << "" << "";
+	QTest::newRow("changed word") << "int a = 1;" << "int a = 2;" << "8-9" << "8-9";
+	QTest::newRow("inserted words") << "foo(x)" << "foo(x, y)" << "" << "5-8";
+	QTest::newRow("removed words") << "foo(x, y)" << "foo(x)" << "5-8" << "";
+	QTest::newRow("two changes") << "a + b + c" << "a - b + d" << "2-3 8-9" << "2-3 8-9";
+	QTest::newRow("nothing in common") << "abc" << "xyz" << "" << "";
+}
+
+void TestWordDiff::wordDiff() {
+
+	QFETCH(QString, removed);
+	QFETCH(QString, added);
+	QFETCH(QString, left);
+	QFETCH(QString, right);
+
+	WordDiff wd;
+	::wordDiff(removed, added, &wd);
+	QCOMPARE(toString(wd.left), left);
+	QCOMPARE(toString(wd.right), right);
+}
+
+void TestWordDiff::tooManyTokens() {
+
+	const QString a(QString("a ").repeated(1001));
+	QString b(a);
+	b[0] = 'b';
+
+	WordDiff wd;
+	::wordDiff(a, b, &wd);
+	QVERIFY(wd.left.isEmpty());
+	QVERIFY(wd.right.isEmpty());
+
+	// a shorter line is refined
+	::wordDiff(a.left(20), b.left(20), &wd);
+	QCOMPARE(toString(wd.left), QString("0-1"));
+	QCOMPARE(toString(wd.right), QString("0-1"));
+}
+
+QTEST_APPLESS_MAIN(TestWordDiff)
+#include "tst_worddiff.moc"